@@ -0,0 +1,593 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Drives the object graph with a synthetic default-free zone,
+ * and a loopback action backend, as in the tests, so nothing
+ * reaches the kernel.
+ *
+ * With -k, rule changes go through the real queue and encoder
+ * instead, to a fake kernel on the other end of the socket, see
+ * fake_nl.c, and each phase lasts until everything is answered.
+ *
+ * Every phase prints one line of key=value pairs, so that
+ * results can be compared across commits.
+ */
+
+#include "../src/common.h"
+#include "../src/.version.h"
+
+#include <malloc.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "../src/obj_link.h"
+#include "../src/obj_neigh.h"
+#include "../src/obj_route.h"
+#include "../src/obj_target.h"
+#include "../src/obj_rule.h"
+#include "../src/tc_action.h"
+#include "../src/tc_encode.h"
+#include "../src/neigh_action.h"
+#include "../src/nl_decode.h"
+#include "../src/nl_filter.h"
+#include "../src/nl_conn.h"
+#include "../src/nl_queue.h"
+#include "../src/sched.h"
+
+#include "dfz.h"
+#include "fake_nl.h"
+
+#define BENCH_IFINDEX 1 /* the pretend ingress device */
+#define BENCH_LINK_IFINDEX 100 /* first vlan link */
+
+struct bench_nexthop {
+	int ifindex;
+	struct af_addr v4;
+	struct af_addr v6;
+	uint8_t lladdr[ETH_ALEN];
+};
+
+struct bench_params {
+	struct dfz_params dfz;
+	unsigned int link_cnt;
+	unsigned int nexthops_per_link;
+	unsigned int flap_cnt;
+	unsigned int flap_rounds;
+	int kernel; /* use the fake kernel */
+	struct fake_nl_params fake;
+};
+
+struct bench_phase {
+	const char *name;
+	struct timespec start;
+	uint64_t allocs;
+	uint64_t installs;
+	uint64_t replaces;
+	uint64_t uninstalls;
+	struct fake_nl_stats fake;
+};
+
+static struct bench_params params = {
+	.dfz = {
+		.v4_cnt = 1000000,
+		.v6_cnt = 200000,
+		.seed = 1,
+	},
+	.link_cnt = 8,
+	.nexthops_per_link = 4,
+	.flap_cnt = 10000,
+	.flap_rounds = 10,
+	.fake = {
+		.error_code = ENOSPC,
+		.seed = 1,
+	},
+};
+
+static struct dfz dfz;
+static struct bench_nexthop *nexthops;
+static unsigned int nexthop_cnt;
+
+static uint64_t bench_allocs;
+static uint64_t bench_installs;
+static uint64_t bench_replaces;
+static uint64_t bench_uninstalls;
+
+/* with -k */
+static struct conn bench_conns[QUEUE_LANE_CNT];
+static int (*bench_kernel_install)(EV_P_ const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, int flags);
+
+/* count allocations, the binary is linked with --wrap */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t nmemb, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+	bench_allocs++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	bench_allocs++;
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	bench_allocs++;
+	return __real_realloc(ptr, size);
+}
+
+static void bench_count_install(const struct tc_rule *tcr, const int flags)
+{
+	if (tcr == NULL)
+		bench_uninstalls++;
+	else if (flags & TCE_FLAG_REPLACE)
+		bench_replaces++;
+	else
+		bench_installs++;
+}
+
+static int bench_install_handler(EV_P_ const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, int flags)
+{
+	char buf[MNL_SOCKET_DUMP_SIZE];
+	struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
+
+	fr_ev_unused();
+	bench_count_install(tcr, flags);
+
+	/* act as if the kernel echoed it back */
+	tc_encode_rule(nlh, dev, chain_no, prio, tcr, flags | TCE_FLAG_LOOPBACK);
+	decode_nlmsg_cb(nlh, NULL);
+	return 0;
+}
+
+static int bench_kernel_install_handler(EV_P_ const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, int flags)
+{
+	bench_count_install(tcr, flags);
+	return bench_kernel_install(EV_A_ dev, chain_no, prio, tcr, flags);
+}
+
+static void bench_probe_handler(EV_P_ const int ifindex, const struct af_addr *addr)
+{
+	fr_ev_unused();
+	fr_unused(ifindex);
+	fr_unused(addr);
+}
+
+static void bench_phase_begin(struct bench_phase *ph, const char *name)
+{
+	ph->name = name;
+	ph->allocs = bench_allocs;
+	ph->installs = bench_installs;
+	ph->replaces = bench_replaces;
+	ph->uninstalls = bench_uninstalls;
+	ph->fake = *fake_nl_get_stats();
+	clock_gettime(CLOCK_MONOTONIC, &ph->start);
+}
+
+/* until every request is answered, and every retry is done */
+static void bench_settle(void)
+{
+	if (params.kernel)
+		ev_run(EV_DEFAULT, 0);
+}
+
+static void bench_phase_end(struct bench_phase *ph, const uint64_t ops)
+{
+	const struct fake_nl_stats *fake = fake_nl_get_stats();
+	struct timespec end;
+	struct rusage ru;
+	struct mallinfo2 mi;
+	double secs;
+
+	bench_settle();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	secs = (double) (end.tv_sec - ph->start.tv_sec) + (double) (end.tv_nsec - ph->start.tv_nsec) / 1e9;
+	getrusage(RUSAGE_SELF, &ru);
+	mi = mallinfo2();
+
+	printf("phase=%s ops=%"PRIu64" secs=%.3f ops_per_sec=%.0f", ph->name, ops, secs, secs > 0. ? ops / secs : 0.);
+	printf(" allocs=%"PRIu64" installs=%"PRIu64" replaces=%"PRIu64" uninstalls=%"PRIu64,
+	       bench_allocs - ph->allocs, bench_installs - ph->installs,
+	       bench_replaces - ph->replaces, bench_uninstalls - ph->uninstalls);
+	if (params.kernel)
+		printf(" requests=%"PRIu64" datagrams=%"PRIu64" injected=%"PRIu64" errors=%"PRIu64" filters=%u",
+		       fake->requests - ph->fake.requests, fake->datagrams - ph->fake.datagrams,
+		       fake->injected - ph->fake.injected, fake->errors - ph->fake.errors,
+		       fake_nl_filter_count());
+	printf(" routes=%d rules=%d heap_kb=%zu peak_rss_kb=%ld\n",
+	       obj_route_count(), obj_rule_count(), mi.uordblks / 1024, ru.ru_maxrss);
+	fflush(stdout);
+}
+
+static void bench_nexthops_init(void)
+{
+	nexthop_cnt = params.link_cnt * params.nexthops_per_link;
+	nexthops = fr_malloc(sizeof(struct bench_nexthop) * nexthop_cnt);
+
+	for (unsigned int i = 0; i < nexthop_cnt; i++) {
+		struct bench_nexthop *nh = &nexthops[i];
+		uint32_t host = i + 1;
+
+		nh->ifindex = BENCH_LINK_IFINDEX + i % params.link_cnt;
+
+		/* 100.64.0.0/10 and 2001:db8::/32 */
+		nh->v4.af = AF_INET;
+		nh->v4.in.v4.s_addr = htonl(0x64400000 | host);
+		nh->v6.af = AF_INET6;
+		nh->v6.in.v6.s6_addr[0] = 0x20;
+		nh->v6.in.v6.s6_addr[1] = 0x01;
+		nh->v6.in.v6.s6_addr[2] = 0x0d;
+		nh->v6.in.v6.s6_addr[3] = 0xb8;
+		nh->v6.in.v6.s6_addr[14] = host >> 8;
+		nh->v6.in.v6.s6_addr[15] = host & 0xff;
+
+		nh->lladdr[0] = 0x02;
+		nh->lladdr[4] = host >> 8;
+		nh->lladdr[5] = host & 0xff;
+	}
+}
+
+static void bench_links(const uint16_t nlmsg_type)
+{
+	for (unsigned int i = 0; i < params.link_cnt; i++) {
+		const uint8_t lladdr[ETH_ALEN] = { 0x02, 0xff, 0, 0, i >> 8, i & 0xff };
+		char ifname[IFNAMSIZ];
+
+		snprintf(ifname, sizeof(ifname), "vlan%u", 100 + i);
+		obj_link_netlink_update(nlmsg_type, BENCH_LINK_IFINDEX + i, &lladdr, BENCH_IFINDEX, 100 + i, 1500, ifname);
+	}
+}
+
+static void bench_neigh(const uint16_t nlmsg_type, struct bench_nexthop *nh)
+{
+	const uint8_t (*lladdr)[ETH_ALEN] = (void *) nh->lladdr;
+
+	obj_neigh_netlink_update(nlmsg_type, nh->ifindex, AF_INET, &nh->v4.in, lladdr, NUD_REACHABLE);
+	obj_neigh_netlink_update(nlmsg_type, nh->ifindex, AF_INET6, &nh->v6.in, lladdr, NUD_REACHABLE);
+}
+
+static void bench_neighs(const uint16_t nlmsg_type)
+{
+	for (unsigned int i = 0; i < nexthop_cnt; i++)
+		bench_neigh(nlmsg_type, &nexthops[i]);
+}
+
+/* as decode_route() does for a unipath route */
+static void bench_route(const uint16_t nlmsg_type, const unsigned int idx, const unsigned int nh_idx)
+{
+	const struct af_addr *dst = &dfz.dst[idx];
+	struct bench_nexthop *nh = &nexthops[nh_idx];
+	const struct af_addr *gw = dst->af == AF_INET ? &nh->v4 : &nh->v6;
+	struct obj_neigh *n = obj_neigh_netlink_get(nh->ifindex, dst->af, &gw->in);
+
+	AN(n);
+	obj_route_netlink_update(nlmsg_type, obj_target_get_unipath(n), dst);
+}
+
+static uint64_t bench_announce_all(const uint16_t nlmsg_type)
+{
+	for (unsigned int i = 0; i < dfz.cnt; i++)
+		bench_route(nlmsg_type, i, dfz.nexthop[i]);
+	return dfz.cnt;
+}
+
+/* the session to the busiest nexthop goes down, and comes back */
+static uint64_t bench_session_reset(void)
+{
+	uint64_t ops = 0;
+	unsigned int backup = nexthop_cnt > 1 ? 1 : 0;
+
+	for (unsigned int i = 0; i < dfz.cnt; i++) {
+		if (dfz.nexthop[i] != 0)
+			continue;
+		if (backup == 0)
+			bench_route(RTM_DELROUTE, i, 0);
+		else
+			bench_route(RTM_NEWROUTE, i, backup);
+		ops++;
+	}
+	for (unsigned int i = 0; i < dfz.cnt; i++) {
+		if (dfz.nexthop[i] != 0)
+			continue;
+		bench_route(RTM_NEWROUTE, i, 0);
+		ops++;
+	}
+	return ops;
+}
+
+/* the same prefixes are withdrawn and re-announced, over and over */
+static uint64_t bench_flap_storm(void)
+{
+	unsigned int cnt = params.flap_cnt < dfz.cnt ? params.flap_cnt : dfz.cnt;
+	uint64_t ops = 0;
+
+	for (unsigned int round = 0; round < params.flap_rounds; round++) {
+		for (unsigned int i = 0; i < cnt; i++)
+			bench_route(RTM_DELROUTE, i, dfz.nexthop[i]);
+		for (unsigned int i = 0; i < cnt; i++)
+			bench_route(RTM_NEWROUTE, i, dfz.nexthop[i]);
+		ops += 2 * cnt;
+	}
+	return ops;
+}
+
+/*
+ * every next-hop router is replaced, and then put back,
+ * settling in between, so the flip back doesn't supersede the flip
+ */
+static uint64_t bench_mac_change(void)
+{
+	for (int pass = 0; pass < 2; pass++) {
+		for (unsigned int i = 0; i < nexthop_cnt; i++) {
+			nexthops[i].lladdr[3] ^= 0x01;
+			bench_neigh(RTM_NEWNEIGH, &nexthops[i]);
+		}
+		bench_settle();
+	}
+	return 4 * nexthop_cnt;
+}
+
+static void bench_dump_chains(EV_P_ void *data)
+{
+	fr_unused(data);
+	filter_dump_chains(EV_A_ queue_get_conn(QUEUE_LANE_DUMP), 0);
+}
+
+static void bench_dump_chain(EV_P_ void *data)
+{
+	const struct chain *ch = data;
+
+	filter_dump_chain(EV_A_ queue_get_conn(QUEUE_LANE_DUMP), 0, ch->chain_no, false);
+}
+
+static void bench_dump_chain_terse(EV_P_ void *data)
+{
+	const struct chain *ch = data;
+
+	filter_dump_chain(EV_A_ queue_get_conn(QUEUE_LANE_DUMP), 0, ch->chain_no, true);
+}
+
+/* dump it all back, as a scan would, returns the number of filters */
+static uint64_t bench_verify(const int terse)
+{
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+	uint64_t dumped;
+
+	queue_schedule(EV_A_ bench_dump_chains, NULL, NULL);
+	ev_run(EV_A_ 0);
+	dumped = fake_nl_get_stats()->dumped;
+	for (struct rb_node *node = rb_first(&chain_tree); node != NULL; node = rb_next(node))
+		queue_schedule(EV_A_ terse ? bench_dump_chain_terse : bench_dump_chain, NULL,
+			       rb_container_of(node, struct chain, node));
+	ev_run(EV_A_ 0);
+	return fake_nl_get_stats()->dumped - dumped;
+}
+
+static void bench_kernel_init(struct tc_action_callbacks *tacb)
+{
+	fake_nl_init(&params.fake);
+	AN(nl_conn_open(0, &bench_conns[QUEUE_LANE_DUMP], "scan"));
+	queue_init(QUEUE_LANE_DUMP, &bench_conns[QUEUE_LANE_DUMP]);
+	AN(nl_conn_open(0, &bench_conns[QUEUE_LANE_INSTALL], "install"));
+	queue_init(QUEUE_LANE_INSTALL, &bench_conns[QUEUE_LANE_INSTALL]);
+
+	bench_kernel_install = tacb->install;
+	tacb->install = bench_kernel_install_handler;
+}
+
+static void bench_kernel_fini(void)
+{
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+
+	for (int i = 0; i < QUEUE_KIND_CNT; i++) {
+		const struct queue_stats *st = queue_get_stats(i);
+
+		if (st->latency.cnt == 0 && st->timeouts == 0)
+			continue;
+		printf("latency kind=%s n=%"PRIu64" p50_ms=%.3f p90_ms=%.3f p99_ms=%.3f max_ms=%.3f timeouts=%"PRIu64"\n",
+		       queue_kind_name(i), st->latency.cnt,
+		       queue_stats_percentile(i, 50.) * 1e3,
+		       queue_stats_percentile(i, 90.) * 1e3,
+		       queue_stats_percentile(i, 99.) * 1e3,
+		       st->latency.max * 1e3, st->timeouts);
+	}
+
+	for (int i = 0; i < QUEUE_LANE_CNT; i++) {
+		queue_fini(i);
+		nl_conn_close(EV_A_ &bench_conns[i]);
+	}
+	fake_nl_fini();
+}
+
+static void bench_setup(void)
+{
+	struct tc_action_callbacks *tacb;
+	struct neigh_action_callbacks *nacb;
+
+	config_init("bench");
+	config->if_cnt = 1;
+	config->ifidx[0] = BENCH_IFINDEX;
+
+	obj_set_mode(OBJ_MODE_NORMAL);
+	sched_setup();
+	obj_rule_init();
+	tacb = tc_action_get_callbacks();
+	if (params.kernel)
+		bench_kernel_init(tacb);
+	else
+		tacb->install = bench_install_handler;
+	nacb = neigh_action_get_callbacks();
+	nacb->probe = bench_probe_handler;
+	sched_init();
+}
+
+static void bench_usage(const char *prog_name)
+{
+	printf("Usage: %s [options]\n\n", prog_name);
+	printf("Options:\n");
+	printf("  -4 <cnt>     IPv4 prefixes (default: %u)\n", params.dfz.v4_cnt);
+	printf("  -6 <cnt>     IPv6 prefixes (default: %u)\n", params.dfz.v6_cnt);
+	printf("  -l <cnt>     VLAN links (default: %u)\n", params.link_cnt);
+	printf("  -n <cnt>     next-hops per link (default: %u)\n", params.nexthops_per_link);
+	printf("  -f <cnt>     prefixes in the flap storm (default: %u)\n", params.flap_cnt);
+	printf("  -r <cnt>     rounds of the flap storm (default: %u)\n", params.flap_rounds);
+	printf("  -s <seed>    seed of the generator (default: %"PRIu64")\n", params.dfz.seed);
+	printf("  -k           send rule changes to a fake kernel, through the queue\n");
+	printf("  -L <usecs>   time the fake kernel spends on each request (default: 0)\n");
+	printf("  -e <cnt>     installs per thousand, that the fake kernel fails (default: 0)\n");
+	printf("  -E <errno>   errno of the failures (default: %d)\n", params.fake.error_code);
+}
+
+static unsigned int bench_parse_uint(const char *arg, const unsigned int min)
+{
+	char *end;
+	unsigned long val = strtoul(arg, &end, 10);
+
+	if (*end != '\0' || val < min || val > UINT32_MAX)
+		error(EXIT_FAILURE, 0, "invalid number: %s", arg);
+	return val;
+}
+
+static void bench_parse_args(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "4:6:l:n:f:r:s:kL:e:E:h")) != -1) {
+		switch (c) {
+		case '4':
+			params.dfz.v4_cnt = bench_parse_uint(optarg, 0);
+			break;
+		case '6':
+			params.dfz.v6_cnt = bench_parse_uint(optarg, 0);
+			break;
+		case 'l':
+			params.link_cnt = bench_parse_uint(optarg, 1);
+			break;
+		case 'n':
+			params.nexthops_per_link = bench_parse_uint(optarg, 1);
+			break;
+		case 'f':
+			params.flap_cnt = bench_parse_uint(optarg, 0);
+			break;
+		case 'r':
+			params.flap_rounds = bench_parse_uint(optarg, 0);
+			break;
+		case 's':
+			params.dfz.seed = bench_parse_uint(optarg, 0);
+			break;
+		case 'k':
+			params.kernel = true;
+			break;
+		case 'L':
+			params.fake.latency = bench_parse_uint(optarg, 0) / 1e6;
+			break;
+		case 'e':
+			params.fake.error_permille = bench_parse_uint(optarg, 0);
+			break;
+		case 'E':
+			params.fake.error_code = bench_parse_uint(optarg, 1);
+			break;
+		case 'h':
+			bench_usage(argv[0]);
+			exit(EXIT_SUCCESS);
+		default:
+			bench_usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (params.link_cnt * params.nexthops_per_link > UINT16_MAX)
+		error(EXIT_FAILURE, 0, "too many next-hops");
+	/* the retries would never end */
+	if (params.fake.error_permille >= 1000)
+		error(EXIT_FAILURE, 0, "invalid error rate: %u", params.fake.error_permille);
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_phase ph;
+
+	bench_parse_args(argc, argv);
+	params.dfz.nexthop_cnt = params.link_cnt * params.nexthops_per_link;
+
+	printf("bench version=%s seed=%"PRIu64" v4=%u v6=%u links=%u nexthops=%u",
+	       VERSION_GIT, params.dfz.seed, params.dfz.v4_cnt, params.dfz.v6_cnt,
+	       params.link_cnt, params.dfz.nexthop_cnt);
+	if (params.kernel)
+		printf(" kernel_latency_us=%.0f kernel_errors_permille=%u kernel_errno=%d",
+		       params.fake.latency * 1e6, params.fake.error_permille, params.fake.error_code);
+	printf("\n");
+
+	bench_phase_begin(&ph, "generate");
+	dfz_generate(&dfz, &params.dfz);
+	bench_nexthops_init();
+	bench_phase_end(&ph, dfz.cnt);
+
+	bench_setup();
+
+	/* as during the initial scan, nothing is installed yet */
+	obj_rule_reset_pin();
+
+	bench_phase_begin(&ph, "links");
+	bench_links(RTM_NEWLINK);
+	bench_phase_end(&ph, params.link_cnt);
+
+	bench_phase_begin(&ph, "neighs");
+	bench_neighs(RTM_NEWNEIGH);
+	bench_phase_end(&ph, 2 * nexthop_cnt);
+
+	bench_phase_begin(&ph, "routes");
+	bench_announce_all(RTM_NEWROUTE);
+	bench_phase_end(&ph, dfz.cnt);
+
+	bench_phase_begin(&ph, "install");
+	obj_rule_remove_pin();
+	bench_settle(); /* rules only count once the kernel has answered */
+	bench_phase_end(&ph, obj_rule_count());
+
+	if (params.kernel) {
+		bench_phase_begin(&ph, "verify");
+		bench_phase_end(&ph, bench_verify(false));
+
+		bench_phase_begin(&ph, "verify-terse");
+		bench_phase_end(&ph, bench_verify(true));
+	}
+
+	bench_phase_begin(&ph, "session-reset");
+	bench_phase_end(&ph, bench_session_reset());
+
+	bench_phase_begin(&ph, "flap-storm");
+	bench_phase_end(&ph, bench_flap_storm());
+
+	bench_phase_begin(&ph, "mac-change");
+	bench_phase_end(&ph, bench_mac_change());
+
+	bench_phase_begin(&ph, "withdraw");
+	bench_phase_end(&ph, bench_announce_all(RTM_DELROUTE));
+
+	bench_phase_begin(&ph, "teardown");
+	bench_neighs(RTM_DELNEIGH);
+	bench_links(RTM_DELLINK);
+	bench_phase_end(&ph, params.link_cnt + 2 * nexthop_cnt);
+
+	printf("leftover links=%d neighs=%d targets=%d routes=%d rules=%d",
+	       obj_link_count(), obj_neigh_count(), obj_target_count(),
+	       obj_route_count(), obj_rule_count());
+	if (params.kernel)
+		printf(" filters=%u", fake_nl_filter_count());
+	printf("\n");
+
+	if (params.kernel)
+		bench_kernel_fini();
+	filter_clear_chains();
+	ev_loop_destroy(EV_DEFAULT);
+	config_free();
+	dfz_free(&dfz);
+	free(nexthops);
+	return EXIT_SUCCESS;
+}
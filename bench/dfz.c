@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "dfz.h"
+
+/*
+ * Prefix length distributions, roughly as seen in the
+ * IPv4 and IPv6 default-free zones, in parts per 100000.
+ *
+ * Whatever is left over, or doesn't fit in the address
+ * space of a prefix length, goes to the most common length.
+ */
+struct dfz_len_weight {
+	uint8_t len;
+	unsigned int weight;
+};
+
+static const struct dfz_len_weight dfz_v4_lens[] = {
+	{ 8, 2 }, { 9, 4 }, { 10, 10 }, { 11, 30 },
+	{ 12, 80 }, { 13, 170 }, { 14, 330 }, { 15, 550 },
+	{ 16, 1300 }, { 17, 800 }, { 18, 1350 }, { 19, 2500 },
+	{ 20, 4100 }, { 21, 5200 }, { 22, 11200 }, { 23, 10300 },
+	{ 0, 0 }
+};
+#define DFZ_V4_DEFAULT_LEN 24
+
+static const struct dfz_len_weight dfz_v6_lens[] = {
+	{ 19, 2 }, { 20, 5 }, { 24, 20 }, { 28, 400 },
+	{ 29, 3800 }, { 30, 500 }, { 31, 300 }, { 32, 11000 },
+	{ 33, 1000 }, { 34, 800 }, { 35, 350 }, { 36, 3000 },
+	{ 37, 300 }, { 38, 900 }, { 39, 400 }, { 40, 5500 },
+	{ 41, 500 }, { 42, 1300 }, { 43, 400 }, { 44, 6300 },
+	{ 45, 800 }, { 46, 2700 }, { 47, 1700 },
+	{ 0, 0 }
+};
+#define DFZ_V6_DEFAULT_LEN 48
+
+/* all IPv6 prefixes are within 2000::/3 */
+#define DFZ_V6_FIXED_BITS 3
+
+/* splitmix64, good enough, and the same on every platform */
+uint64_t dfz_rand(uint64_t *state)
+{
+	uint64_t z = (*state += UINT64_C(0x9e3779b97f4a7c15));
+
+	z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+	z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+	return z ^ (z >> 31);
+}
+
+/*
+ * The i'th prefix of a given length, unique for i < 2^bits,
+ * scattered over the address space, using an odd multiplier
+ */
+static uint64_t dfz_scatter(const uint64_t i, const unsigned int bits, const uint64_t offset)
+{
+	uint64_t mask = (UINT64_C(1) << bits) - 1;
+
+	return (i * UINT64_C(0x9e3779b97f4a7c15) + offset) & mask;
+}
+
+static void dfz_put_v4(struct af_addr *dst, const uint8_t len, const uint64_t x)
+{
+	uint32_t addr = (uint32_t) (x << (32 - len));
+
+	dst->af = AF_INET;
+	dst->mask_len = len;
+	dst->in.v4.s_addr = htonl(addr);
+}
+
+static void dfz_put_v6(struct af_addr *dst, const uint8_t len, const uint64_t x)
+{
+	uint64_t hi = (UINT64_C(1) << 61) | (x << (64 - len));
+
+	dst->af = AF_INET6;
+	dst->mask_len = len;
+	for (int i = 0; i < 8; i++)
+		dst->in.v6.s6_addr[i] = (uint8_t) (hi >> (56 - 8 * i));
+}
+
+static void dfz_fill(struct af_addr *dst, const unsigned int cnt, const struct dfz_len_weight *lens,
+			     const uint8_t default_len, const unsigned int fixed_bits, uint64_t *state,
+			     void (*put)(struct af_addr *dst, const uint8_t len, const uint64_t x))
+{
+	unsigned int total = 0, n = 0;
+
+	for (const struct dfz_len_weight *lw = lens; lw->len; lw++) {
+		unsigned int bits = lw->len - fixed_bits;
+		uint64_t want = (uint64_t) cnt * lw->weight / 100000;
+		uint64_t offset = dfz_rand(state);
+
+		/* leave room, so that it's still a sparse table */
+		if (want > UINT64_C(1) << (bits - 1))
+			want = UINT64_C(1) << (bits - 1);
+		for (uint64_t i = 0; i < want && total < cnt; i++)
+			put(&dst[total++], lw->len, dfz_scatter(i, bits, offset));
+	}
+
+	/* the rest */
+	uint64_t offset = dfz_rand(state);
+
+	AN(cnt - total <= UINT64_C(1) << (default_len - fixed_bits));
+	while (total < cnt)
+		put(&dst[total++], default_len, dfz_scatter(n++, default_len - fixed_bits, offset));
+}
+
+void dfz_generate(struct dfz *d, const struct dfz_params *p)
+{
+	uint64_t state = p->seed;
+	unsigned int cnt = p->v4_cnt + p->v6_cnt;
+
+	AN(p->nexthop_cnt > 0);
+	AN(p->nexthop_cnt <= UINT16_MAX);
+	d->cnt = cnt;
+	d->dst = fr_malloc(sizeof(struct af_addr) * (cnt + 1));
+	d->nexthop = fr_malloc(sizeof(uint16_t) * (cnt + 1));
+
+	dfz_fill(d->dst, p->v4_cnt, dfz_v4_lens, DFZ_V4_DEFAULT_LEN, 0, &state, dfz_put_v4);
+	dfz_fill(&d->dst[p->v4_cnt], p->v6_cnt, dfz_v6_lens, DFZ_V6_DEFAULT_LEN, DFZ_V6_FIXED_BITS, &state, dfz_put_v6);
+
+	/*
+	 * A few transit sessions carry most of the table,
+	 * so the distribution is skewed towards the first nexthops.
+	 */
+	for (unsigned int i = 0; i < cnt; i++) {
+		double u = (double) (dfz_rand(&state) >> 11) / (double) (UINT64_C(1) << 53);
+
+		d->nexthop[i] = (uint16_t) (p->nexthop_cnt * u * u);
+	}
+
+	/* announced in no particular order */
+	for (unsigned int i = cnt; i > 1; i--) {
+		unsigned int j = dfz_rand(&state) % i;
+		struct af_addr tmp_dst = d->dst[i - 1];
+		uint16_t tmp_nh = d->nexthop[i - 1];
+
+		d->dst[i - 1] = d->dst[j];
+		d->dst[j] = tmp_dst;
+		d->nexthop[i - 1] = d->nexthop[j];
+		d->nexthop[j] = tmp_nh;
+	}
+}
+
+void dfz_free(struct dfz *d)
+{
+	free(d->dst);
+	free(d->nexthop);
+	d->dst = NULL;
+	d->nexthop = NULL;
+	d->cnt = 0;
+}
@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef FLOWER_ROUTE_BENCH_DFZ_H
+#define FLOWER_ROUTE_BENCH_DFZ_H
+
+#include "../src/common.h"
+
+struct dfz_params {
+	unsigned int v4_cnt;
+	unsigned int v6_cnt;
+	unsigned int nexthop_cnt;
+	uint64_t seed;
+};
+
+/* a synthetic default-free zone, in announcement order */
+struct dfz {
+	unsigned int cnt;
+	struct af_addr *dst;
+	uint16_t *nexthop; /* index of the nexthop, per prefix */
+};
+
+uint64_t dfz_rand(uint64_t *state);
+void dfz_generate(struct dfz *d, const struct dfz_params *p);
+void dfz_free(struct dfz *d);
+
+#endif
@@ -0,0 +1,682 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * fake rtnetlink, see fake_nl.h
+ *
+ * As in the kernel, requests are handled in the sender's context, so
+ * the configured latency is spent in sendto(). Dumps are generated as
+ * the socket drains, and resume from the last key sent, as the kernel's
+ * do, so that changes made meanwhile don't upset them.
+ */
+
+#include "../src/nl_common.h"
+
+#include <time.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/if_ether.h>
+
+#include "../src/nl_filter.h"
+#include "../src/tc_encode.h"
+#include "../src/tc_decode.h"
+#include "../src/rbtree.h"
+
+#include "fake_nl.h"
+#include "dfz.h"
+
+#define FAKE_NL_DUMP_SIZE 16384 /* per datagram, as the kernel's dump skbs */
+#define FAKE_NL_PORTID_BASE 0x40000000
+
+/* a filter, as the kernel holds it */
+struct fake_nl_filter {
+	uint64_t key;
+	struct tc_decoded_rule tdr;
+	struct rb_node node;
+};
+
+/* a datagram that is ready to go, or a dump that is yet to be generated */
+struct fake_nl_reply {
+	struct fake_nl_reply *next;
+	int is_dump;
+	uint16_t type; /* of the dump request */
+	int terse;
+	uint32_t seq;
+	uint64_t cursor; /* the next key to dump */
+	uint64_t end; /* beyond the last key to dump */
+	size_t len;
+	char buf[];
+};
+
+/* completes libmnl's opaque type, for the wrapped functions */
+struct mnl_socket {
+	int fd; /* ours */
+	int kfd; /* the fake kernel's */
+	unsigned int portid;
+	ev_io wio; /* for when the socket is full */
+	struct fake_nl_reply *head;
+	struct fake_nl_reply *tail;
+	size_t out_len; /* of a datagram, that didn't fit */
+	char out[FAKE_NL_DUMP_SIZE];
+};
+
+/* the parts of a TC request, that are used here */
+struct fake_nl_tca {
+	int has_chain;
+	uint32_t chain_no;
+	int terse;
+};
+
+static struct fake_nl_params fake_nl_params;
+static struct fake_nl_stats fake_nl_stats;
+static struct rb_root fake_nl_filters = RB_ROOT;
+static unsigned int fake_nl_filter_cnt;
+static unsigned int fake_nl_last_portid = FAKE_NL_PORTID_BASE;
+static uint64_t fake_nl_rand_state;
+
+struct mnl_socket *__wrap_mnl_socket_open(int bus);
+int __wrap_mnl_socket_bind(struct mnl_socket *nl, unsigned int groups, pid_t pid);
+int __wrap_mnl_socket_close(struct mnl_socket *nl);
+int __wrap_mnl_socket_get_fd(const struct mnl_socket *nl);
+unsigned int __wrap_mnl_socket_get_portid(const struct mnl_socket *nl);
+ssize_t __wrap_mnl_socket_sendto(const struct mnl_socket *nl, const void *req, size_t siz);
+ssize_t __wrap_mnl_socket_recvfrom(const struct mnl_socket *nl, void *buf, size_t siz);
+int __wrap_mnl_socket_setsockopt(const struct mnl_socket *nl, int type, void *buf, socklen_t len);
+
+/* in the order that dumps go through them, as tc_action_key() */
+static uint64_t fake_nl_key(const unsigned int dev, const uint32_t chain_no, const uint16_t prio)
+{
+	return ((uint64_t) dev << 48) | ((uint64_t) chain_no << 16) | prio;
+}
+
+/* the first filter with a key that isn't below key */
+static struct fake_nl_filter *fake_nl_filter_next(const uint64_t key)
+{
+	struct rb_node *node = fake_nl_filters.rb_node;
+	struct fake_nl_filter *best = NULL;
+	struct fake_nl_filter *this;
+
+	while (node) {
+		this = rb_container_of(node, struct fake_nl_filter, node);
+		if (this->key < key) {
+			node = node->rb_right;
+		} else {
+			best = this;
+			if (this->key == key)
+				break;
+			node = node->rb_left;
+		}
+	}
+	return best;
+}
+
+static struct fake_nl_filter *fake_nl_filter_lookup(const uint64_t key)
+{
+	struct fake_nl_filter *f = fake_nl_filter_next(key);
+
+	return f != NULL && f->key == key ? f : NULL;
+}
+
+static void fake_nl_filter_insert(struct fake_nl_filter *f)
+{
+	struct rb_node **new = &(fake_nl_filters.rb_node), *parent = NULL;
+	struct fake_nl_filter *this;
+
+	while (*new) {
+		this = rb_container_of(*new, struct fake_nl_filter, node);
+		parent = *new;
+		AN(f->key != this->key);
+		if (f->key < this->key)
+			new = &((*new)->rb_left);
+		else
+			new = &((*new)->rb_right);
+	}
+	rb_link_node(&f->node, parent, new);
+	rb_insert_color(&f->node, &fake_nl_filters);
+	fake_nl_filter_cnt++;
+}
+
+static void fake_nl_filter_erase(struct fake_nl_filter *f)
+{
+	rb_erase(&f->node, &fake_nl_filters);
+	fake_nl_filter_cnt--;
+	free(f);
+}
+
+static void fake_nl_parse_tca(const struct nlmsghdr *nlh, struct fake_nl_tca *tca)
+{
+	const struct nla_bitfield32 *dump_flags;
+	struct nlattr *attr;
+
+	memset(tca, '\0', sizeof(*tca));
+	mnl_attr_for_each(attr, nlh, sizeof(struct tcmsg)) {
+		switch (mnl_attr_get_type(attr)) {
+		case TCA_CHAIN:
+			tca->has_chain = true;
+			tca->chain_no = mnl_attr_get_u32(attr);
+			break;
+		case TCA_DUMP_FLAGS:
+			dump_flags = mnl_attr_get_payload(attr);
+			tca->terse = !!(dump_flags->value & dump_flags->selector & TCA_DUMP_FLAGS_TERSE);
+			break;
+		}
+	}
+}
+
+static void fake_nl_reply_queue(struct mnl_socket *nl, struct fake_nl_reply *r)
+{
+	if (nl->tail != NULL)
+		nl->tail->next = r;
+	else
+		nl->head = r;
+	nl->tail = r;
+}
+
+static void fake_nl_reply_msg(struct mnl_socket *nl, const struct nlmsghdr *nlh)
+{
+	struct fake_nl_reply *r = fr_malloc(sizeof(struct fake_nl_reply) + nlh->nlmsg_len);
+
+	AN(nlh->nlmsg_len <= sizeof(nl->out));
+	memcpy(r->buf, nlh, nlh->nlmsg_len);
+	r->len = nlh->nlmsg_len;
+	fake_nl_reply_queue(nl, r);
+}
+
+/* as with NETLINK_CAP_ACK and NETLINK_EXT_ACK */
+static void fake_nl_ack(struct mnl_socket *nl, const struct nlmsghdr *req, const int code, const char *msg)
+{
+	char buf[MNL_SOCKET_BUFFER_SIZE];
+	struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
+	struct nlmsgerr *err;
+
+	nlh->nlmsg_type = NLMSG_ERROR;
+	nlh->nlmsg_flags = NLM_F_CAPPED;
+	nlh->nlmsg_seq = req->nlmsg_seq;
+	nlh->nlmsg_pid = nl->portid;
+	err = mnl_nlmsg_put_extra_header(nlh, sizeof(*err));
+	err->error = -code;
+	err->msg = *req;
+	if (msg != NULL) {
+		nlh->nlmsg_flags |= NLM_F_ACK_TLVS;
+		mnl_attr_put_strz(nlh, NLMSGERR_ATTR_MSG, msg);
+	}
+	fake_nl_reply_msg(nl, nlh);
+}
+
+static void fake_nl_echo(struct mnl_socket *nl, const struct nlmsghdr *req, const uint16_t type, const struct fake_nl_filter *f)
+{
+	char buf[MNL_SOCKET_DUMP_SIZE];
+	struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
+	const struct tc_decoded_rule *tdr = &f->tdr;
+
+	tc_encode_rule(nlh, tdr->dev, tdr->chain_no, tdr->prio, &tdr->tcr, TCE_FLAG_LOOPBACK);
+	nlh->nlmsg_type = type;
+	nlh->nlmsg_flags = req->nlmsg_flags & (NLM_F_CREATE | NLM_F_EXCL | NLM_F_REPLACE);
+	nlh->nlmsg_seq = req->nlmsg_seq;
+	nlh->nlmsg_pid = nl->portid;
+	fake_nl_reply_msg(nl, nlh);
+}
+
+/* flower reports the ethertype inside the vlan tag, as the protocol */
+static void fake_nl_flower_fixup(struct nlmsghdr *nlh)
+{
+	struct nlattr *attr, *nested;
+	uint16_t *eth_type = NULL;
+	const uint16_t *vlan_eth_type = NULL;
+
+	mnl_attr_for_each(attr, nlh, sizeof(struct tcmsg)) {
+		if (mnl_attr_get_type(attr) != TCA_OPTIONS)
+			continue;
+		mnl_attr_for_each_nested(nested, attr) {
+			if (mnl_attr_get_type(nested) == TCA_FLOWER_KEY_ETH_TYPE)
+				eth_type = mnl_attr_get_payload(nested);
+			else if (mnl_attr_get_type(nested) == TCA_FLOWER_KEY_VLAN_ETH_TYPE)
+				vlan_eth_type = mnl_attr_get_payload(nested);
+		}
+	}
+	if (eth_type != NULL && vlan_eth_type != NULL && *eth_type == htons(ETH_P_8021Q))
+		*eth_type = *vlan_eth_type;
+}
+
+static int fake_nl_new_filter(struct mnl_socket *nl, const struct nlmsghdr *req, const char **msg)
+{
+	char buf[MNL_SOCKET_DUMP_SIZE];
+	struct nlmsghdr *nlh = (struct nlmsghdr *) buf;
+	struct tc_decoded_rule *tdr;
+	struct fake_nl_filter *f;
+	uint64_t key;
+
+	if (req->nlmsg_len > sizeof(buf))
+		return EMSGSIZE;
+
+	/* the kernel picks the handle, and flower's first is 1 */
+	memcpy(buf, req, req->nlmsg_len);
+	((struct tcmsg *) mnl_nlmsg_get_payload(nlh))->tcm_handle = 1;
+	fake_nl_flower_fixup(nlh);
+	tdr = decode_filter2(nlh);
+	if (tdr == NULL || !tdr->is_done) {
+		free(tdr);
+		*msg = "fake: unable to decode the filter";
+		return EINVAL;
+	}
+
+	key = fake_nl_key(tdr->dev, tdr->chain_no, tdr->prio);
+	f = fake_nl_filter_lookup(key);
+	if (f != NULL && !(req->nlmsg_flags & NLM_F_REPLACE)) {
+		free(tdr);
+		*msg = "Filter already exists";
+		return EEXIST;
+	}
+	if (f == NULL && !(req->nlmsg_flags & NLM_F_CREATE)) {
+		free(tdr);
+		return ENOENT;
+	}
+
+	if (f != NULL) {
+		fake_nl_stats.replaces++;
+	} else {
+		f = fr_malloc(sizeof(struct fake_nl_filter));
+		f->key = key;
+		fake_nl_filter_insert(f);
+		fake_nl_stats.adds++;
+	}
+	f->tdr = *tdr;
+	free(tdr);
+
+	if (req->nlmsg_flags & NLM_F_ECHO)
+		fake_nl_echo(nl, req, RTM_NEWTFILTER, f);
+	return 0;
+}
+
+static int fake_nl_del_filter(struct mnl_socket *nl, const struct nlmsghdr *req, const char **msg)
+{
+	const struct tcmsg *tcm = mnl_nlmsg_get_payload(req);
+	uint16_t prio = TC_H_MAJ(tcm->tcm_info) >> 16;
+	int dev = filter_get_dev(tcm);
+	struct fake_nl_filter *f;
+	struct fake_nl_tca tca;
+	uint64_t end;
+
+	if (dev < 0) {
+		*msg = "fake: not one of our devices";
+		return EINVAL;
+	}
+	fake_nl_parse_tca(req, &tca);
+
+	/* prio 0 flushes the chain */
+	if (prio == 0) {
+		end = fake_nl_key(dev, tca.chain_no, UINT16_MAX) + 1;
+		while ((f = fake_nl_filter_next(fake_nl_key(dev, tca.chain_no, 0))) != NULL && f->key < end)
+			fake_nl_filter_erase(f);
+		fake_nl_stats.flushes++;
+		return 0;
+	}
+
+	f = fake_nl_filter_lookup(fake_nl_key(dev, tca.chain_no, prio));
+	if (f == NULL) {
+		*msg = "Filter with specified priority/protocol not found";
+		return ENOENT;
+	}
+	if (req->nlmsg_flags & NLM_F_ECHO)
+		fake_nl_echo(nl, req, RTM_DELTFILTER, f);
+	fake_nl_filter_erase(f);
+	fake_nl_stats.deletes++;
+	return 0;
+}
+
+static void fake_nl_dump(struct mnl_socket *nl, const struct nlmsghdr *req)
+{
+	struct fake_nl_reply *r = fr_malloc(sizeof(struct fake_nl_reply));
+	const struct tcmsg *tcm = mnl_nlmsg_get_payload(req);
+	struct fake_nl_tca tca;
+	int dev;
+
+	r->is_dump = true;
+	r->type = req->nlmsg_type;
+	r->seq = req->nlmsg_seq;
+	fake_nl_stats.dumps++;
+
+	/* links, routes and the like, come back empty */
+	if ((req->nlmsg_type == RTM_GETCHAIN || req->nlmsg_type == RTM_GETTFILTER) &&
+	    req->nlmsg_len >= mnl_nlmsg_size(sizeof(*tcm)) &&
+	    (dev = filter_get_dev(tcm)) >= 0) {
+		fake_nl_parse_tca(req, &tca);
+		r->terse = tca.terse;
+		if (req->nlmsg_type == RTM_GETTFILTER && tca.has_chain) {
+			r->cursor = fake_nl_key(dev, tca.chain_no, 0);
+			r->end = fake_nl_key(dev, tca.chain_no, UINT16_MAX) + 1;
+		} else {
+			r->cursor = fake_nl_key(dev, 0, 0);
+			r->end = fake_nl_key(dev, UINT32_MAX, UINT16_MAX) + 1;
+		}
+	}
+	fake_nl_reply_queue(nl, r);
+}
+
+static int fake_nl_inject(void)
+{
+	return fake_nl_params.error_permille > 0 &&
+	       dfz_rand(&fake_nl_rand_state) % 1000 < fake_nl_params.error_permille;
+}
+
+/* spins, as sleeping would overshoot short latencies by far */
+static void fake_nl_delay(void)
+{
+	struct timespec start, now;
+	double elapsed;
+
+	if (fake_nl_params.latency <= 0.)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = (double) (now.tv_sec - start.tv_sec) + (double) (now.tv_nsec - start.tv_nsec) / 1e9;
+	} while (elapsed < fake_nl_params.latency);
+}
+
+static void fake_nl_request(struct mnl_socket *nl, const struct nlmsghdr *req)
+{
+	const char *msg = NULL;
+	int code = 0;
+
+	fake_nl_stats.requests++;
+	fake_nl_delay();
+	if ((req->nlmsg_flags & NLM_F_DUMP) == NLM_F_DUMP) {
+		fake_nl_dump(nl, req);
+		return;
+	}
+
+	switch (req->nlmsg_type) {
+	case RTM_NEWTFILTER:
+	case RTM_DELTFILTER:
+		/* as when the hardware is full, deletes don't fail that way */
+		if (req->nlmsg_type == RTM_NEWTFILTER && fake_nl_inject()) {
+			code = fake_nl_params.error_code;
+			msg = "fake: injected failure";
+			fake_nl_stats.injected++;
+			break;
+		}
+		if (req->nlmsg_len < mnl_nlmsg_size(sizeof(struct tcmsg)))
+			code = EINVAL;
+		else if (req->nlmsg_type == RTM_NEWTFILTER)
+			code = fake_nl_new_filter(nl, req, &msg);
+		else
+			code = fake_nl_del_filter(nl, req, &msg);
+		if (code != 0)
+			fake_nl_stats.errors++;
+		break;
+	default:
+		/* qdiscs, neighbour probes and the like, are taken for granted */
+		break;
+	}
+
+	if (code != 0 || (req->nlmsg_flags & NLM_F_ACK))
+		fake_nl_ack(nl, req, code, msg);
+}
+
+static void fake_nl_encode_chain(struct nlmsghdr *nlh, const struct tc_decoded_rule *tdr)
+{
+	struct tcmsg *tcm;
+
+	nlh->nlmsg_type = RTM_NEWCHAIN;
+	tcm = mnl_nlmsg_put_extra_header(nlh, sizeof(struct tcmsg));
+	tcm->tcm_family = AF_UNSPEC;
+	filter_set_dev(tcm, tdr->dev);
+	/* the kernel gives the handle of the clsact qdisc */
+	if (config->block_index == 0)
+		tcm->tcm_parent = TC_H_MAJ(TC_H_INGRESS);
+	mnl_attr_put_u32(nlh, TCA_CHAIN, tdr->chain_no);
+}
+
+/* only the handle, flags and offload state */
+static void fake_nl_encode_terse(struct nlmsghdr *nlh, const struct tc_decoded_rule *tdr)
+{
+	uint32_t flower_flags = tdr->tcr.flower_flags;
+	struct nlattr *opts;
+	struct tcmsg *tcm;
+
+	nlh->nlmsg_type = RTM_NEWTFILTER;
+	tcm = mnl_nlmsg_put_extra_header(nlh, sizeof(struct tcmsg));
+	tcm->tcm_family = AF_UNSPEC;
+	filter_set_dev(tcm, tdr->dev);
+	tcm->tcm_handle = 1;
+	tcm->tcm_info = TC_H_MAKE(tdr->prio << 16, htons(ETH_P_8021Q));
+	mnl_attr_put_strz(nlh, TCA_KIND, "flower");
+	mnl_attr_put_u32(nlh, TCA_CHAIN, tdr->chain_no);
+	opts = mnl_attr_nest_start(nlh, TCA_OPTIONS);
+	if (!(flower_flags & TCA_CLS_FLAGS_SKIP_HW)) {
+		flower_flags |= TCA_CLS_FLAGS_IN_HW;
+		mnl_attr_put_u32(nlh, TCA_FLOWER_IN_HW_COUNT, 1);
+	}
+	mnl_attr_put_u32(nlh, TCA_FLOWER_FLAGS, flower_flags);
+	mnl_attr_nest_end(nlh, opts);
+}
+
+/* fills the next datagram of a dump, returns true once it is complete */
+static int fake_nl_dump_fill(struct mnl_socket *nl, struct fake_nl_reply *r)
+{
+	char buf[MNL_SOCKET_DUMP_SIZE];
+	struct nlmsghdr *nlh;
+	struct fake_nl_filter *f;
+	const struct tc_decoded_rule *tdr;
+
+	AZ(nl->out_len);
+	while ((f = fake_nl_filter_next(r->cursor)) != NULL && f->key < r->end) {
+		tdr = &f->tdr;
+		nlh = mnl_nlmsg_put_header(buf);
+		if (r->type == RTM_GETCHAIN)
+			fake_nl_encode_chain(nlh, tdr);
+		else if (r->terse)
+			fake_nl_encode_terse(nlh, tdr);
+		else
+			tc_encode_rule(nlh, tdr->dev, tdr->chain_no, tdr->prio, &tdr->tcr, TCE_FLAG_LOOPBACK);
+		nlh->nlmsg_flags = NLM_F_MULTI;
+		nlh->nlmsg_seq = r->seq;
+		nlh->nlmsg_pid = nl->portid;
+
+		if (nl->out_len + nlh->nlmsg_len > sizeof(nl->out))
+			return false;
+		memcpy(nl->out + nl->out_len, nlh, nlh->nlmsg_len);
+		nl->out_len += NLMSG_ALIGN(nlh->nlmsg_len);
+		fake_nl_stats.dumped++;
+
+		/* a chain is only dumped once, however many filters it has */
+		if (r->type == RTM_GETCHAIN)
+			r->cursor = fake_nl_key(tdr->dev, tdr->chain_no, UINT16_MAX) + 1;
+		else
+			r->cursor = f->key + 1;
+	}
+
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type = NLMSG_DONE;
+	nlh->nlmsg_flags = NLM_F_MULTI;
+	nlh->nlmsg_seq = r->seq;
+	nlh->nlmsg_pid = nl->portid;
+	*(int *) mnl_nlmsg_put_extra_header(nlh, sizeof(int)) = 0;
+	if (nl->out_len + nlh->nlmsg_len > sizeof(nl->out))
+		return false;
+	memcpy(nl->out + nl->out_len, nlh, nlh->nlmsg_len);
+	nl->out_len += nlh->nlmsg_len;
+	return true;
+}
+
+static int fake_nl_send(struct mnl_socket *nl)
+{
+	if (send(nl->kfd, nl->out, nl->out_len, MSG_NOSIGNAL) == -1) {
+		if (errno == EAGAIN)
+			return false;
+		error(EXIT_FAILURE, errno, "fake_nl: send");
+	}
+	fake_nl_stats.datagrams++;
+	fake_nl_stats.bytes += nl->out_len;
+	nl->out_len = 0;
+	return true;
+}
+
+/* sends replies, until the socket is full */
+static void fake_nl_flush(struct mnl_socket *nl)
+{
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+	struct fake_nl_reply *r;
+	int is_complete;
+
+	ev_io_stop(EV_A_ &nl->wio);
+	for (;;) {
+		if (nl->out_len == 0) {
+			r = nl->head;
+			if (r == NULL)
+				return;
+			if (r->is_dump) {
+				is_complete = fake_nl_dump_fill(nl, r);
+			} else {
+				memcpy(nl->out, r->buf, r->len);
+				nl->out_len = r->len;
+				is_complete = true;
+			}
+			if (is_complete) {
+				nl->head = r->next;
+				if (nl->tail == r)
+					nl->tail = NULL;
+				free(r);
+			}
+		}
+		if (!fake_nl_send(nl)) {
+			ev_io_start(EV_A_ &nl->wio);
+			return;
+		}
+	}
+}
+
+static void fake_nl_writable_cb(EV_P_ ev_io *w, int revents)
+{
+	fr_ev_unused();
+	fr_unused(revents);
+	fake_nl_flush(rb_container_of(w, struct mnl_socket, wio));
+}
+
+struct mnl_socket *__wrap_mnl_socket_open(int bus)
+{
+	struct mnl_socket *nl;
+	int sv[2];
+
+	if (bus != NETLINK_ROUTE) {
+		errno = EPROTONOSUPPORT;
+		return NULL;
+	}
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1)
+		return NULL;
+	if (fcntl(sv[1], F_SETFL, O_NONBLOCK) == -1) {
+		close(sv[0]);
+		close(sv[1]);
+		return NULL;
+	}
+
+	nl = fr_malloc(sizeof(struct mnl_socket));
+	nl->fd = sv[0];
+	nl->kfd = sv[1];
+	ev_io_init(&nl->wio, fake_nl_writable_cb, nl->kfd, EV_WRITE);
+	return nl;
+}
+
+/* nothing is multicast, so groups are accepted, and otherwise ignored */
+int __wrap_mnl_socket_bind(struct mnl_socket *nl, unsigned int groups, pid_t pid)
+{
+	fr_unused(groups);
+	nl->portid = pid != MNL_SOCKET_AUTOPID ? (unsigned int) pid : ++fake_nl_last_portid;
+	return 0;
+}
+
+int __wrap_mnl_socket_close(struct mnl_socket *nl)
+{
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+	struct fake_nl_reply *r;
+
+	ev_io_stop(EV_A_ &nl->wio);
+	while ((r = nl->head) != NULL) {
+		nl->head = r->next;
+		free(r);
+	}
+	close(nl->kfd);
+	close(nl->fd);
+	free(nl);
+	return 0;
+}
+
+int __wrap_mnl_socket_get_fd(const struct mnl_socket *nl)
+{
+	return nl->fd;
+}
+
+unsigned int __wrap_mnl_socket_get_portid(const struct mnl_socket *nl)
+{
+	return nl->portid;
+}
+
+ssize_t __wrap_mnl_socket_sendto(const struct mnl_socket *nl, const void *req, size_t siz)
+{
+	struct mnl_socket *s = (struct mnl_socket *) nl;
+	const struct nlmsghdr *nlh = req;
+	int len = siz;
+
+	while (mnl_nlmsg_ok(nlh, len)) {
+		fake_nl_request(s, nlh);
+		nlh = mnl_nlmsg_next(nlh, &len);
+	}
+	fake_nl_flush(s);
+	return siz;
+}
+
+ssize_t __wrap_mnl_socket_recvfrom(const struct mnl_socket *nl, void *buf, size_t siz)
+{
+	struct iovec iov = {
+		.iov_base = buf,
+		.iov_len = siz,
+	};
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+	};
+	ssize_t ret = recvmsg(nl->fd, &msg, 0);
+
+	if (ret == -1)
+		return -1;
+	if (msg.msg_flags & MSG_TRUNC) {
+		errno = ENOSPC;
+		return -1;
+	}
+	return ret;
+}
+
+/* the options only change what the kernel sends, and that's fixed here */
+int __wrap_mnl_socket_setsockopt(const struct mnl_socket *nl, int type, void *buf, socklen_t len)
+{
+	fr_unused(nl);
+	fr_unused(type);
+	fr_unused(buf);
+	fr_unused(len);
+	return 0;
+}
+
+void fake_nl_init(const struct fake_nl_params *p)
+{
+	fake_nl_params = *p;
+	fake_nl_rand_state = p->seed;
+	memset(&fake_nl_stats, '\0', sizeof(fake_nl_stats));
+}
+
+void fake_nl_fini(void)
+{
+	struct rb_node *node;
+
+	while ((node = rb_first(&fake_nl_filters)) != NULL)
+		fake_nl_filter_erase(rb_container_of(node, struct fake_nl_filter, node));
+}
+
+unsigned int fake_nl_filter_count(void)
+{
+	return fake_nl_filter_cnt;
+}
+
+const struct fake_nl_stats *fake_nl_get_stats(void)
+{
+	return &fake_nl_stats;
+}
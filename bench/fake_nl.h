@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef FLOWER_ROUTE_BENCH_FAKE_NL_H
+#define FLOWER_ROUTE_BENCH_FAKE_NL_H
+
+#include "../src/common.h"
+
+/*
+ * A stand-in for the kernel's side of rtnetlink, for the subset that
+ * we use: filter add, replace, delete and dump, chain dump and ACKs.
+ *
+ * The binary is linked with --wrap for the mnl_socket functions,
+ * so every netlink socket becomes one end of a socketpair, with the
+ * fake kernel on the other end.
+ */
+
+struct fake_nl_params {
+	ev_tstamp latency; /* spent on each request */
+	unsigned int error_permille; /* of filter installs, that fail */
+	int error_code; /* errno of the failures */
+	uint64_t seed;
+};
+
+struct fake_nl_stats {
+	uint64_t requests;
+	uint64_t adds;
+	uint64_t replaces;
+	uint64_t deletes;
+	uint64_t flushes;
+	uint64_t dumps;
+	uint64_t dumped; /* chains and filters, sent in dumps */
+	uint64_t injected; /* failed on purpose */
+	uint64_t errors; /* failed, as the kernel would have */
+	uint64_t datagrams;
+	uint64_t bytes;
+};
+
+void fake_nl_init(const struct fake_nl_params *p);
+void fake_nl_fini(void);
+unsigned int fake_nl_filter_count(void);
+const struct fake_nl_stats *fake_nl_get_stats(void);
+
+#endif
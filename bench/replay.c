@@ -0,0 +1,248 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Replays a capture, made with --capture, through the same
+ * receive, decode and object pipeline as the daemon, offline.
+ *
+ * The kernel's side of the conversation is in the capture,
+ * so rule changes are counted, and otherwise dropped.
+ */
+
+#include "../src/common.h"
+#include "../src/.version.h"
+
+#include <time.h>
+#include <sys/resource.h>
+
+#include "../src/capture.h"
+#include "../src/nl_receive.h"
+#include "../src/nl_filter.h"
+#include "../src/obj_link.h"
+#include "../src/obj_neigh.h"
+#include "../src/obj_route.h"
+#include "../src/obj_target.h"
+#include "../src/obj_rule.h"
+#include "../src/tc_action.h"
+#include "../src/neigh_action.h"
+#include "../src/sched.h"
+
+/* one per socket in the capture */
+#define REPLAY_CONN_MAX 16
+
+static char replay_conn_name[] = "replay";
+
+struct replay_conn {
+	uint32_t portid;
+	struct conn c;
+};
+
+struct replay_state {
+	int realtime;
+	ev_tstamp first_ts;
+	ev_tstamp last_ts;
+	struct timespec start;
+	struct replay_conn conns[REPLAY_CONN_MAX];
+	unsigned int conn_cnt;
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t messages;
+	uint64_t completions;
+	uint64_t errors;
+};
+
+static uint64_t replay_rule_changes;
+
+static int replay_install_handler(EV_P_ const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, int flags)
+{
+	fr_ev_unused();
+	fr_unused(dev);
+	fr_unused(chain_no);
+	fr_unused(prio);
+	fr_unused(tcr);
+	fr_unused(flags);
+	replay_rule_changes++;
+	return 0;
+}
+
+static void replay_probe_handler(EV_P_ const int ifindex, const struct af_addr *addr)
+{
+	fr_ev_unused();
+	fr_unused(ifindex);
+	fr_unused(addr);
+}
+
+static double replay_elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* the seq and portid are left at 0, so that mnl doesn't check them */
+static struct conn *replay_conn_get(struct replay_state *st, const uint32_t portid)
+{
+	struct replay_conn *rc;
+
+	for (unsigned int i = 0; i < st->conn_cnt; i++) {
+		if (st->conns[i].portid == portid)
+			return &st->conns[i].c;
+	}
+	if (st->conn_cnt == REPLAY_CONN_MAX)
+		error(EXIT_FAILURE, 0, "too many sockets in the capture");
+	rc = &st->conns[st->conn_cnt++];
+	rc->portid = portid;
+	rc->c.name = replay_conn_name;
+	return &rc->c;
+}
+
+static void replay_pace(struct replay_state *st, const ev_tstamp ts)
+{
+	double ahead = (ts - st->first_ts) - replay_elapsed(&st->start);
+	struct timespec req;
+
+	if (ahead <= 0.)
+		return;
+	req.tv_sec = (time_t) ahead;
+	req.tv_nsec = (long) ((ahead - req.tv_sec) * 1e9);
+	while (nanosleep(&req, &req) == -1 && errno == EINTR)
+		;
+}
+
+static int replay_packet_cb(const struct capture_packet *p, void *data)
+{
+	struct replay_state *st = data;
+	struct conn *c = replay_conn_get(st, p->portid);
+	const struct nlmsghdr *nlh = p->buf;
+	int len = p->len;
+	int ret;
+
+	if (st->packets == 0)
+		st->first_ts = p->ts;
+	else if (st->realtime)
+		replay_pace(st, p->ts);
+	st->last_ts = p->ts;
+
+	while (mnl_nlmsg_ok(nlh, len)) {
+		st->messages++;
+		nlh = mnl_nlmsg_next(nlh, &len);
+	}
+
+	filter_dump_set_terse(c, p->flags & CAPTURE_FLAG_TERSE);
+	ret = nl_receive_datagram(c, p->buf, p->len);
+	if (ret == MNL_CB_STOP)
+		st->completions++;
+	else if (ret == MNL_CB_ERROR)
+		st->errors++;
+
+	st->packets++;
+	st->bytes += p->len;
+	return 0;
+}
+
+static void replay_setup(void)
+{
+	struct tc_action_callbacks *tacb;
+	struct neigh_action_callbacks *nacb;
+
+	obj_set_mode(OBJ_MODE_NORMAL);
+	sched_setup();
+	obj_rule_init();
+	tacb = tc_action_get_callbacks();
+	tacb->install = replay_install_handler;
+	nacb = neigh_action_get_callbacks();
+	nacb->probe = replay_probe_handler;
+	sched_init();
+
+	/* unlike a fresh start, the state is already known, from the capture */
+	obj_rule_remove_pin();
+}
+
+static void replay_usage(const char *prog_name)
+{
+	printf("Usage: %s [options] <capture>\n\n", prog_name);
+	printf("Options:\n");
+	printf("  -i <ifindex>  interface, that rules were installed on (repeatable)\n");
+	printf("  -t <table>    routing table id (default: %d)\n", RT_TABLE_MAIN);
+	printf("  -b <index>    shared TC block\n");
+	printf("  -R            pace the replay, as it was captured\n");
+	printf("  -v            increase verbosity\n");
+}
+
+static unsigned int replay_parse_uint(const char *arg)
+{
+	char *end;
+	unsigned long val = strtoul(arg, &end, 10);
+
+	if (*end != '\0' || val > UINT32_MAX)
+		error(EXIT_FAILURE, 0, "invalid number: %s", arg);
+	return val;
+}
+
+int main(int argc, char **argv)
+{
+	static struct replay_state st;
+	struct rusage ru;
+	double secs;
+	int ret, c;
+
+	config_init(argv[0]);
+	config->table_id = RT_TABLE_MAIN;
+	while ((c = getopt(argc, argv, "i:t:b:Rvh")) != -1) {
+		switch (c) {
+		case 'i':
+			if (config->if_cnt == CONFIG_MAX_IFACES)
+				error(EXIT_FAILURE, 0, "too many interfaces");
+			config->ifidx[config->if_cnt++] = replay_parse_uint(optarg);
+			break;
+		case 't':
+			config->table_id = replay_parse_uint(optarg);
+			break;
+		case 'b':
+			config->block_index = replay_parse_uint(optarg);
+			break;
+		case 'R':
+			st.realtime = true;
+			break;
+		case 'v':
+			config->verbosity++;
+			break;
+		case 'h':
+			replay_usage(argv[0]);
+			exit(EXIT_SUCCESS);
+		default:
+			replay_usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (optind + 1 != argc) {
+		replay_usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	replay_setup();
+
+	clock_gettime(CLOCK_MONOTONIC, &st.start);
+	ret = capture_read(argv[optind], replay_packet_cb, &st);
+	secs = replay_elapsed(&st.start);
+	if (ret < 0)
+		exit(EXIT_FAILURE);
+	getrusage(RUSAGE_SELF, &ru);
+
+	printf("replay version=%s capture=%s span=%.3f\n", VERSION_GIT, argv[optind], st.last_ts - st.first_ts);
+	printf("packets=%"PRIu64" messages=%"PRIu64" bytes=%"PRIu64" completions=%"PRIu64" errors=%"PRIu64" rule_changes=%"PRIu64"\n",
+	       st.packets, st.messages, st.bytes, st.completions, st.errors, replay_rule_changes);
+	printf("secs=%.3f packets_per_sec=%.0f messages_per_sec=%.0f mb_per_sec=%.1f peak_rss_kb=%ld\n",
+	       secs, secs > 0. ? st.packets / secs : 0., secs > 0. ? st.messages / secs : 0.,
+	       secs > 0. ? st.bytes / secs / 1e6 : 0., ru.ru_maxrss);
+	printf("objects links=%d neighs=%d targets=%d routes=%d rules=%d\n",
+	       obj_link_count(), obj_neigh_count(), obj_target_count(),
+	       obj_route_count(), obj_rule_count());
+
+	for (unsigned int i = 0; i < st.conn_cnt; i++)
+		filter_dump_set_terse(&st.conns[i].c, false);
+	filter_clear_chains();
+	ev_loop_destroy(EV_DEFAULT);
+	config_free();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,291 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+##################################################
+#  end-to-end scale test, in a network namespace  #
+##################################################
+
+#
+# builds an uplink without a NIC: a veth pair with a clsact qdisc,
+# VLAN sub-interfaces and permanent neighbours, in a namespace of its own,
+# loads a synthetic table with `ip -batch`, and runs flower-routed on it
+# with --skip-hw, measuring:
+#
+# - the time to the first full sync (with --one-off)
+# - CPU and memory use in steady state, over a number of scans
+# - the time to converge after every route is moved to another next-hop
+#
+# results are printed as key=value lines, so runs can be compared
+#
+
+export PATH=/usr/sbin:/usr/bin:/sbin:/bin
+
+NETNS="flower-route-bench"
+UPLINK="up0"
+TABLE=100
+V4_CNT=100000
+V6_CNT=0
+VLAN_CNT=8
+NH_CNT=4
+STEADY_SECS=60
+CONVERGE_TIMEOUT=600
+DAEMON="./flower-routed"
+KEEP=0
+WORKDIR=""
+DAEMON_PID=""
+
+bail(){
+	local msg="$(printf "$@")"
+	echo "$msg" >&2
+	exit 1
+}
+
+usage(){
+	cat <<EOF
+usage: $0 [OPTIONS]
+
+Options:
+	-4 <count>     IPv4 /24 routes (dft: $V4_CNT)
+	-6 <count>     IPv6 /48 routes (dft: $V6_CNT)
+	-V <count>     VLAN sub-interfaces (dft: $VLAN_CNT)
+	-n <count>     next-hops per VLAN (dft: $NH_CNT)
+	-t <table>     routing table (dft: $TABLE)
+	-s <secs>      steady state measurement (dft: $STEADY_SECS)
+	-d <path>      flower-routed binary (dft: $DAEMON)
+	-k             keep the namespace, for poking around afterwards
+	-h             show this help text
+EOF
+}
+
+now(){
+	date +%s.%N
+}
+
+elapsed(){
+	local start="$1"
+	local end="$2"
+	awk -v s="$start" -v e="$end" 'BEGIN { printf("%.3f\n", e - s) }'
+}
+
+nsexec(){
+	ip netns exec "$NETNS" "$@"
+}
+
+cleanup(){
+	if [ -n "$DAEMON_PID" ] ; then
+		kill "$DAEMON_PID" 2>/dev/null
+		wait "$DAEMON_PID" 2>/dev/null
+	fi
+	[ -n "$WORKDIR" ] && rm -rf "$WORKDIR"
+	if [ "$KEEP" -eq 0 ] ; then
+		ip netns del "$NETNS" 2>/dev/null
+	fi
+}
+
+setup_netns(){
+	local vid
+
+	ip netns del "$NETNS" 2>/dev/null
+	ip netns add "$NETNS" || bail 'unable to create netns %s' "$NETNS"
+	nsexec ip link set lo up
+	nsexec ip link add "$UPLINK" type veth peer name peer0 ||
+		bail 'unable to create veth pair'
+	nsexec ip link set peer0 up
+	nsexec ip link set "$UPLINK" up
+	nsexec tc qdisc add dev "$UPLINK" clsact ||
+		bail 'unable to add clsact qdisc on %s' "$UPLINK"
+
+	for i in $(seq 0 $((VLAN_CNT - 1))) ; do
+		vid=$((100 + i))
+		echo "link add link $UPLINK name $UPLINK.$vid type vlan id $vid"
+		echo "link set $UPLINK.$vid up"
+		echo "addr add 100.64.$i.1/24 dev $UPLINK.$vid"
+		# IPv6 groups are hex, as in gen_routes
+		echo "addr add fd00:0:0:$(printf %x "$i")::1/64 dev $UPLINK.$vid nodad"
+		for j in $(seq 1 "$NH_CNT") ; do
+			echo "neigh add 100.64.$i.$((j + 1)) lladdr 02:00:00:00:$(printf %02x "$i"):$(printf %02x "$j") dev $UPLINK.$vid nud permanent"
+			echo "neigh add fd00:0:0:$(printf %x "$i")::$(printf %x $((j + 1))) lladdr 02:00:00:00:$(printf %02x "$i"):$(printf %02x "$j") dev $UPLINK.$vid nud permanent"
+		done
+	done > "$WORKDIR/links.batch"
+	nsexec ip -batch "$WORKDIR/links.batch" ||
+		bail 'unable to set up VLANs and neighbours'
+}
+
+# writes an `ip -batch` file, next-hops are picked round-robin from <shift>
+gen_routes(){
+	local cmd="$1"
+	local shift="$2"
+	awk -v v4="$V4_CNT" -v v6="$V6_CNT" -v vlans="$VLAN_CNT" -v nhs="$NH_CNT" \
+	    -v table="$TABLE" -v cmd="$cmd" -v shift="$shift" -v uplink="$UPLINK" '
+	function nh(k,   n, i, j) {
+		n = (k + shift) % (vlans * nhs)
+		i = int(n / nhs)
+		j = n % nhs
+		vlan = i
+		return j + 2
+	}
+	BEGIN {
+		for (k = 0; k < v4; k++) {
+			h = nh(k)
+			printf("route %s %d.%d.%d.0/24 via 100.64.%d.%d dev %s.%d table %d\n",
+			       cmd, 11 + int(k / 65536), int(k / 256) % 256, k % 256,
+			       vlan, h, uplink, 100 + vlan, table)
+		}
+		for (k = 0; k < v6; k++) {
+			h = nh(k)
+			printf("route %s 2a00:%x:%x::/48 via fd00:0:0:%x::%x dev %s.%d table %d\n",
+			       cmd, int(k / 65536), k % 65536, vlan, h, uplink, 100 + vlan, table)
+		}
+	}'
+}
+
+# sums the samples of a metric, matching a label filter
+metric(){
+	local name="$1"
+	local labels="$2"
+	awk -v name="flower_route_$name" -v labels="$labels" '
+	!/^#/ && index($1, name) == 1 {
+		rest = substr($1, length(name) + 1)
+		if (rest != "" && substr(rest, 1, 1) != "{")
+			next
+		if (labels != "" && index(rest, labels) == 0)
+			next
+		sum += $2
+	}
+	END { printf("%d\n", sum) }' "$WORKDIR/metrics.prom" 2>/dev/null
+}
+
+# everything that has been asked of the kernel, has been answered
+is_converged(){
+	[ "$(metric queue_depth)" -eq 0 ] &&
+	[ "$(metric queue_in_flight)" -eq 0 ] &&
+	[ "$(metric coalesce_pending)" -eq 0 ] &&
+	[ "$(metric rules 'state="want"')" -eq 0 ] &&
+	[ "$(metric rules 'state="queued"')" -eq 0 ] &&
+	[ "$(metric rules 'state="pending"')" -eq 0 ]
+}
+
+# waits for the next metrics write, returns the requests sent so far
+wait_metrics(){
+	local prev="$(stat -c %Y.%N "$WORKDIR/metrics.prom" 2>/dev/null)"
+	while [ "$(stat -c %Y.%N "$WORKDIR/metrics.prom" 2>/dev/null)" = "$prev" ] ; do
+		kill -0 "$DAEMON_PID" 2>/dev/null || bail 'flower-routed died'
+		sleep 0.1
+	done
+	metric netlink_requests_total 'conn="install"'
+}
+
+cpu_ticks(){
+	awk '{ print $14 + $15 }' "/proc/$1/stat"
+}
+
+proc_kb(){
+	awk -v k="$2:" '$1 == k { print $2 }' "/proc/$1/status"
+}
+
+bench_initial_sync(){
+	local start="$(now)"
+	nsexec "$DAEMON" -i "$UPLINK" -t "$TABLE" --skip-hw -1 ||
+		bail 'initial sync failed'
+	echo "initial_sync_secs=$(elapsed "$start" "$(now)")"
+	echo "filters=$(nsexec tc filter show dev "$UPLINK" ingress | grep -c '^filter .* handle')"
+}
+
+bench_steady_state(){
+	local hz="$(getconf CLK_TCK)"
+	local t0 t1 c0 c1
+
+	# not through nsexec, so that $! is the daemon, and not a subshell
+	ip netns exec "$NETNS" "$DAEMON" -i "$UPLINK" -t "$TABLE" --skip-hw \
+		--metrics-file "$WORKDIR/metrics.prom" --metrics-interval 1 &
+	DAEMON_PID=$!
+
+	# the restart finds every rule in place, wait for it to settle first
+	until wait_metrics > /dev/null && is_converged ; do
+		:
+	done
+
+	t0="$(now)"
+	c0="$(cpu_ticks "$DAEMON_PID")"
+	sleep "$STEADY_SECS"
+	t1="$(now)"
+	c1="$(cpu_ticks "$DAEMON_PID")"
+	awk -v c="$((c1 - c0))" -v hz="$hz" -v s="$t0" -v e="$t1" \
+		'BEGIN { printf("steady_cpu_percent=%.2f\n", 100 * c / hz / (e - s)) }'
+	echo "steady_rss_kb=$(proc_kb "$DAEMON_PID" VmRSS)"
+	echo "steady_hwm_kb=$(proc_kb "$DAEMON_PID" VmHWM)"
+}
+
+bench_replace(){
+	local start end reqs prev
+
+	gen_routes replace 1 > "$WORKDIR/replace.batch"
+	prev="$(wait_metrics)"
+	start="$(now)"
+	nsexec ip -batch "$WORKDIR/replace.batch" || bail 'route replace failed'
+	end="$(now)"
+	echo "replace_batch_secs=$(elapsed "$start" "$end")"
+
+	# converged, once nothing is outstanding, and no requests are sent until the next write
+	while true ; do
+		reqs="$(wait_metrics)"
+		if [ "$reqs" -gt "$prev" ] && is_converged ; then
+			end="$(now)"
+			[ "$(wait_metrics)" -eq "$reqs" ] && is_converged && break
+		fi
+		if [ "$(elapsed "$start" "$(now)" | cut -d. -f1)" -ge "$CONVERGE_TIMEOUT" ] ; then
+			bail 'no convergence after %d secs' "$CONVERGE_TIMEOUT"
+		fi
+	done
+	echo "replace_converge_secs=$(elapsed "$start" "$end")"
+	echo "replace_requests=$((reqs - prev))"
+	echo "replace_failed_rules=$(metric rules 'state="failed"')"
+	grep '^flower_route_convergence_seconds{.*quantile' "$WORKDIR/metrics.prom" |
+		sed -e 's/^flower_route_convergence_seconds{\(.*\)} \(.*\)$/convergence \1 secs=\2/' -e 's/"//g' -e 's/,/ /g'
+	echo "replace_rss_kb=$(proc_kb "$DAEMON_PID" VmRSS)"
+	echo "replace_hwm_kb=$(proc_kb "$DAEMON_PID" VmHWM)"
+}
+
+main(){
+	local start
+
+	while getopts '4:6:V:n:t:s:d:kh' opt ; do
+		case "$opt" in
+			4) V4_CNT="$OPTARG" ;;
+			6) V6_CNT="$OPTARG" ;;
+			V) VLAN_CNT="$OPTARG" ;;
+			n) NH_CNT="$OPTARG" ;;
+			t) TABLE="$OPTARG" ;;
+			s) STEADY_SECS="$OPTARG" ;;
+			d) DAEMON="$OPTARG" ;;
+			k) KEEP=1 ;;
+			h) usage ; exit 0 ;;
+			*) usage >&2 ; exit 1 ;;
+		esac
+	done
+
+	[ "$(id -u)" -eq 0 ] || bail 'must be run as root'
+	[ -x "$DAEMON" ] || bail 'flower-routed not found at %s, run `make build`' "$DAEMON"
+	[ "$VLAN_CNT" -ge 1 ] && [ "$VLAN_CNT" -le 250 ] || bail 'VLAN count must be 1-250'
+	[ "$NH_CNT" -ge 1 ] && [ "$NH_CNT" -le 250 ] || bail 'next-hop count must be 1-250'
+	DAEMON="$(readlink -f "$DAEMON")"
+
+	WORKDIR="$(mktemp -d)"
+	trap cleanup EXIT
+	trap 'exit 1' INT TERM
+
+	setup_netns
+	echo "version=$("$DAEMON" --version | awk '{ print $NF }')"
+	echo "routes_v4=$V4_CNT routes_v6=$V6_CNT vlans=$VLAN_CNT nexthops=$((VLAN_CNT * NH_CNT))"
+
+	gen_routes add 0 > "$WORKDIR/routes.batch"
+	start="$(now)"
+	nsexec ip -batch "$WORKDIR/routes.batch" || bail 'unable to load routes'
+	echo "load_batch_secs=$(elapsed "$start" "$(now)")"
+
+	bench_initial_sync
+	bench_steady_state
+	bench_replace
+}
+
+main "$@"
@@ -0,0 +1,156 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * capture of received netlink datagrams
+ *
+ * With --capture, every datagram is written with its arrival time,
+ * so that the decode path can be replayed offline, see bench/replay.c
+ */
+
+#include "capture.h"
+#include "nl_filter.h"
+
+#include <errno.h>
+#include <time.h>
+#include <linux/if_arp.h>
+#include <linux/if_packet.h>
+#include <linux/netlink.h>
+
+static FILE *capture_file;
+
+int capture_open(const char *path)
+{
+	struct capture_pcap_hdr hdr = {
+		.magic = CAPTURE_PCAP_MAGIC_NSEC,
+		.version_major = 2,
+		.version_minor = 4,
+		.snaplen = CAPTURE_SNAPLEN,
+		.network = CAPTURE_LINKTYPE_NETLINK,
+	};
+
+	AZ(capture_file);
+	capture_file = fopen(path, "w");
+	if (capture_file == NULL) {
+		fr_printf(ERROR, "capture: unable to open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (fwrite(&hdr, sizeof(hdr), 1, capture_file) != 1) {
+		fr_printf(ERROR, "capture: unable to write %s: %s\n", path, strerror(errno));
+		capture_close();
+		return -1;
+	}
+	return 0;
+}
+
+void capture_close(void)
+{
+	if (capture_file == NULL)
+		return;
+	fclose(capture_file);
+	capture_file = NULL;
+}
+
+void capture_datagram(const struct conn *c, const void *buf, const size_t len)
+{
+	struct capture_pcap_rec rec;
+	struct capture_nlmon_hdr nlmon = {
+		.pkttype = htons(PACKET_HOST),
+		.hatype = htons(ARPHRD_NETLINK),
+		.addr_len = htons(sizeof(nlmon.addr)),
+		.protocol = htons(NETLINK_ROUTE),
+	};
+	uint32_t portid = htonl(c->portid);
+	struct timespec ts;
+
+	if (capture_file == NULL)
+		return;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	rec.ts_sec = ts.tv_sec;
+	rec.ts_frac = ts.tv_nsec;
+	rec.incl_len = sizeof(nlmon) + len;
+	rec.orig_len = rec.incl_len;
+	AN(rec.incl_len <= CAPTURE_SNAPLEN);
+
+	memcpy(nlmon.addr, &portid, sizeof(portid));
+	if (filter_dump_is_terse(c))
+		nlmon.addr[4] |= CAPTURE_FLAG_TERSE;
+
+	/* flushed per datagram, the daemon is usually killed, not stopped */
+	if (fwrite(&rec, sizeof(rec), 1, capture_file) != 1 ||
+	    fwrite(&nlmon, sizeof(nlmon), 1, capture_file) != 1 ||
+	    fwrite(buf, len, 1, capture_file) != 1 ||
+	    fflush(capture_file) != 0) {
+		fr_printf(ERROR, "capture: write failed, stopping: %s\n", strerror(errno));
+		capture_close();
+	}
+}
+
+static int capture_read_fail(FILE *f, const char *path, const char *what)
+{
+	if (ferror(f))
+		fr_printf(ERROR, "capture: unable to read %s: %s\n", path, strerror(errno));
+	else
+		fr_printf(ERROR, "capture: %s: %s\n", path, what);
+	fclose(f);
+	return -1;
+}
+
+/* calls cb for each datagram, until it returns non-zero, returns the count or -1 */
+int capture_read(const char *path, int (*cb)(const struct capture_packet *p, void *data), void *data)
+{
+	static char buf[CAPTURE_SNAPLEN];
+	struct capture_pcap_hdr hdr;
+	struct capture_pcap_rec rec;
+	struct capture_nlmon_hdr nlmon;
+	struct capture_packet p;
+	double frac_scale;
+	int cnt = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		fr_printf(ERROR, "capture: unable to open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1)
+		return capture_read_fail(f, path, "truncated header");
+	if (hdr.magic == CAPTURE_PCAP_MAGIC_NSEC)
+		frac_scale = 1e-9;
+	else if (hdr.magic == CAPTURE_PCAP_MAGIC_USEC)
+		frac_scale = 1e-6;
+	else
+		return capture_read_fail(f, path, "not a pcap file, in host byte order");
+	if (hdr.network != CAPTURE_LINKTYPE_NETLINK)
+		return capture_read_fail(f, path, "not a netlink capture");
+
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		if (rec.incl_len < sizeof(nlmon) || rec.incl_len > sizeof(nlmon) + sizeof(buf))
+			return capture_read_fail(f, path, "bad record length");
+		if (fread(&nlmon, sizeof(nlmon), 1, f) != 1 ||
+		    fread(buf, rec.incl_len - sizeof(nlmon), 1, f) != 1)
+			return capture_read_fail(f, path, "truncated record");
+
+		/* nlmon also sees other netlink families */
+		if (ntohs(nlmon.hatype) != ARPHRD_NETLINK || ntohs(nlmon.protocol) != NETLINK_ROUTE)
+			continue;
+
+		memset(&p, '\0', sizeof(p));
+		p.ts = rec.ts_sec + rec.ts_frac * frac_scale;
+		if (ntohs(nlmon.addr_len) >= sizeof(p.portid)) {
+			memcpy(&p.portid, nlmon.addr, sizeof(p.portid));
+			p.portid = ntohl(p.portid);
+		}
+		if (ntohs(nlmon.addr_len) == sizeof(nlmon.addr))
+			p.flags = nlmon.addr[4];
+		p.buf = buf;
+		p.len = rec.incl_len - sizeof(nlmon);
+		cnt++;
+		if (cb(&p, data) != 0)
+			break;
+	}
+	if (ferror(f))
+		return capture_read_fail(f, path, "read error");
+	fclose(f);
+	return cnt;
+}
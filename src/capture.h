@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef FLOWER_ROUTE_CAPTURE_H
+#define FLOWER_ROUTE_CAPTURE_H
+
+#include "nl_common.h"
+
+/*
+ * received netlink datagrams, in the pcap format that nlmon
+ * devices produce, so that wireshark can read them as well
+ */
+
+#define CAPTURE_PCAP_MAGIC_USEC 0xa1b2c3d4
+#define CAPTURE_PCAP_MAGIC_NSEC 0xa1b23c4d
+#define CAPTURE_LINKTYPE_NETLINK 253
+#define CAPTURE_SNAPLEN 65535
+
+#define CAPTURE_FLAG_TERSE 0x01 /* a reply to a terse filter dump */
+
+struct capture_pcap_hdr {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t network;
+};
+
+struct capture_pcap_rec {
+	uint32_t ts_sec;
+	uint32_t ts_frac; /* usecs or nsecs, depending on the magic */
+	uint32_t incl_len;
+	uint32_t orig_len;
+};
+
+/* the cooked header of LINKTYPE_NETLINK, in network byte order */
+struct capture_nlmon_hdr {
+	uint16_t pkttype;
+	uint16_t hatype; /* ARPHRD_NETLINK */
+	uint16_t addr_len;
+	uint8_t addr[8]; /* portid of the receiving socket, and our flags */
+	uint16_t protocol; /* NETLINK_ROUTE */
+};
+
+/* a datagram, as read back from a capture */
+struct capture_packet {
+	ev_tstamp ts;
+	uint32_t portid;
+	uint8_t flags;
+	const void *buf;
+	size_t len;
+};
+
+int capture_open(const char *path);
+void capture_close(void);
+void capture_datagram(const struct conn *c, const void *buf, const size_t len);
+int capture_read(const char *path, int (*cb)(const struct capture_packet *p, void *data), void *data);
+
+#endif
@@ -0,0 +1,392 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * coalesce route and neighbour updates
+ *
+ * With --coalesce, updates are held for a short window, and only the
+ * final state per prefix or neighbour is applied. On flush neighbours
+ * are applied before routes, and new routes before deleted ones, so
+ * that shared targets stay alive while routes move between them.
+ *
+ * Prefixes that keep getting withdrawn are dampened: each withdrawal
+ * adds to a penalty that decays exponentially, and while suppressed,
+ * withdrawals are still applied right away, but announcements are
+ * held until the penalty has decayed below the reuse threshold.
+ */
+
+#include <math.h>
+
+#include "coalesce.h"
+#include "obj_neigh.h"
+#include "obj_route.h"
+#include "obj_target.h"
+#include "trace.h"
+
+#define COALESCE_DAMP_HALF_LIFE 30.   /* seconds */
+#define COALESCE_DAMP_PENALTY   1.
+#define COALESCE_DAMP_SUPPRESS  3.
+#define COALESCE_DAMP_REUSE     1.
+#define COALESCE_DAMP_FORGET    .1
+#define COALESCE_RECHECK        1.    /* seconds, while suppressing */
+
+struct coalesce_route {
+	struct rb_node node;
+	struct af_addr dst;
+	struct obj_target *target; /* referenced while pending */
+	uint16_t nlmsg_type;
+	int is_pending;
+	int is_suppressed;
+	double penalty;
+	ev_tstamp penalty_ts;
+	ev_tstamp event_ts; /* of the first held update, for tracing */
+};
+
+struct coalesce_neigh {
+	struct rb_node node;
+	int ifindex;
+	struct af_addr addr;
+	uint16_t nlmsg_type;
+	int has_lladdr;
+	uint8_t lladdr[ETH_ALEN];
+	uint16_t nud_state;
+	ev_tstamp event_ts; /* of the first held update, for tracing */
+};
+
+static struct rb_root coalesce_route_tree = RB_ROOT;
+static struct rb_root coalesce_neigh_tree = RB_ROOT;
+static ev_timer coalesce_timer;
+static int coalesce_pending_cnt;
+
+int coalesce_pending_count(void)
+{
+	return coalesce_pending_cnt;
+}
+
+static struct coalesce_route *coalesce_route_lookup(const struct af_addr *dst)
+{
+	struct rb_node *node = coalesce_route_tree.rb_node;
+	struct coalesce_route *this;
+	int ret;
+
+	while (node) {
+		this = rb_container_of(node, struct coalesce_route, node);
+		ret = memcmp(dst, &this->dst, sizeof(struct af_addr));
+		if (ret < 0)
+			node = node->rb_left;
+		else if (ret > 0)
+			node = node->rb_right;
+		else
+			return this;
+	}
+	return NULL;
+}
+
+static int coalesce_route_insert(struct coalesce_route *cr)
+{
+	struct rb_node **new = &(coalesce_route_tree.rb_node), *parent = NULL;
+	struct coalesce_route *this;
+	int ret;
+
+	/* Figure out where to put new node */
+	while (*new) {
+		this = rb_container_of(*new, struct coalesce_route, node);
+		ret = memcmp(&cr->dst, &this->dst, sizeof(struct af_addr));
+
+		parent = *new;
+		if (ret < 0)
+			new = &((*new)->rb_left);
+		else if (ret > 0)
+			new = &((*new)->rb_right);
+		else
+			return 0;
+	}
+
+	/* Add new node and rebalance tree. */
+	rb_link_node(&cr->node, parent, new);
+	rb_insert_color(&cr->node, &coalesce_route_tree);
+
+	return 1;
+}
+
+static int coalesce_neigh_cmp(const int ifindex, const struct af_addr *addr, const struct coalesce_neigh *cn)
+{
+	if (ifindex != cn->ifindex)
+		return ifindex < cn->ifindex ? -1 : 1;
+	return memcmp(addr, &cn->addr, sizeof(struct af_addr));
+}
+
+static struct coalesce_neigh *coalesce_neigh_lookup(const int ifindex, const struct af_addr *addr)
+{
+	struct rb_node *node = coalesce_neigh_tree.rb_node;
+	struct coalesce_neigh *this;
+	int ret;
+
+	while (node) {
+		this = rb_container_of(node, struct coalesce_neigh, node);
+		ret = coalesce_neigh_cmp(ifindex, addr, this);
+		if (ret < 0)
+			node = node->rb_left;
+		else if (ret > 0)
+			node = node->rb_right;
+		else
+			return this;
+	}
+	return NULL;
+}
+
+static int coalesce_neigh_insert(struct coalesce_neigh *cn)
+{
+	struct rb_node **new = &(coalesce_neigh_tree.rb_node), *parent = NULL;
+	struct coalesce_neigh *this;
+	int ret;
+
+	/* Figure out where to put new node */
+	while (*new) {
+		this = rb_container_of(*new, struct coalesce_neigh, node);
+		ret = coalesce_neigh_cmp(cn->ifindex, &cn->addr, this);
+
+		parent = *new;
+		if (ret < 0)
+			new = &((*new)->rb_left);
+		else if (ret > 0)
+			new = &((*new)->rb_right);
+		else
+			return 0;
+	}
+
+	/* Add new node and rebalance tree. */
+	rb_link_node(&cn->node, parent, new);
+	rb_insert_color(&cn->node, &coalesce_neigh_tree);
+
+	return 1;
+}
+
+static void coalesce_timer_cb(EV_P_ ev_timer *w, int revents)
+{
+	fr_unused(w);
+	fr_unused(revents);
+	coalesce_flush(EV_A);
+}
+
+static void coalesce_arm(EV_P_ const ev_tstamp after)
+{
+	if (ev_is_active(&coalesce_timer))
+		return;
+	ev_timer_init(&coalesce_timer, coalesce_timer_cb, after, 0.);
+	ev_timer_start(EV_A_ &coalesce_timer);
+}
+
+static void coalesce_damp_decay(struct coalesce_route *cr, const ev_tstamp now)
+{
+	if (cr->penalty > 0.)
+		cr->penalty *= exp2(-(now - cr->penalty_ts) / COALESCE_DAMP_HALF_LIFE);
+	cr->penalty_ts = now;
+}
+
+static void coalesce_route_set_pending(struct coalesce_route *cr, const uint16_t nlmsg_type, struct obj_target *t)
+{
+	if (cr->target) {
+		obj_target_unref(cr->target);
+	} else {
+		coalesce_pending_cnt++;
+		cr->event_ts = trace_event_ts();
+	}
+	cr->target = obj_target_ref(t);
+	cr->nlmsg_type = nlmsg_type;
+	cr->is_pending = true;
+}
+
+static void coalesce_route_clear_pending(struct coalesce_route *cr)
+{
+	AN(cr->is_pending);
+	obj_target_unref(cr->target);
+	cr->target = NULL;
+	cr->is_pending = false;
+	AN(coalesce_pending_cnt--);
+}
+
+void coalesce_route_update(const uint16_t nlmsg_type, struct obj_target *t, const struct af_addr *dst)
+{
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+	struct coalesce_route *cr;
+
+	if (config->coalesce_ms == 0) {
+		obj_route_netlink_update(nlmsg_type, t, dst);
+		return;
+	}
+
+	cr = coalesce_route_lookup(dst);
+	if (cr == NULL) {
+		cr = fr_malloc(sizeof(struct coalesce_route));
+		memcpy(&cr->dst, dst, sizeof(struct af_addr));
+		coalesce_route_insert(cr);
+	}
+
+	if (nlmsg_type == RTM_DELROUTE) {
+		coalesce_damp_decay(cr, ev_now(EV_A));
+		cr->penalty += COALESCE_DAMP_PENALTY;
+		if (cr->penalty >= COALESCE_DAMP_SUPPRESS)
+			cr->is_suppressed = true;
+	}
+
+	if (cr->is_suppressed && nlmsg_type == RTM_DELROUTE) {
+		/* never keep forwarding a withdrawn prefix in hardware */
+		if (cr->is_pending)
+			coalesce_route_clear_pending(cr);
+		obj_route_netlink_update(nlmsg_type, t, dst);
+		coalesce_arm(EV_A_ COALESCE_RECHECK);
+		return;
+	}
+
+	coalesce_route_set_pending(cr, nlmsg_type, t);
+	coalesce_arm(EV_A_ config->coalesce_ms / 1000.);
+}
+
+void coalesce_neigh_update(const uint16_t nlmsg_type, const int ifindex, const uint8_t af, const union some_in_addr *addr, const uint8_t (*lladdr)[ETH_ALEN], const uint16_t nud_state)
+{
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+	struct coalesce_neigh *cn;
+	struct af_addr af_addr;
+
+	if (config->coalesce_ms == 0) {
+		obj_neigh_netlink_update(nlmsg_type, ifindex, af, addr, lladdr, nud_state);
+		return;
+	}
+
+	build_af_addr(&af_addr, af, addr, 0);
+	cn = coalesce_neigh_lookup(ifindex, &af_addr);
+	if (cn == NULL) {
+		cn = fr_malloc(sizeof(struct coalesce_neigh));
+		cn->ifindex = ifindex;
+		memcpy(&cn->addr, &af_addr, sizeof(struct af_addr));
+		coalesce_neigh_insert(cn);
+		coalesce_pending_cnt++;
+		cn->event_ts = trace_event_ts();
+	}
+
+	cn->nlmsg_type = nlmsg_type;
+	cn->nud_state = nud_state;
+	cn->has_lladdr = lladdr != NULL;
+	if (lladdr)
+		memcpy(cn->lladdr, lladdr, ETH_ALEN);
+
+	coalesce_arm(EV_A_ config->coalesce_ms / 1000.);
+}
+
+static void coalesce_flush_neighs(void)
+{
+	struct rb_node *node;
+
+	while ((node = rb_first(&coalesce_neigh_tree))) {
+		struct coalesce_neigh *cn = rb_container_of(node, struct coalesce_neigh, node);
+		const uint8_t (*lladdr)[ETH_ALEN] = NULL;
+		ev_tstamp prev;
+
+		if (cn->has_lladdr)
+			lladdr = (const uint8_t (*)[ETH_ALEN]) &cn->lladdr;
+
+		rb_erase(node, &coalesce_neigh_tree);
+		prev = trace_event_begin(cn->event_ts);
+		obj_neigh_netlink_update(cn->nlmsg_type, cn->ifindex, cn->addr.af, &cn->addr.in, lladdr, cn->nud_state);
+		trace_event_end(prev);
+		AN(coalesce_pending_cnt--);
+		free(cn);
+	}
+}
+
+/* a nexthop object may have been deleted, while a route waited for it */
+static int coalesce_target_is_gone(const struct obj_target *t)
+{
+	return t->nh_id != 0 && obj_target_nhid_lookup(t->nh_id) != t;
+}
+
+static void coalesce_flush_routes(const uint16_t nlmsg_type, const ev_tstamp now, int *held)
+{
+	for (struct rb_node *node = rb_first(&coalesce_route_tree); node; node = rb_next(node)) {
+		struct coalesce_route *cr = rb_container_of(node, struct coalesce_route, node);
+
+		if (!cr->is_pending || cr->nlmsg_type != nlmsg_type)
+			continue;
+
+		if (cr->is_suppressed) {
+			coalesce_damp_decay(cr, now);
+			if (cr->penalty >= COALESCE_DAMP_REUSE) {
+				(*held)++;
+				continue;
+			}
+			cr->is_suppressed = false;
+		}
+
+		if (!coalesce_target_is_gone(cr->target)) {
+			ev_tstamp prev = trace_event_begin(cr->event_ts);
+
+			obj_route_netlink_update(cr->nlmsg_type, cr->target, &cr->dst);
+			trace_event_end(prev);
+		}
+		coalesce_route_clear_pending(cr);
+	}
+}
+
+static void coalesce_forget_routes(const ev_tstamp now)
+{
+	struct rb_node *node, *next;
+
+	for (node = rb_first(&coalesce_route_tree); node; node = next) {
+		struct coalesce_route *cr = rb_container_of(node, struct coalesce_route, node);
+
+		next = rb_next(node);
+		if (cr->is_pending)
+			continue;
+		coalesce_damp_decay(cr, now);
+		if (cr->penalty >= COALESCE_DAMP_FORGET)
+			continue;
+		rb_erase(node, &coalesce_route_tree);
+		free(cr);
+	}
+}
+
+void coalesce_flush(EV_P)
+{
+	ev_tstamp now = ev_now(EV_A);
+	int held = 0;
+
+	ev_timer_stop(EV_A_ &coalesce_timer);
+
+	coalesce_flush_neighs();
+	/* make before break, so shared targets aren't dropped in between */
+	coalesce_flush_routes(RTM_NEWROUTE, now, &held);
+	coalesce_flush_routes(RTM_DELROUTE, now, &held);
+	coalesce_forget_routes(now);
+
+	if (held > 0) {
+		fr_printf(DEBUG1, "coalesce: holding %d dampened prefixes\n", held);
+		coalesce_arm(EV_A_ COALESCE_RECHECK);
+	} else if (!RB_EMPTY_ROOT(&coalesce_route_tree)) {
+		/* keep decaying penalties, until they are forgotten */
+		coalesce_arm(EV_A_ COALESCE_DAMP_HALF_LIFE);
+	}
+}
+
+/* drop everything, without applying it */
+void coalesce_fini(EV_P)
+{
+	struct rb_node *node;
+
+	ev_timer_stop(EV_A_ &coalesce_timer);
+
+	while ((node = rb_first(&coalesce_neigh_tree))) {
+		rb_erase(node, &coalesce_neigh_tree);
+		free(rb_container_of(node, struct coalesce_neigh, node));
+		AN(coalesce_pending_cnt--);
+	}
+
+	while ((node = rb_first(&coalesce_route_tree))) {
+		struct coalesce_route *cr = rb_container_of(node, struct coalesce_route, node);
+
+		rb_erase(node, &coalesce_route_tree);
+		if (cr->is_pending)
+			coalesce_route_clear_pending(cr);
+		free(cr);
+	}
+	AZ(coalesce_pending_cnt);
+}
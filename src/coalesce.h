@@ -0,0 +1,9 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include "obj.h"
+
+void coalesce_route_update(const uint16_t nlmsg_type, struct obj_target *t, const struct af_addr *dst);
+void coalesce_neigh_update(const uint16_t nlmsg_type, const int ifindex, const uint8_t af, const union some_in_addr *addr, const uint8_t (*lladdr)[ETH_ALEN], const uint16_t nud_state);
+void coalesce_flush(EV_P);
+void coalesce_fini(EV_P);
+int coalesce_pending_count(void);
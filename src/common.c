@@ -35,6 +35,8 @@ void print_af_addr(const struct af_addr *af_addr)
 	char out[INET6_ADDRSTRLEN];
 
 	AN(af_addr);
+	if (!DBG_LEVEL(INFO))
+		return;
 	if (inet_ntop(af_addr->af, &af_addr->in, out, sizeof(out)))
 		fr_printf(INFO, "%s/%d\n", out, af_addr->mask_len);
 }
@@ -12,7 +12,8 @@ void config_init(const char *prog_name)
 
 	/* default values */
 	config->scan_interval = 10;
-	config->flower_flags = TCA_CLS_FLAGS_SKIP_SW | TCA_CLS_FLAGS_IN_HW;
+	config->metrics_interval = 5;
+	config->flower_flags = TCA_CLS_FLAGS_SKIP_SW;
 }
 
 void config_free(void)
@@ -21,11 +22,29 @@ void config_free(void)
 		free(config->prog_name);
 		config->prog_name = NULL;
 	}
-	if (config->ifname) {
-		free(config->ifname);
-		config->ifname = NULL;
+	for (unsigned int i = 0; i < config->if_cnt; i++) {
+		free(config->ifname[i]);
+		config->ifname[i] = NULL;
+	}
+	if (config->metrics_file) {
+		free(config->metrics_file);
+		config->metrics_file = NULL;
+	}
+	if (config->capture_file) {
+		free(config->capture_file);
+		config->capture_file = NULL;
 	}
 	onload_free();
 	free(config);
 	config = NULL;
 }
+
+/* returns the device number of ifindex, or -1 if it isn't one of ours */
+int config_if_lookup(const unsigned int ifindex)
+{
+	for (unsigned int i = 0; i < config->if_cnt; i++) {
+		if (config->ifidx[i] == ifindex)
+			return i;
+	}
+	return -1;
+}
@@ -14,21 +14,35 @@ struct config_prefix_list {
 	struct config_prefix_list *next;
 };
 
+/* max. number of ingress devices */
+#define CONFIG_MAX_IFACES 8
+
 struct config {
 	uint32_t table_id;
-	unsigned int ifidx;
+	unsigned int if_cnt;
+	unsigned int ifidx[CONFIG_MAX_IFACES]; /* rules are installed on each of them */
 	unsigned int scan_interval;
 	unsigned int timeout;
-	char *ifname;
+	unsigned int coalesce_ms;
+	char *ifname[CONFIG_MAX_IFACES];
 	char *prog_name;
 	struct config_prefix_list *prefix_list_head;
 	uint8_t dry_run;
 	uint32_t flower_flags;
 	uint8_t verbosity;
 	int exit_after_first_sync;
+	int full_scans; /* don't use terse dumps for verification */
+	int no_tc_monitor; /* don't subscribe to TC events */
+	int flush; /* empty our chains after the first scan */
+	int flush_on_exit; /* empty our chains before exiting */
+	uint32_t block_index; /* shared TC block of the devices, 0 = none */
+	char *metrics_file; /* written periodically, if set */
+	unsigned int metrics_interval; /* seconds between metrics writes */
+	char *capture_file; /* received netlink datagrams are written here, if set */
 };
 
 extern struct config *config;
 
 void config_init(const char *prog_name);
 void config_free(void);
+int config_if_lookup(const unsigned int ifindex);
@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * logging, off the hot path
+ *
+ * Once debug_init() is called, messages are formatted into a ring,
+ * and written out in bulk, before the event loop goes back to sleep,
+ * instead of with a write(2) for every fprintf() on unbuffered stderr.
+ * Errors are still written out straight away.
+ *
+ * Until then, and while in sync mode, they go straight to stderr.
+ */
+
+#include "common.h"
+
+#include <stdarg.h>
+
+#define DEBUG_RING_SIZE (1 << 20) /* must be a power of 2 */
+#define DEBUG_RING_MASK (DEBUG_RING_SIZE - 1)
+#define DEBUG_LINE_MAX 512 /* longer messages are written through */
+
+static char debug_ring[DEBUG_RING_SIZE];
+static size_t debug_head; /* bytes ever put in the ring */
+static size_t debug_tail; /* bytes ever written out */
+static int debug_fd = -1;
+static int debug_is_sync;
+static ev_prepare debug_watcher;
+
+static void debug_put(const char *s, const size_t len)
+{
+	size_t off = debug_head & DEBUG_RING_MASK;
+	size_t first = DEBUG_RING_SIZE - off;
+
+	if (first > len)
+		first = len;
+	memcpy(&debug_ring[off], s, first);
+	memcpy(debug_ring, s + first, len - first);
+	debug_head += len;
+}
+
+void debug_flush(void)
+{
+	int saved_errno = errno;
+
+	while (debug_tail != debug_head) {
+		size_t off = debug_tail & DEBUG_RING_MASK;
+		size_t len = debug_head - debug_tail;
+		ssize_t ret;
+
+		if (len > DEBUG_RING_SIZE - off)
+			len = DEBUG_RING_SIZE - off;
+		ret = write(debug_fd, &debug_ring[off], len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0) {
+			/* nowhere left to complain */
+			debug_tail = debug_head;
+			break;
+		}
+		debug_tail += ret;
+	}
+	errno = saved_errno;
+}
+
+void fr_log(const int level, const char *fmt, ...)
+{
+	char line[DEBUG_LINE_MAX];
+	int saved_errno = errno;
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	if (debug_fd < 0) {
+		vfprintf(stderr, fmt, ap);
+		goto out;
+	}
+	if (debug_is_sync) {
+		vdprintf(debug_fd, fmt, ap);
+		goto out;
+	}
+
+	len = vsnprintf(line, sizeof(line), fmt, ap);
+	if (len < 0)
+		goto out;
+	if ((size_t) len >= sizeof(line)) {
+		/* rare, so written through, after what's already queued */
+		va_end(ap);
+		va_start(ap, fmt);
+		debug_flush();
+		vdprintf(debug_fd, fmt, ap);
+		goto out;
+	}
+
+	if ((size_t) len > DEBUG_RING_SIZE - (debug_head - debug_tail))
+		debug_flush();
+	debug_put(line, len);
+	if (level == VERBOSITY_LEVEL_ERROR)
+		debug_flush();
+out:
+	va_end(ap);
+	errno = saved_errno;
+}
+
+/* returns true, if the message should be printed */
+int debug_ratelimit(struct debug_ratelimit *rl, const int level, const char *func)
+{
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+	ev_tstamp now = ev_now(EV_A);
+
+	if (rl->begin == 0. || now - rl->begin >= DEBUG_RATELIMIT_INTERVAL) {
+		if (rl->missed > 0)
+			fr_log(level, "%s: %u messages suppressed\n", func, rl->missed);
+		rl->begin = now;
+		rl->printed = 0;
+		rl->missed = 0;
+	}
+	if (rl->printed < DEBUG_RATELIMIT_BURST) {
+		rl->printed++;
+		return true;
+	}
+	rl->missed++;
+	return false;
+}
+
+/* while in sync mode, messages are written through, eg. around hexdumps to stderr */
+void debug_sync(const int sync)
+{
+	if (sync)
+		debug_flush();
+	debug_is_sync = sync;
+}
+
+static void debug_prepare_cb(EV_P_ ev_prepare *w, int revents)
+{
+	fr_ev_unused();
+	fr_unused(w);
+	fr_unused(revents);
+	debug_flush();
+}
+
+void debug_init(EV_P_ const int fd)
+{
+	static int registered;
+
+	AN(fd >= 0);
+	debug_fd = fd;
+	ev_prepare_init(&debug_watcher, debug_prepare_cb);
+	ev_prepare_start(EV_A_ &debug_watcher);
+	ev_unref(EV_A); /* don't keep the loop alive on our own */
+
+	/* exit() can be called from anywhere */
+	if (!registered) {
+		atexit(debug_flush);
+		registered = true;
+	}
+}
+
+void debug_fini(EV_P)
+{
+	if (debug_fd < 0)
+		return;
+	ev_ref(EV_A);
+	ev_prepare_stop(EV_A_ &debug_watcher);
+	debug_flush();
+	debug_fd = -1;
+}
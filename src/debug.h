@@ -10,14 +10,46 @@ enum fr_debug_verbosity_level {
 	VERBOSITY_LEVEL_DEBUG3,
 };
 
+/* levels above this are compiled out, see VERBOSITY_MAX in the Makefile */
+#ifndef FR_VERBOSITY_MAX
+#define FR_VERBOSITY_MAX VERBOSITY_LEVEL_DEBUG3
+#endif
+
 #define DBG_LEVEL(prio) \
-	(config->verbosity >= VERBOSITY_LEVEL_##prio)
+	(VERBOSITY_LEVEL_##prio <= FR_VERBOSITY_MAX && \
+	 config->verbosity >= VERBOSITY_LEVEL_##prio)
 
 #define fr_printf(prio, ...) \
 	do { \
 		if (DBG_LEVEL(prio)) { \
 			if (DBG_LEVEL(DEBUG3)) \
-				fprintf(stderr, "%s:%d:%s(): ", __FILE__, __LINE__, __func__); \
-			fprintf(stderr, __VA_ARGS__); \
+				fr_log(VERBOSITY_LEVEL_##prio, "%s:%d:%s(): ", __FILE__, __LINE__, __func__); \
+			fr_log(VERBOSITY_LEVEL_##prio, __VA_ARGS__); \
 		} \
 	} while (0)
+
+/* each call site prints at most a burst of messages per interval */
+#define DEBUG_RATELIMIT_BURST 10
+#define DEBUG_RATELIMIT_INTERVAL 5. /* seconds */
+
+struct debug_ratelimit {
+	ev_tstamp begin;
+	unsigned int printed;
+	unsigned int missed;
+};
+
+/* for messages, that can be repeated for every rule */
+#define fr_printf_ratelimited(prio, ...) \
+	do { \
+		static struct debug_ratelimit debug_rl; \
+		if (DBG_LEVEL(prio) && \
+		    debug_ratelimit(&debug_rl, VERBOSITY_LEVEL_##prio, __func__)) \
+			fr_printf(prio, __VA_ARGS__); \
+	} while (0)
+
+void fr_log(const int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int debug_ratelimit(struct debug_ratelimit *rl, const int level, const char *func);
+void debug_init(EV_P_ const int fd);
+void debug_fini(EV_P);
+void debug_flush(void);
+void debug_sync(const int sync);
@@ -73,7 +73,7 @@ static void advance_state(EV_P_ void *data, int nl_errno)
 	switch (state->state) {
 	case 1:
 		nl_conn_open(0, c, "hack");
-		queue_init(c);
+		queue_init(QUEUE_LANE_DUMP, c);
 		break;
 	case NEW_HACK_STEP:
 		// delete chain 14 rule 1
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "hist.h"
+
+void hist_record(struct hist *h, const ev_tstamp latency)
+{
+	double usec = latency * 1e6;
+	unsigned int b = 0;
+
+	while (usec >= 2. && b < HIST_BUCKETS - 1) {
+		usec /= 2.;
+		b++;
+	}
+	h->buckets[b]++;
+	h->cnt++;
+	h->sum += latency;
+	if (latency > h->max)
+		h->max = latency;
+}
+
+/* upper bound of the bucket, that the percentile falls in, at most the max */
+ev_tstamp hist_percentile(const struct hist *h, const double pct)
+{
+	uint64_t want, sum = 0;
+	ev_tstamp bound;
+
+	if (h->cnt == 0)
+		return 0.;
+	want = (uint64_t) (h->cnt * pct / 100.);
+	if (want == 0)
+		want = 1;
+	for (unsigned int b = 0; b < HIST_BUCKETS; b++) {
+		sum += h->buckets[b];
+		if (sum >= want) {
+			bound = (double) (UINT64_C(2) << b) / 1e6;
+			return bound < h->max ? bound : h->max;
+		}
+	}
+	return h->max;
+}
@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef FLOWER_ROUTE_HIST_H
+#define FLOWER_ROUTE_HIST_H
+
+#include "common.h"
+
+#define HIST_BUCKETS 32
+
+/* latency histogram, in log2 buckets of microseconds */
+struct hist {
+	uint64_t cnt;
+	ev_tstamp sum;
+	ev_tstamp max;
+	uint64_t buckets[HIST_BUCKETS];
+};
+
+void hist_record(struct hist *h, const ev_tstamp latency);
+ev_tstamp hist_percentile(const struct hist *h, const double pct);
+
+#endif
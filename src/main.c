@@ -2,6 +2,8 @@
 
 #include "common.h"
 
+#include <signal.h>
+
 #include "options.h"
 #include "rt_names.h"
 
@@ -9,8 +11,15 @@
 #include "monitor.h"
 #include "obj_rule.h"
 #include "sched_basic.h"
+#include "coalesce.h"
+#include "metrics.h"
+#include "capture.h"
+#include "nl_queue.h"
+#include "trace.h"
+#include "tc_dry_run.h"
 
 ev_timer timeout_watcher;
+ev_signal dump_watcher;
 
 static void timeout_cb(EV_P_ ev_timer *w, int revents)
 {
@@ -20,6 +29,40 @@ static void timeout_cb(EV_P_ ev_timer *w, int revents)
 	ev_break(EV_A_ EVBREAK_ALL);
 }
 
+/* the full state is too much to print after every scan, so it's on SIGUSR1 */
+static void dump_cb(EV_P_ ev_signal *w, int revents)
+{
+	uint8_t verbosity = config->verbosity;
+
+	fr_ev_unused();
+	fr_unused(w);
+	fr_unused(revents);
+	if (config->verbosity < VERBOSITY_LEVEL_DEBUG1)
+		config->verbosity = VERBOSITY_LEVEL_DEBUG1;
+	debug_sync(true);
+	obj_rule_print_all();
+	obj_rule_print_hw_report();
+	queue_stats_print();
+	trace_print();
+	debug_sync(false);
+	config->verbosity = verbosity;
+}
+
+static void dump_init(EV_P)
+{
+	ev_signal_init(&dump_watcher, dump_cb, SIGUSR1);
+	ev_signal_start(EV_A_ &dump_watcher);
+	ev_unref(EV_A);
+}
+
+static void flushed_cb(void *data)
+{
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+
+	fr_unused(data);
+	ev_break(EV_A_ EVBREAK_ALL);
+}
+
 static void timeout_init(EV_P)
 {
 	double timeout = config->timeout;
@@ -38,19 +81,43 @@ int main(int argc, char **argv)
 	rt_names_init();
 	config_init(argv[0]);
 	options_parse(argc, argv);
+	if (config->capture_file != NULL && capture_open(config->capture_file) != 0)
+		return EXIT_FAILURE;
 
 	/* kickstart event loop */
+	debug_init(EV_A_ STDERR_FILENO);
 	timeout_init(EV_A);
+	dump_init(EV_A);
 	monitor_init(EV_A);
 	sched_setup();
+	if (config->dry_run)
+		tc_dry_run_init();
 	sched_init();
 	scan_init(EV_A);
 	obj_rule_init();
+	metrics_init(EV_A);
 
 	ev_run(EV_A_ 0);
 
+	if (config->flush_on_exit) {
+		/* pinned, so that nothing new is installed meanwhile */
+		obj_rule_reset_pin();
+		if (obj_rule_flush(flushed_cb, NULL) > 0)
+			ev_run(EV_A_ 0);
+	}
+
+	metrics_fini(EV_A);
 	scan_fini(EV_A);
+	coalesce_fini(EV_A);
+	capture_close();
+	if (config->dry_run) {
+		tc_dry_run_report(stdout);
+		tc_dry_run_fini();
+	}
 
+	ev_ref(EV_A);
+	ev_signal_stop(EV_A_ &dump_watcher);
+	debug_fini(EV_A);
 	ev_loop_destroy(EV_A);
 
 	fr_printf(INFO, "Oops, we exited the event loop!\n");
@@ -0,0 +1,235 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * metrics, in Prometheus' text exposition format
+ *
+ * With --metrics-file, they are written to a temporary file, and renamed
+ * over the target, so that a textfile collector never sees half a file.
+ * Counters are totals since start, rates are left to the collector.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "metrics.h"
+#include "nl_conn.h"
+#include "nl_queue.h"
+#include "nl_receive.h"
+#include "obj_link.h"
+#include "obj_neigh.h"
+#include "obj_route.h"
+#include "obj_rule.h"
+#include "obj_target.h"
+#include "coalesce.h"
+#include "scan.h"
+#include "trace.h"
+
+#define METRICS_PREFIX "flower_route_"
+
+static ev_timer metrics_timer;
+
+static void metrics_header(FILE *f, const char *name, const char *type, const char *help)
+{
+	fprintf(f, "# HELP "METRICS_PREFIX"%s %s\n", name, help);
+	fprintf(f, "# TYPE "METRICS_PREFIX"%s %s\n", name, type);
+}
+
+/* label values are quoted, so escape what would end them */
+static void metrics_label_value(FILE *f, const char *s)
+{
+	for (; *s != '\0'; s++) {
+		if (*s == '\\' || *s == '"')
+			fputc('\\', f);
+		if (*s == '\n')
+			fputs("\\n", f);
+		else
+			fputc(*s, f);
+	}
+}
+
+/* as a summary, quantile 1 is the max */
+static void metrics_print_hist(FILE *f, const char *name, const char *label, const char *value, const struct hist *h)
+{
+	static const double quantiles[] = { .5, .9, .99, 1. };
+
+	for (unsigned int i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++)
+		fprintf(f, METRICS_PREFIX"%s{%s=\"%s\",quantile=\"%g\"} %.6f\n", name, label, value,
+			quantiles[i], hist_percentile(h, quantiles[i] * 100.));
+	fprintf(f, METRICS_PREFIX"%s_sum{%s=\"%s\"} %.6f\n", name, label, value, h->sum);
+	fprintf(f, METRICS_PREFIX"%s_count{%s=\"%s\"} %"PRIu64"\n", name, label, value, h->cnt);
+}
+
+static void metrics_print_queue(FILE *f)
+{
+	metrics_header(f, "queue_depth", "gauge", "Unsent requests in the netlink queue.");
+	for (int i = 0; i < QUEUE_LANE_CNT; i++)
+		fprintf(f, METRICS_PREFIX"queue_depth{lane=\"%s\"} %u\n",
+			queue_lane_name(i), queue_get_depth(i));
+
+	metrics_header(f, "queue_in_flight", "gauge", "Requests sent, but not yet answered.");
+	for (int i = 0; i < QUEUE_LANE_CNT; i++)
+		fprintf(f, METRICS_PREFIX"queue_in_flight{lane=\"%s\"} %u\n",
+			queue_lane_name(i), queue_get_in_flight(i));
+
+	metrics_header(f, "queue_latency_seconds", "summary", "Time from sending a queue item, until it completed.");
+	for (int i = 0; i < QUEUE_KIND_CNT; i++)
+		metrics_print_hist(f, "queue_latency_seconds", "kind", queue_kind_name(i), &queue_get_stats(i)->latency);
+
+	metrics_header(f, "queue_timeouts_total", "counter", "Queue items that hung, and got the connection reset.");
+	for (int i = 0; i < QUEUE_KIND_CNT; i++)
+		fprintf(f, METRICS_PREFIX"queue_timeouts_total{kind=\"%s\"} %"PRIu64"\n",
+			queue_kind_name(i), queue_get_stats(i)->timeouts);
+}
+
+static void metrics_print_conn_counter(FILE *f, const char *name, const char *help, const size_t offset)
+{
+	metrics_header(f, name, "counter", help);
+	for (unsigned int i = 0; i < NL_CONN_MAX; i++) {
+		struct conn *c = nl_conn_get(i);
+
+		if (c == NULL)
+			continue;
+		fprintf(f, METRICS_PREFIX"%s{conn=\"%s\"} %"PRIu64"\n", name,
+			nl_conn_get_name(c), *(const uint64_t *)((const char *)c + offset));
+	}
+}
+
+static void metrics_print_netlink(FILE *f)
+{
+	const struct nl_error_stats *st = nl_receive_get_error_stats();
+
+	metrics_print_conn_counter(f, "netlink_requests_total", "Netlink requests sent.",
+				   offsetof(struct conn, tx_requests));
+	metrics_print_conn_counter(f, "netlink_acks_total", "Netlink requests completed without an error.",
+				   offsetof(struct conn, rx_acks));
+	metrics_print_conn_counter(f, "netlink_failures_total", "Netlink requests completed with an error.",
+				   offsetof(struct conn, rx_errors));
+	metrics_print_conn_counter(f, "netlink_received_bytes_total", "Bytes received from netlink.",
+				   offsetof(struct conn, rx_bytes));
+
+	metrics_header(f, "netlink_errors_total", "counter", "Netlink errors, by errno and extended ack message.");
+	for (unsigned int i = 0; i < NL_ERROR_STATS_MAX; i++) {
+		if (st[i].cnt == 0)
+			continue;
+		if (st[i].code != 0)
+			fprintf(f, METRICS_PREFIX"netlink_errors_total{errno=\"%u\",msg=\"", st[i].code);
+		else
+			fprintf(f, METRICS_PREFIX"netlink_errors_total{errno=\"other\",msg=\"");
+		metrics_label_value(f, st[i].msg);
+		fprintf(f, "\"} %"PRIu64"\n", st[i].cnt);
+	}
+}
+
+static void metrics_print_objects(FILE *f)
+{
+	struct obj_rule_state_stats st;
+
+	metrics_header(f, "objects", "gauge", "Objects, by kind.");
+	fprintf(f, METRICS_PREFIX"objects{kind=\"link\"} %d\n", obj_link_count());
+	fprintf(f, METRICS_PREFIX"objects{kind=\"neigh\"} %d\n", obj_neigh_count());
+	fprintf(f, METRICS_PREFIX"objects{kind=\"target\"} %d\n", obj_target_count());
+	fprintf(f, METRICS_PREFIX"objects{kind=\"route\"} %d\n", obj_route_count());
+	fprintf(f, METRICS_PREFIX"objects{kind=\"rule\"} %d\n", obj_rule_count());
+
+	metrics_header(f, "rules", "gauge", "Rules, by state.");
+	obj_rule_get_state_stats(&st);
+	for (int i = 0; i < OBJ_RULE_STATE_CNT; i++)
+		fprintf(f, METRICS_PREFIX"rules{state=\"%s\"} %u\n", obj_rule_state_str(i), st.cnt[i]);
+
+	metrics_header(f, "coalesce_pending", "gauge", "Updates held back by --coalesce.");
+	fprintf(f, METRICS_PREFIX"coalesce_pending %d\n", coalesce_pending_count());
+}
+
+static void metrics_print_scan(FILE *f)
+{
+	const struct scan_stats *st;
+
+	metrics_header(f, "scan_duration_seconds", "gauge", "Time spent in each part of the last scan.");
+	for (unsigned int i = 0; (st = scan_get_stats(i)) != NULL; i++)
+		fprintf(f, METRICS_PREFIX"scan_duration_seconds{helper=\"%s\"} %.6f\n",
+			scan_stats_name(i), st->duration);
+
+	metrics_header(f, "scan_dumps", "gauge", "Dumps in each part of the last scan.");
+	for (unsigned int i = 0; (st = scan_get_stats(i)) != NULL; i++)
+		fprintf(f, METRICS_PREFIX"scan_dumps{helper=\"%s\"} %u\n",
+			scan_stats_name(i), st->dumps);
+
+	metrics_header(f, "scan_received_bytes", "gauge", "Bytes dumped in each part of the last scan.");
+	for (unsigned int i = 0; (st = scan_get_stats(i)) != NULL; i++)
+		fprintf(f, METRICS_PREFIX"scan_received_bytes{helper=\"%s\"} %"PRIu64"\n",
+			scan_stats_name(i), st->rx_bytes);
+}
+
+static void metrics_print_convergence(FILE *f)
+{
+	metrics_header(f, "convergence_seconds", "summary", "Time from the netlink event, until a rule change reached each stage.");
+	for (int i = TRACE_STAGE_QUEUED; i < TRACE_STAGE_CNT; i++)
+		metrics_print_hist(f, "convergence_seconds", "stage", trace_stage_name(i), trace_get_hist(i));
+	metrics_print_hist(f, "convergence_seconds", "stage", "total", trace_get_total());
+}
+
+void metrics_print(FILE *f)
+{
+	metrics_print_queue(f);
+	metrics_print_netlink(f);
+	metrics_print_objects(f);
+	metrics_print_scan(f);
+	metrics_print_convergence(f);
+}
+
+int metrics_write(const char *path)
+{
+	size_t len = strlen(path) + sizeof(".tmp");
+	char *tmp = fr_malloc(len);
+	FILE *f;
+	int ret = -1;
+
+	snprintf(tmp, len, "%s.tmp", path);
+	f = fopen(tmp, "w");
+	if (f == NULL) {
+		fr_printf(ERROR, "metrics: unable to open %s: %s\n", tmp, strerror(errno));
+		goto out;
+	}
+	metrics_print(f);
+	if (fclose(f) != 0) {
+		fr_printf(ERROR, "metrics: unable to write %s: %s\n", tmp, strerror(errno));
+		goto out_unlink;
+	}
+	if (rename(tmp, path) != 0) {
+		fr_printf(ERROR, "metrics: unable to rename %s: %s\n", tmp, strerror(errno));
+		goto out_unlink;
+	}
+	ret = 0;
+	goto out;
+out_unlink:
+	unlink(tmp);
+out:
+	free(tmp);
+	return ret;
+}
+
+static void metrics_timer_cb(EV_P_ ev_timer *w, int revents)
+{
+	fr_unused(w);
+	fr_unused(revents);
+	metrics_write(config->metrics_file);
+}
+
+void metrics_init(EV_P)
+{
+	if (config->metrics_file == NULL)
+		return;
+	ev_timer_init(&metrics_timer, metrics_timer_cb, 0., config->metrics_interval);
+	ev_timer_again(EV_A_ &metrics_timer);
+	ev_unref(EV_A); /* don't keep the loop alive on our own */
+}
+
+/* a final write, with the state at exit */
+void metrics_fini(EV_P)
+{
+	if (config->metrics_file == NULL)
+		return;
+	ev_ref(EV_A);
+	ev_timer_stop(EV_A_ &metrics_timer);
+	metrics_write(config->metrics_file);
+}
@@ -0,0 +1,8 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include "common.h"
+
+void metrics_init(EV_P);
+void metrics_fini(EV_P);
+void metrics_print(FILE *f);
+int metrics_write(const char *path);
@@ -5,6 +5,8 @@
 #include "nl_conn.h"
 #include "nl_receive.h"
 
+#define NL_GROUP(group) (1U << ((group) - 1))
+
 struct monitor {
 	struct conn c;
 };
@@ -26,13 +28,18 @@ void monitor_init(EV_P)
 {
 	struct monitor *m = fr_malloc(sizeof(struct monitor));
 	struct conn *c = &m->c;
-	int groups = 0;
+	unsigned int groups = 0;
 
-	groups |= RTNLGRP_LINK;
-	groups |= RTNLGRP_NEIGH;
-	groups |= RTNLGRP_TC;
-	groups |= RTNLGRP_IPV4_ROUTE;
-	groups |= RTNLGRP_IPV6_ROUTE;
+	/* bind(2) takes a bitmask, where bit n-1 is multicast group n */
+	groups |= NL_GROUP(RTNLGRP_LINK);
+	groups |= NL_GROUP(RTNLGRP_NEIGH);
+	/* our own changes are echoed back on the install lane,
+	 * others' changes are otherwise only seen when scanning */
+	if (!config->no_tc_monitor)
+		groups |= NL_GROUP(RTNLGRP_TC);
+	groups |= NL_GROUP(RTNLGRP_IPV4_ROUTE);
+	groups |= NL_GROUP(RTNLGRP_IPV6_ROUTE);
+	groups |= NL_GROUP(RTNLGRP_NEXTHOP);
 
 	nl_conn_open(groups, c, "monitor");
 	c->on_complete = monitor_complete;
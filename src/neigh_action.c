@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "neigh_action.h"
+#include "nl_queue.h"
+#include "nl_send.h"
+
+struct neigh_action {
+	int ifindex;
+	struct af_addr addr;
+};
+
+/*
+ * NTF_USE makes the kernel act as if it had a packet for the neighbour,
+ * so it starts resolving it, creating the entry if needed
+ */
+static void neigh_action_do_probe(EV_P_ const int ifindex, const struct af_addr *addr)
+{
+	char buf[MNL_SOCKET_DUMP_SIZE];
+	struct conn *c = queue_get_conn(QUEUE_LANE_INSTALL);
+	struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
+	struct ndmsg *ndm;
+
+	nlh->nlmsg_type = RTM_NEWNEIGH;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_REPLACE;
+	ndm = mnl_nlmsg_put_extra_header(nlh, sizeof(struct ndmsg));
+	ndm->ndm_family = addr->af;
+	ndm->ndm_ifindex = ifindex;
+	ndm->ndm_state = NUD_PROBE;
+	ndm->ndm_flags = NTF_USE;
+
+	switch (addr->af) {
+	case AF_INET:
+		mnl_attr_put(nlh, NDA_DST, sizeof(struct in_addr), &addr->in.v4);
+		break;
+	case AF_INET6:
+		mnl_attr_put(nlh, NDA_DST, sizeof(struct in6_addr), &addr->in.v6);
+		break;
+	default:
+		AN(false);
+		break;
+	}
+
+	nl_send_req(EV_A_ c, nlh);
+}
+
+static struct neigh_action_callbacks nacb = {
+	.probe = neigh_action_do_probe,
+};
+
+struct neigh_action_callbacks *neigh_action_get_callbacks(void)
+{
+	return &nacb;
+}
+
+static void neigh_action_execute(EV_P_ void *data)
+{
+	struct neigh_action *na = data;
+
+	AN(nacb.probe);
+	nacb.probe(EV_A_ na->ifindex, &na->addr);
+}
+
+static void neigh_action_done(EV_P_ void *data, const int nl_errno)
+{
+	struct neigh_action *na = data;
+
+	if (nl_errno != 0)
+		fr_printf(DEBUG1, "neigh probe on %d failed: %d\n", na->ifindex, nl_errno);
+	free(na);
+}
+
+void neigh_action_probe(const int ifindex, const struct af_addr *addr)
+{
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+	struct neigh_action *na;
+
+	if (config->dry_run)
+		return;
+
+	na = fr_malloc(sizeof(struct neigh_action));
+	na->ifindex = ifindex;
+	memcpy(&na->addr, addr, sizeof(struct af_addr));
+
+	/* routes are waiting for it */
+	queue_schedule_in(EV_A_ QUEUE_LANE_INSTALL, QUEUE_CLASS_URGENT, QUEUE_KIND_PROBE, neigh_action_execute, neigh_action_done, na);
+}
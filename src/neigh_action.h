@@ -0,0 +1,11 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include "common.h"
+
+struct neigh_action_callbacks {
+	void (*probe)(EV_P_ const int ifindex, const struct af_addr *addr);
+};
+
+struct neigh_action_callbacks *neigh_action_get_callbacks(void);
+
+void neigh_action_probe(const int ifindex, const struct af_addr *addr);
@@ -18,9 +18,14 @@ struct conn {
 	unsigned int seq;
 	void (*on_complete)(EV_P_ struct conn *c, int nl_errno);
 	void (*on_send_req)(struct conn *c);
+	void (*on_progress)(EV_P_ struct conn *c);
 	int busy;
 	int queue_pos;
 	char *name;
+	uint64_t tx_requests; /* counters for the metrics, kept across resets */
+	uint64_t rx_acks; /* requests completed without an error */
+	uint64_t rx_errors;
+	uint64_t rx_bytes;
 };
 
 void common_netlink_set_seq(struct nlmsghdr *nlh, struct conn *c);
@@ -17,6 +17,27 @@
 #include "nl_send.h"
 #include "nl_conn.h"
 
+static struct conn *nl_conns[NL_CONN_MAX];
+
+static void nl_conn_register(struct conn *c)
+{
+	for (unsigned int i = 0; i < NL_CONN_MAX; i++) {
+		if (nl_conns[i] == NULL) {
+			nl_conns[i] = c;
+			return;
+		}
+	}
+	AN(false);
+}
+
+static void nl_conn_unregister(struct conn *c)
+{
+	for (unsigned int i = 0; i < NL_CONN_MAX; i++) {
+		if (nl_conns[i] == c)
+			nl_conns[i] = NULL;
+	}
+}
+
 static void nl_conn_set_name(struct conn *c, const char *name)
 {
 	AZ(c->name);
@@ -24,7 +45,7 @@ static void nl_conn_set_name(struct conn *c, const char *name)
 	AN(c->name);
 }
 
-struct conn *nl_conn_open(int groups, struct conn *reuse_conn, const char *name)
+struct conn *nl_conn_open(unsigned int groups, struct conn *reuse_conn, const char *name)
 {
 	int fd;
 	int val = 1;
@@ -80,6 +101,7 @@ struct conn *nl_conn_open(int groups, struct conn *reuse_conn, const char *name)
 		c->portid = mnl_socket_get_portid(c->nl);
 		c->seq = time(NULL) ^ c->portid;
 	}
+	nl_conn_register(c);
 
 	return c;
 error_out:
@@ -91,6 +113,7 @@ error_out:
 void nl_conn_close(EV_P_ struct conn *c)
 {
 	ev_io_stop(EV_A_ &c->w);
+	nl_conn_unregister(c);
 	mnl_socket_close(c->nl);
 	c->nl = NULL;
 
@@ -103,3 +126,10 @@ const char *nl_conn_get_name(struct conn *c)
 {
 	return c->name;
 }
+
+/* NULL for an unused slot */
+struct conn *nl_conn_get(const unsigned int idx)
+{
+	AN(idx < NL_CONN_MAX);
+	return nl_conns[idx];
+}
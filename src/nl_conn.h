@@ -2,6 +2,10 @@
 
 #include "nl_common.h"
 
-struct conn *nl_conn_open(int groups, struct conn *reuse_conn, const char *name);
+struct conn *nl_conn_open(unsigned int groups, struct conn *reuse_conn, const char *name);
 void nl_conn_close(EV_P_ struct conn *c);
 const char *nl_conn_get_name(struct conn *c);
+
+/* open connections, for the metrics */
+#define NL_CONN_MAX 8
+struct conn *nl_conn_get(const unsigned int idx);
@@ -12,11 +12,14 @@
 #include "obj_neigh.h"
 #include "obj_route.h"
 #include "obj_target.h"
+#include "coalesce.h"
+#include "trace.h"
 
 #include <libmnl/libmnl.h>
 #include <errno.h>
 #include <stdio.h>
 #include <linux/rtnetlink.h>
+#include <linux/nexthop.h>
 #include <netinet/in.h>
 #include <string.h>
 #include <arpa/inet.h>
@@ -55,7 +58,7 @@ static const struct type_map neigh_attr_types[NDA_MAX+1] = {
 };
 decode_nlattr_cb(neigh, NDA_MAX, true)
 
-static const struct type_map route4_attr_types[RTAX_MAX+1] = {
+static const struct type_map route4_attr_types[RTA_MAX+1] = {
 	TYPE_MAP(RTA_TABLE,     U32),
 	TYPE_MAP(RTA_OIF,       U32),
 	TYPE_MAP(RTA_FLOW,      U32),
@@ -66,10 +69,11 @@ static const struct type_map route4_attr_types[RTAX_MAX+1] = {
 	TYPE_MAP(RTA_GATEWAY,   U32),
 	TYPE_MAP(RTA_METRICS,   NESTED),
 	TYPE_MAP(RTA_MULTIPATH, BINARY),
+	TYPE_MAP(RTA_NH_ID,     U32),
 };
-decode_nlattr_cb(route4, RTAX_MAX, true)
+decode_nlattr_cb(route4, RTA_MAX, true)
 
-static const struct type_map route6_attr_types[RTAX_MAX+1] = {
+static const struct type_map route6_attr_types[RTA_MAX+1] = {
 	TYPE_MAP(RTA_TABLE,     U32),
 	TYPE_MAP(RTA_OIF,       U32),
 	TYPE_MAP(RTA_FLOW,      U32),
@@ -81,8 +85,80 @@ static const struct type_map route6_attr_types[RTAX_MAX+1] = {
 	TYPE_MAP(RTA_METRICS,   NESTED),
 	TYPE_MAP(RTA_MULTIPATH, BINARY),
 	TYPE_MAP(RTA_CACHEINFO, BINARY),
+	TYPE_MAP(RTA_NH_ID,     U32),
 };
-decode_nlattr_cb(route6, RTAX_MAX, true)
+decode_nlattr_cb(route6, RTA_MAX, true)
+
+static const struct type_map nexthop_attr_types[NHA_MAX+1] = {
+	TYPE_MAP(NHA_ID,        U32),
+	TYPE_MAP(NHA_GROUP,     BINARY),
+	TYPE_MAP(NHA_BLACKHOLE, FLAG),
+	TYPE_MAP(NHA_OIF,       U32),
+	TYPE_MAP(NHA_GATEWAY,   BINARY),
+};
+decode_nlattr_cb(nexthop, NHA_MAX, false)
+
+/*
+ * steady-state scans mostly repeat what is already known, so the relevant
+ * parts of each message are fingerprinted, and the fingerprint is stored
+ * on the object, when it matches the message isn't decoded any further
+ */
+#define LINK_FP_ATTRS (DECODE_FP_ATTR(IFLA_ADDRESS) | DECODE_FP_ATTR(IFLA_MTU) | \
+	DECODE_FP_ATTR(IFLA_IFNAME) | DECODE_FP_ATTR(IFLA_LINK) | DECODE_FP_ATTR(IFLA_LINKINFO))
+#define NEIGH_FP_ATTRS (DECODE_FP_ATTR(NDA_DST) | DECODE_FP_ATTR(NDA_LLADDR))
+#define ROUTE_FP_ATTRS (DECODE_FP_ATTR(RTA_TABLE) | DECODE_FP_ATTR(RTA_DST) | \
+	DECODE_FP_ATTR(RTA_OIF) | DECODE_FP_ATTR(RTA_GATEWAY) | \
+	DECODE_FP_ATTR(RTA_MULTIPATH) | DECODE_FP_ATTR(RTA_NH_ID))
+
+/* neighbours and routes are only decoded on known links,
+ * so their fingerprints are invalidated when links change */
+static uint32_t link_epoch;
+
+static size_t decode_addr_len(const uint8_t af)
+{
+	switch (af) {
+	case AF_INET:
+		return sizeof(struct in_addr);
+	case AF_INET6:
+		return sizeof(struct in6_addr);
+	default:
+		return 0;
+	}
+}
+
+/* looks up the object, that a message is about, without decoding it */
+static const struct nlattr *decode_find_addr(const struct nlmsghdr *nlh, const size_t offset, const uint16_t type, const uint8_t af)
+{
+	const struct nlattr *attr = decode_find_attr(nlh, offset, type);
+	size_t len = decode_addr_len(af);
+
+	if (attr == NULL || len == 0 || mnl_attr_get_payload_len(attr) != len)
+		return NULL;
+	return attr;
+}
+
+static struct obj_neigh *decode_neigh_lookup(const struct nlmsghdr *nlh)
+{
+	struct ndmsg *ndm = mnl_nlmsg_get_payload(nlh);
+	const struct nlattr *dst = decode_find_addr(nlh, sizeof(*ndm), NDA_DST, ndm->ndm_family);
+	struct obj_link *l = obj_link_lookup(ndm->ndm_ifindex);
+
+	if (l == NULL || dst == NULL)
+		return NULL;
+	return obj_neigh_fdb_lookup2(l, ndm->ndm_family, mnl_attr_get_payload(dst));
+}
+
+static struct obj_route *decode_route_lookup(const struct nlmsghdr *nlh)
+{
+	struct rtmsg *rm = mnl_nlmsg_get_payload(nlh);
+	const struct nlattr *dst = decode_find_addr(nlh, sizeof(*rm), RTA_DST, rm->rtm_family);
+	struct af_addr af_dst;
+
+	if (dst == NULL)
+		return NULL;
+	build_af_addr(&af_dst, rm->rtm_family, mnl_attr_get_payload(dst), rm->rtm_dst_len);
+	return obj_route_lookup(&af_dst);
+}
 
 static int decode_link(const struct nlmsghdr *nlh, struct conn *c)
 {
@@ -97,16 +173,23 @@ static int decode_link(const struct nlmsghdr *nlh, struct conn *c)
 	uint32_t mtu;
 	int is_vlan;
 	uint16_t vlan_id;
+	struct obj_link *l;
+	uint32_t fp;
 
 	if (ifi->ifi_type != ARPHRD_ETHER)
 		return MNL_CB_OK;
 
+	fp = decode_fingerprint(nlh, sizeof(*ifi), offsetof(struct ifinfomsg, ifi_flags), LINK_FP_ATTRS, 0);
+	l = obj_link_lookup(ifi->ifi_index);
+	if (l && l->nl_fp == fp)
+		return MNL_CB_OK;
+
 	ret = mnl_attr_parse(nlh, sizeof(*ifi), decode_nlattr_link_cb, tb);
 	if (ret != MNL_CB_OK)
 		return ret;
 
 	lower_ifindex = tb[IFLA_LINK] ? mnl_attr_get_u32(tb[IFLA_LINK]) : 0;
-	if (lower_ifindex != config->ifidx)
+	if (config_if_lookup(lower_ifindex) < 0)
 		return MNL_CB_OK;
 
 	ifname = tb[IFLA_IFNAME] ? mnl_attr_get_str(tb[IFLA_IFNAME]) : NULL;
@@ -138,6 +221,10 @@ static int decode_link(const struct nlmsghdr *nlh, struct conn *c)
 	vlan_id = tb_vlan[IFLA_VLAN_ID] ? mnl_attr_get_u16(tb_vlan[IFLA_VLAN_ID]) : 0;
 
 	obj_link_netlink_update(nlh->nlmsg_type, ifi->ifi_index, lladdr, lower_ifindex, vlan_id, mtu, ifname);
+	link_epoch++;
+	l = obj_link_lookup(ifi->ifi_index);
+	if (l)
+		l->nl_fp = fp;
 	fr_printf(INFO, "\n");
 
 	return MNL_CB_OK;
@@ -147,28 +234,26 @@ static struct obj_target *decode_multipath(const struct nlattr *attr, const uint
 {
 	size_t len = mnl_attr_get_payload_len(attr);
 	struct rtnexthop *rtnh = mnl_attr_get_payload(attr);
-	struct obj_nexthop *first, **last;
-
-	/* TODO validate the assumtion: multipath is always returned in sort order from the kernel */
+	struct obj_neigh **neighs = fr_malloc(sizeof(struct obj_neigh *) * (len / sizeof(struct rtnexthop) + 1));
+	struct obj_target *t = NULL;
+	unsigned int cnt = 0;
 
 	while (rtnh && RTNH_OK(rtnh, len)) {
-		struct nlattr *tb[RTAX_MAX+1] = {0};
+		struct nlattr *tb[RTA_MAX+1] = {0};
 		size_t attrs_len = rtnh->rtnh_len - sizeof(struct rtnexthop);
 		int ret = mnl_attr_parse_payload(RTNH_DATA(rtnh), attrs_len, attr_cb, tb);
 
 		if (ret != MNL_CB_OK)
-			return NULL;
-
-		int oif = rtnh->rtnh_ifindex;
-		void *nh = mnl_attr_get_payload(tb[RTA_GATEWAY]);
-		struct obj_neigh *n = obj_neigh_netlink_get(oif, af, nh);
+			goto out;
 
-		if (!n)
-			return NULL; /* unknown link */
+		if (tb[RTA_GATEWAY]) {
+			int oif = rtnh->rtnh_ifindex;
+			void *nh = mnl_attr_get_payload(tb[RTA_GATEWAY]);
+			struct obj_neigh *n = obj_neigh_netlink_get(oif, af, nh);
 
-		if (n) {
-			/* TODO don't just treat multipath as unipath */
-			return obj_target_get_unipath(n);
+			/* TODO respect rtnh_hops weights */
+			if (n)
+				neighs[cnt++] = n;
 		}
 
 		/* prepare next round */
@@ -176,15 +261,21 @@ static struct obj_target *decode_multipath(const struct nlattr *attr, const uint
 		rtnh = len >= sizeof(struct rtnexthop) ? RTNH_NEXT(rtnh) : NULL;
 	}
 
-	return NULL;
+	/* nexthops on unknown links are left out */
+	t = obj_target_get_multipath(neighs, cnt);
+out:
+	free(neighs);
+	return t;
 }
 
 static int decode_route(const struct nlmsghdr *nlh, struct conn *c)
 {
 	int (*attr_cb)(const struct nlattr *attr, void *data);
 	struct rtmsg *rm = mnl_nlmsg_get_payload(nlh);
-	struct nlattr *tb[RTAX_MAX+1] = {0};
+	struct nlattr *tb[RTA_MAX+1] = {0};
 	struct obj_target *t = NULL;
+	struct obj_route *r;
+	uint32_t fp;
 	int ret;
 
 	switch (rm->rtm_family) {
@@ -198,6 +289,12 @@ static int decode_route(const struct nlmsghdr *nlh, struct conn *c)
 		return MNL_CB_OK;
 	}
 
+	fp = decode_fingerprint(nlh, sizeof(*rm), sizeof(*rm), ROUTE_FP_ATTRS, link_epoch);
+	r = decode_route_lookup(nlh);
+	/* unless it's still waiting to be installed */
+	if (r && r->nl_fp == fp && r->target && (r->rule || !obj_target_is_ready(r->target)))
+		return MNL_CB_OK;
+
 	ret = mnl_attr_parse(nlh, sizeof(*rm), attr_cb, tb);
 	if (ret != MNL_CB_OK)
 		return ret;
@@ -209,7 +306,15 @@ static int decode_route(const struct nlmsghdr *nlh, struct conn *c)
 	if (!tb[RTA_DST])
 		return MNL_CB_OK;
 
-	if (tb[RTA_MULTIPATH]) {
+	if (tb[RTA_NH_ID]) {
+		/* nexthop object, the kernel also expands it into RTA_OIF/RTA_GATEWAY
+		 * or RTA_MULTIPATH, but those are only a snapshot of the nexthop */
+		uint32_t nh_id = mnl_attr_get_u32(tb[RTA_NH_ID]);
+
+		t = obj_target_nhid_lookup(nh_id);
+		if (!t)
+			fr_printf(DEBUG2, "route references unknown nexthop id %"PRIu32"\n", nh_id);
+	} else if (tb[RTA_MULTIPATH]) {
 		/* multipath */
 		t = decode_multipath(tb[RTA_MULTIPATH], rm->rtm_family, attr_cb);
 	} else if (tb[RTA_OIF] && tb[RTA_GATEWAY]) {
@@ -231,7 +336,10 @@ static int decode_route(const struct nlmsghdr *nlh, struct conn *c)
 		void *dst = mnl_attr_get_payload(tb[RTA_DST]);
 
 		build_af_addr(&af_dst, rm->rtm_family, dst, rm->rtm_dst_len);
-		obj_route_netlink_update(nlh->nlmsg_type, t, &af_dst);
+		coalesce_route_update(nlh->nlmsg_type, t, &af_dst);
+		r = obj_route_lookup(&af_dst);
+		if (r)
+			r->nl_fp = fp;
 	}
 
 	//fr_printf(DEBUG2, "%s: got route\n", nl_conn_get_name(c));
@@ -241,14 +349,67 @@ static int decode_route(const struct nlmsghdr *nlh, struct conn *c)
 	return MNL_CB_OK;
 }
 
+static int decode_nexthop(const struct nlmsghdr *nlh, struct conn *c)
+{
+	struct nlattr *tb[NHA_MAX+1] = {0};
+	struct nhmsg *nhm = mnl_nlmsg_get_payload(nlh);
+	uint32_t *grp_ids = NULL;
+	unsigned int grp_cnt = 0;
+	struct obj_neigh *n = NULL;
+	uint32_t nh_id;
+	int ret;
+
+	ret = mnl_attr_parse(nlh, sizeof(*nhm), decode_nlattr_nexthop_cb, tb);
+	if (ret != MNL_CB_OK)
+		return ret;
+
+	if (!tb[NHA_ID])
+		return MNL_CB_OK;
+	nh_id = mnl_attr_get_u32(tb[NHA_ID]);
+
+	if (nlh->nlmsg_type == RTM_DELNEXTHOP) {
+		obj_target_nhid_netlink_update(nlh->nlmsg_type, nh_id, NULL, NULL, 0);
+		return MNL_CB_OK;
+	}
+
+	if (tb[NHA_GROUP]) {
+		const struct nexthop_grp *grp = mnl_attr_get_payload(tb[NHA_GROUP]);
+
+		grp_cnt = mnl_attr_get_payload_len(tb[NHA_GROUP]) / sizeof(struct nexthop_grp);
+		grp_ids = fr_malloc(sizeof(uint32_t) * (grp_cnt + 1));
+		for (unsigned int i = 0; i < grp_cnt; i++)
+			grp_ids[i] = grp[i].id;
+	} else if (tb[NHA_OIF] && tb[NHA_GATEWAY] && !tb[NHA_BLACKHOLE]) {
+		int oif = mnl_attr_get_u32(tb[NHA_OIF]);
+		void *gw = mnl_attr_get_payload(tb[NHA_GATEWAY]);
+
+		n = obj_neigh_netlink_get(oif, nhm->nh_family, gw);
+	}
+
+	/* n is NULL for blackholes and nexthops on unknown links,
+	 * the target is still tracked, so routes using it are known */
+	obj_target_nhid_netlink_update(nlh->nlmsg_type, nh_id, n, grp_ids, grp_cnt);
+	free(grp_ids);
+
+	return MNL_CB_OK;
+}
+
 static int decode_neigh(const struct nlmsghdr *nlh, struct conn *c)
 {
 	struct nlattr *tb[NDA_MAX+1] = {0};
 	struct ndmsg *ndm = mnl_nlmsg_get_payload(nlh);
-	int ret = mnl_attr_parse(nlh, sizeof(*ndm), decode_nlattr_neigh_cb, tb);
 	const uint8_t (*lladdr)[ETH_ALEN];
 	void *addr = NULL;
+	struct obj_neigh *n;
+	uint32_t fp;
+	int ret;
 
+	fp = decode_fingerprint(nlh, sizeof(*ndm), sizeof(*ndm), NEIGH_FP_ATTRS, link_epoch);
+	n = decode_neigh_lookup(nlh);
+	if (n && n->nl_fp == fp)
+		return MNL_CB_OK;
+
+	ret = mnl_attr_parse(nlh, sizeof(*ndm), decode_nlattr_neigh_cb, tb);
 	if (ret != MNL_CB_OK)
 		return ret;
 
@@ -257,45 +418,63 @@ static int decode_neigh(const struct nlmsghdr *nlh, struct conn *c)
 	if (tb[NDA_DST])
 		addr = mnl_attr_get_payload(tb[NDA_DST]);
 
-	obj_neigh_netlink_update(nlh->nlmsg_type, ndm->ndm_ifindex, ndm->ndm_family, addr, lladdr);
+	coalesce_neigh_update(nlh->nlmsg_type, ndm->ndm_ifindex, ndm->ndm_family, addr, lladdr, ndm->ndm_state);
+	n = decode_neigh_lookup(nlh);
+	if (n)
+		n->nl_fp = fp;
 
 	return MNL_CB_OK;
 }
 
+/* rule changes, made while decoding, are traced from here */
 int decode_nlmsg_cb(const struct nlmsghdr *nlh, void *data)
 {
 	struct conn *c = data;
+	ev_tstamp prev = trace_event_begin(ev_time());
+	int ret = MNL_CB_OK;
 
 	switch (nlh->nlmsg_type) {
 	case RTM_NEWLINK:
 	case RTM_DELLINK:
-		return decode_link(nlh, c);
+		ret = decode_link(nlh, c);
+		break;
 
 	case RTM_NEWROUTE:
 	case RTM_DELROUTE:
-		return decode_route(nlh, c);
+		ret = decode_route(nlh, c);
+		break;
+
+	case RTM_NEWNEXTHOP:
+	case RTM_DELNEXTHOP:
+		ret = decode_nexthop(nlh, c);
+		break;
 
 	case RTM_NEWNEIGH:
 	case RTM_DELNEIGH:
 	case RTM_GETNEIGH:
-		return decode_neigh(nlh, c);
+		ret = decode_neigh(nlh, c);
+		break;
 
 	case RTM_NEWQDISC:
 	case RTM_DELQDISC:
-		return decode_qdisc(nlh, c);
+		ret = decode_qdisc(nlh, c);
+		break;
 
 	case RTM_NEWCHAIN:
 	case RTM_DELCHAIN:
-		return decode_chain(nlh, c);
+		ret = decode_chain(nlh, c);
+		break;
 
 	case RTM_NEWTFILTER:
 	case RTM_DELTFILTER:
-		return decode_filter(nlh, c);
+		ret = decode_filter(nlh, c);
+		break;
 
 	default:
 		fr_printf(DEBUG1, "no handler for nlmsg_type %d\n", nlh->nlmsg_type);
 		break;
 	}
+	trace_event_end(prev);
 
-	return MNL_CB_OK;
+	return ret;
 }
@@ -30,3 +30,50 @@ int decode_nlattr(const struct nlattr *attr,
 
 	return MNL_CB_OK;
 }
+
+static uint32_t fnv1a(uint32_t hash, const void *data, const size_t len)
+{
+	const uint8_t *p = data;
+
+	for (size_t i = 0; i < len; i++) {
+		hash ^= p[i];
+		hash *= 16777619;
+	}
+	return hash;
+}
+
+/*
+ * hashes the message type, the first hdr_len bytes of the family header,
+ * and the attributes in attr_mask, so that volatile attributes, like
+ * counters and cache info, can be left out, never returns 0
+ */
+uint32_t decode_fingerprint(const struct nlmsghdr *nlh, const size_t offset, const size_t hdr_len, const uint64_t attr_mask, const uint32_t seed)
+{
+	uint32_t hash = fnv1a(2166136261, &seed, sizeof(seed));
+	const struct nlattr *attr;
+
+	AN(hdr_len <= offset);
+	hash = fnv1a(hash, &nlh->nlmsg_type, sizeof(nlh->nlmsg_type));
+	hash = fnv1a(hash, mnl_nlmsg_get_payload(nlh), hdr_len);
+
+	mnl_attr_for_each(attr, nlh, offset) {
+		uint16_t type = mnl_attr_get_type(attr);
+
+		if (type >= 64 || !(attr_mask & DECODE_FP_ATTR(type)))
+			continue;
+		hash = fnv1a(hash, attr, mnl_attr_get_len(attr));
+	}
+	return hash != 0 ? hash : 1;
+}
+
+/* unvalidated, for looking up the object before deciding to decode */
+const struct nlattr *decode_find_attr(const struct nlmsghdr *nlh, const size_t offset, const uint16_t type)
+{
+	const struct nlattr *attr;
+
+	mnl_attr_for_each(attr, nlh, offset) {
+		if (mnl_attr_get_type(attr) == type)
+			return attr;
+	}
+	return NULL;
+}
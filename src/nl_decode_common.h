@@ -30,3 +30,9 @@ int decode_nlattr(const struct nlattr *attr,
 	const struct nlattr **tb,
 	uint16_t max,
 	const struct type_map *typemap);
+
+/* selects an attribute type for decode_fingerprint() */
+#define DECODE_FP_ATTR(attr) (UINT64_C(1) << (attr))
+
+uint32_t decode_fingerprint(const struct nlmsghdr *nlh, const size_t offset, const size_t hdr_len, const uint64_t attr_mask, const uint32_t seed);
+const struct nlattr *decode_find_attr(const struct nlmsghdr *nlh, const size_t offset, const uint16_t type);
@@ -4,6 +4,8 @@
 #include "nl_dump.h"
 #include "nl_send.h"
 
+#include <linux/nexthop.h>
+
 void nl_dump_link(EV_P_ struct conn *c)
 {
 	struct nlmsghdr *nlh;
@@ -36,6 +38,22 @@ void nl_dump_neigh(EV_P_ struct conn *c, uint8_t af)
 	nl_send_req(EV_A_ c, nlh);
 }
 
+void nl_dump_nexthop(EV_P_ struct conn *c)
+{
+	struct nlmsghdr *nlh;
+	char buf[MNL_SOCKET_DUMP_SIZE];
+	struct nhmsg *nhm;
+
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type = RTM_GETNEXTHOP;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+
+	nhm = mnl_nlmsg_put_extra_header(nlh, sizeof(struct nhmsg));
+	nhm->nh_family = AF_UNSPEC;
+
+	nl_send_req(EV_A_ c, nlh);
+}
+
 void nl_dump_route(EV_P_ struct conn *c, uint8_t af)
 {
 	struct nlmsghdr *nlh;
@@ -19,6 +19,45 @@
 
 struct rb_root chain_tree = RB_ROOT;
 
+/* conn with a terse filter dump in progress */
+static const struct conn *terse_conn;
+
+/*
+ * rules are installed per device, or once in the shared block,
+ * which then counts as the only device
+ */
+void filter_set_dev(struct tcmsg *tcm, const unsigned int dev)
+{
+	if (config->block_index) {
+		tcm->tcm_ifindex = TCM_IFINDEX_MAGIC_BLOCK;
+		tcm->tcm_block_index = config->block_index;
+	} else {
+		tcm->tcm_ifindex = config->ifidx[dev];
+		tcm->tcm_parent = TC_H_MAKE(TC_H_CLSACT, TC_H_MIN_INGRESS);
+	}
+}
+
+/* returns the device a filter or chain is on, or -1 if it isn't ours */
+int filter_get_dev(const struct tcmsg *tcm)
+{
+	if (config->block_index == 0)
+		return config_if_lookup(tcm->tcm_ifindex);
+	if ((uint32_t) tcm->tcm_ifindex == TCM_IFINDEX_MAGIC_BLOCK &&
+	    tcm->tcm_block_index == config->block_index)
+		return 0;
+	return -1;
+}
+
+unsigned int filter_dev_cnt(void)
+{
+	return config->block_index ? 1 : config->if_cnt;
+}
+
+const char *filter_dev_name(const unsigned int dev)
+{
+	return config->block_index ? "block" : config->ifname[dev];
+}
+
 void filter_dump(EV_P_ struct conn *c)
 {
 	struct nlmsghdr *nlh;
@@ -30,14 +69,37 @@ void filter_dump(EV_P_ struct conn *c)
 	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
 	tcm = mnl_nlmsg_put_extra_header(nlh, sizeof(struct tcmsg));
 	tcm->tcm_family = AF_UNSPEC;
-	tcm->tcm_ifindex = config->ifidx; /* this is ignored by kernel */
+	tcm->tcm_ifindex = config->ifidx[0]; /* this is ignored by kernel */
 	tcm->tcm_handle = 0;
 	tcm->tcm_parent = 0;
 
 	nl_send_req(EV_A_ c, nlh);
 }
 
-void filter_dump_chains(EV_P_ struct conn *c)
+/* create the clsact qdisc of dev, with its ingress bound to the shared block */
+void filter_bind_block(EV_P_ struct conn *c, const unsigned int dev)
+{
+	struct nlmsghdr *nlh;
+	char buf[MNL_SOCKET_DUMP_SIZE];
+	struct tcmsg *tcm;
+
+	AN(config->block_index);
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type = RTM_NEWQDISC;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL;
+	tcm = mnl_nlmsg_put_extra_header(nlh, sizeof(struct tcmsg));
+	tcm->tcm_family = AF_UNSPEC;
+	tcm->tcm_ifindex = config->ifidx[dev];
+	tcm->tcm_handle = TC_H_MAKE(TC_H_CLSACT, 0);
+	tcm->tcm_parent = TC_H_CLSACT;
+
+	mnl_attr_put_strz(nlh, TCA_KIND, "clsact");
+	mnl_attr_put_u32(nlh, TCA_INGRESS_BLOCK, config->block_index);
+
+	nl_send_req(EV_A_ c, nlh);
+}
+
+void filter_dump_chains(EV_P_ struct conn *c, const unsigned int dev)
 {
 	struct nlmsghdr *nlh;
 	char buf[MNL_SOCKET_DUMP_SIZE];
@@ -48,14 +110,13 @@ void filter_dump_chains(EV_P_ struct conn *c)
 	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
 	tcm = mnl_nlmsg_put_extra_header(nlh, sizeof(struct tcmsg));
 	tcm->tcm_family = AF_UNSPEC;
-	tcm->tcm_ifindex = config->ifidx;
 	tcm->tcm_handle = 0;
-	tcm->tcm_parent = TC_H_MAKE(TC_H_CLSACT, TC_H_MIN_INGRESS);
+	filter_set_dev(tcm, dev);
 
 	nl_send_req(EV_A_ c, nlh);
 }
 
-void filter_dump_chain(EV_P_ struct conn *c, uint32_t chain_no)
+void filter_dump_chain(EV_P_ struct conn *c, const unsigned int dev, uint32_t chain_no, const int terse)
 {
 	struct nlmsghdr *nlh;
 	char buf[MNL_SOCKET_DUMP_SIZE];
@@ -66,15 +127,41 @@ void filter_dump_chain(EV_P_ struct conn *c, uint32_t chain_no)
 	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
 	tcm = mnl_nlmsg_put_extra_header(nlh, sizeof(struct tcmsg));
 	tcm->tcm_family = AF_UNSPEC;
-	tcm->tcm_ifindex = config->ifidx;
 	tcm->tcm_handle = 0;
-	tcm->tcm_parent = TC_H_MAKE(TC_H_CLSACT, TC_H_MIN_INGRESS);
+	filter_set_dev(tcm, dev);
 
 	mnl_attr_put_u32(nlh, TCA_CHAIN, chain_no);
 
+	if (terse) {
+		/* only handle, flags and offload state, no keys or actions */
+		struct nla_bitfield32 dump_flags = {
+			.value = TCA_DUMP_FLAGS_TERSE,
+			.selector = TCA_DUMP_FLAGS_TERSE,
+		};
+
+		mnl_attr_put(nlh, TCA_DUMP_FLAGS, sizeof(dump_flags), &dump_flags);
+		terse_conn = c;
+	} else if (terse_conn == c) {
+		terse_conn = NULL;
+	}
+
 	nl_send_req(EV_A_ c, nlh);
 }
 
+int filter_dump_is_terse(const struct conn *c)
+{
+	return c != NULL && c == terse_conn;
+}
+
+/* for replaying captures, where the dump was requested in another life */
+void filter_dump_set_terse(const struct conn *c, const int terse)
+{
+	if (terse)
+		terse_conn = c;
+	else if (terse_conn == c)
+		terse_conn = NULL;
+}
+
 static int u32cmp(const uint32_t a, const uint32_t b)
 {
 	return ((int) a) - b;
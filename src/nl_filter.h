@@ -5,9 +5,17 @@
 #include "nl_common.h"
 #include "rbtree.h"
 
+void filter_set_dev(struct tcmsg *tcm, const unsigned int dev);
+int filter_get_dev(const struct tcmsg *tcm);
+unsigned int filter_dev_cnt(void);
+const char *filter_dev_name(const unsigned int dev);
+
 void filter_dump(EV_P_ struct conn *c);
-void filter_dump_chains(EV_P_ struct conn *c);
-void filter_dump_chain(EV_P_ struct conn *c, uint32_t chain_no);
+void filter_bind_block(EV_P_ struct conn *c, const unsigned int dev);
+void filter_dump_chains(EV_P_ struct conn *c, const unsigned int dev);
+void filter_dump_chain(EV_P_ struct conn *c, const unsigned int dev, uint32_t chain_no, const int terse);
+int filter_dump_is_terse(const struct conn *c);
+void filter_dump_set_terse(const struct conn *c, const int terse);
 
 void filter_got_qdisc(void);
 void filter_got_chain(uint32_t chain_no);
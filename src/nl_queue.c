@@ -1,11 +1,12 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 
 #include "nl_queue.h"
-
-/* TODO add timer to detect hung items, that never completes */
+#include "nl_conn.h"
+#include "rbtree.h"
 
 enum queue_item_state {
 	QUEUE_ITEM_STATE_NEW,
+	QUEUE_ITEM_STATE_CANCELLED,
 	QUEUE_ITEM_STATE_SENT,
 	QUEUE_ITEM_STATE_DONE,
 };
@@ -16,122 +17,455 @@ struct queue_item {
 	void *data;
 	struct queue_item *next;
 	enum queue_item_state state;
+	enum queue_kind kind;
+	int has_key;
+	uint64_t key;
+	struct rb_node key_node; /* in key_tree, while unsent */
 };
 
-struct queue {
+struct queue_list {
 	struct queue_item *head;
 	struct queue_item *tail;
+};
+
+/*
+ * Each lane has its own connection, and one request in flight,
+ * so a long dump in one lane doesn't hold up the other lanes.
+ */
+struct queue {
+	struct queue_list list[QUEUE_CLASS_CNT];
+	struct queue_item *sent;
+	ev_tstamp sent_at;
+	ev_timer watchdog; /* for the sent item, restarted on progress */
+	ev_tstamp deadline;
 	bool is_busy;
 	bool has_sent_request;
 	struct conn *conn;
+	struct rb_root key_tree;
+};
+
+static struct queue Q[QUEUE_LANE_CNT];
+static struct queue_stats queue_stats[QUEUE_KIND_CNT];
+
+/* a dump makes progress all along, so this is for silence, not duration */
+static const ev_tstamp queue_default_deadline[QUEUE_LANE_CNT] = {
+	[QUEUE_LANE_DUMP] = 30.,
+	[QUEUE_LANE_INSTALL] = 5.,
 };
 
-static struct queue Q = {NULL,};
+static const char * const queue_kind_names[QUEUE_KIND_CNT] = {
+	[QUEUE_KIND_OTHER] = "other",
+	[QUEUE_KIND_DUMP] = "dump",
+	[QUEUE_KIND_INSTALL] = "install",
+	[QUEUE_KIND_REPLACE] = "replace",
+	[QUEUE_KIND_UNINSTALL] = "uninstall",
+	[QUEUE_KIND_PROBE] = "probe",
+};
+
+static const char * const queue_lane_names[QUEUE_LANE_CNT] = {
+	[QUEUE_LANE_DUMP] = "dump",
+	[QUEUE_LANE_INSTALL] = "install",
+};
+
+static struct queue *queue_by_lane(const enum queue_lane lane)
+{
+	AN(lane < QUEUE_LANE_CNT);
+	return &Q[lane];
+}
 
-static struct queue_item *queue_pop(void)
+static struct queue *queue_by_conn(const struct conn *c)
 {
-	struct queue_item *qi = Q.head;
+	for (int i = 0; i < QUEUE_LANE_CNT; i++) {
+		if (Q[i].conn == c)
+			return &Q[i];
+	}
+	AN(false);
+	return NULL;
+}
+
+static struct queue_item *queue_key_lookup(struct queue *q, const uint64_t key)
+{
+	struct rb_node *node = q->key_tree.rb_node;
+	struct queue_item *this;
+
+	while (node) {
+		this = rb_container_of(node, struct queue_item, key_node);
+		if (key < this->key)
+			node = node->rb_left;
+		else if (key > this->key)
+			node = node->rb_right;
+		else
+			return this;
+	}
+	return NULL;
+}
+
+static int queue_key_insert(struct queue *q, struct queue_item *qi)
+{
+	struct rb_node **new = &(q->key_tree.rb_node), *parent = NULL;
+	struct queue_item *this;
+
+	AN(qi->has_key);
+
+	/* Figure out where to put new node */
+	while (*new) {
+		this = rb_container_of(*new, struct queue_item, key_node);
+
+		parent = *new;
+		if (qi->key < this->key)
+			new = &((*new)->rb_left);
+		else if (qi->key > this->key)
+			new = &((*new)->rb_right);
+		else
+			return 0;
+	}
+
+	/* Add new node and rebalance tree. */
+	rb_link_node(&qi->key_node, parent, new);
+	rb_insert_color(&qi->key_node, &q->key_tree);
+
+	return 1;
+}
+
+static void queue_key_erase(struct queue *q, struct queue_item *qi)
+{
+	if (!qi->has_key)
+		return;
+	rb_erase(&qi->key_node, &q->key_tree);
+	qi->has_key = false;
+}
+
+static struct queue_item *queue_list_pop(struct queue_list *l)
+{
+	struct queue_item *qi = l->head;
 
 	AN(qi);
-	Q.head = qi->next;
-	if (Q.tail == qi)
-		Q.tail = NULL;
+	l->head = qi->next;
+	if (l->tail == qi)
+		l->tail = NULL;
+	qi->next = NULL;
 	return qi;
 }
 
-static void queue_process(EV_P)
+/* cancelled items stay in their list, until they reach the head */
+static void queue_drop_cancelled(struct queue *q)
+{
+	for (int i = 0; i < QUEUE_CLASS_CNT; i++) {
+		struct queue_list *l = &q->list[i];
+
+		while (l->head != NULL && l->head->state == QUEUE_ITEM_STATE_CANCELLED)
+			free(queue_list_pop(l));
+	}
+}
+
+/* the first class with items in it wins */
+static struct queue_list *queue_next_list(struct queue *q)
+{
+	queue_drop_cancelled(q);
+	for (int i = 0; i < QUEUE_CLASS_CNT; i++) {
+		if (q->list[i].head != NULL)
+			return &q->list[i];
+	}
+	return NULL;
+}
+
+ev_tstamp queue_stats_percentile(const enum queue_kind kind, const double pct)
+{
+	return hist_percentile(&queue_get_stats(kind)->latency, pct);
+}
+
+const struct queue_stats *queue_get_stats(const enum queue_kind kind)
+{
+	AN(kind < QUEUE_KIND_CNT);
+	return &queue_stats[kind];
+}
+
+void queue_stats_print(void)
+{
+	for (int i = 0; i < QUEUE_KIND_CNT; i++) {
+		const struct queue_stats *st = &queue_stats[i];
+
+		if (st->latency.cnt == 0 && st->timeouts == 0)
+			continue;
+		fr_printf(DEBUG1, "latency %-9s n=%-8"PRIu64" p50=%.3fms p90=%.3fms p99=%.3fms max=%.3fms timeouts=%"PRIu64"\n",
+			  queue_kind_names[i], st->latency.cnt,
+			  queue_stats_percentile(i, 50.) * 1e3,
+			  queue_stats_percentile(i, 90.) * 1e3,
+			  queue_stats_percentile(i, 99.) * 1e3,
+			  st->latency.max * 1e3, st->timeouts);
+	}
+}
+
+const char *queue_kind_name(const enum queue_kind kind)
+{
+	AN(kind < QUEUE_KIND_CNT);
+	return queue_kind_names[kind];
+}
+
+const char *queue_lane_name(const enum queue_lane lane)
+{
+	AN(lane < QUEUE_LANE_CNT);
+	return queue_lane_names[lane];
+}
+
+/* unsent items, cancelled ones don't count */
+unsigned int queue_get_depth(const enum queue_lane lane)
+{
+	struct queue *q = queue_by_lane(lane);
+	unsigned int depth = 0;
+
+	for (int i = 0; i < QUEUE_CLASS_CNT; i++) {
+		for (struct queue_item *qi = q->list[i].head; qi != NULL; qi = qi->next) {
+			if (qi->state == QUEUE_ITEM_STATE_NEW)
+				depth++;
+		}
+	}
+	return depth;
+}
+
+unsigned int queue_get_in_flight(const enum queue_lane lane)
+{
+	return queue_by_lane(lane)->sent != NULL;
+}
+
+static void queue_process(EV_P_ struct queue *q, struct queue_list *l)
 {
 	struct queue_item *qi;
 
-	AN(!Q.is_busy);
-	qi = Q.head;
+	AN(!q->is_busy);
+	qi = queue_list_pop(l);
 	AN(qi->state == QUEUE_ITEM_STATE_NEW);
 	AN(qi->execute);
-	Q.is_busy = true;
-	Q.has_sent_request = false;
+	queue_key_erase(q, qi); /* too late to cancel it now */
+	q->sent = qi;
+	q->sent_at = ev_time();
+	q->is_busy = true;
+	q->has_sent_request = false;
 	qi->state = QUEUE_ITEM_STATE_SENT;
 	qi->execute(EV_A_ qi->data);
 }
 
-static void handle_queue_completed(EV_P_ struct conn *c, int nl_errno)
+static void handle_queue_completed(EV_P_ struct queue *q, int nl_errno)
 {
 	struct queue_item *qi;
 
-	AN(Q.conn == c);
-	AN(Q.is_busy);
-	qi = queue_pop();
+	AN(q->is_busy);
+	qi = q->sent;
+	AN(qi);
 	AN(qi->state == QUEUE_ITEM_STATE_SENT);
 	qi->state = QUEUE_ITEM_STATE_DONE;
-	Q.is_busy = false;
+	ev_timer_stop(EV_A_ &q->watchdog);
+	hist_record(&queue_stats[qi->kind].latency, ev_time() - q->sent_at);
+	q->sent = NULL;
+	q->is_busy = false;
 	if (qi->completed)
 		qi->completed(EV_A_ qi->data, nl_errno);
 	free(qi);
 }
 
-static void queue_process_loop(EV_P)
+static void queue_process_loop(EV_P_ struct queue *q)
 {
-	while (Q.head != NULL && !Q.is_busy) {
-		queue_process(EV_A);
-		if (Q.has_sent_request)
+	struct queue_list *l;
+
+	while (!q->is_busy && (l = queue_next_list(q)) != NULL) {
+		queue_process(EV_A_ q, l);
+		if (q->has_sent_request) {
+			q->watchdog.repeat = q->deadline;
+			ev_timer_again(EV_A_ &q->watchdog);
 			break;
-		handle_queue_completed(EV_A_ Q.conn, 0);
+		}
+		handle_queue_completed(EV_A_ q, 0);
 	}
 }
 
 static void queue_is_complete(EV_P_ struct conn *c, int nl_errno)
 {
-	handle_queue_completed(EV_A_ c, nl_errno);
-	if (Q.head != NULL && !Q.is_busy)
-		queue_process_loop(EV_A);
+	struct queue *q = queue_by_conn(c);
+
+	handle_queue_completed(EV_A_ q, nl_errno);
+	if (!q->is_busy)
+		queue_process_loop(EV_A_ q);
 }
 
 static void queue_has_sent_request(struct conn *c)
 {
-	AN(Q.conn == c);
-	Q.has_sent_request = true;
+	struct queue *q = queue_by_conn(c);
+
+	q->has_sent_request = true;
 }
 
-void queue_schedule(EV_P_ void (*execute)(EV_P_ void *data), void (*completed)(EV_P_ void *data, int nl_errno), void *data)
+static void queue_has_progress(EV_P_ struct conn *c)
+{
+	struct queue *q = queue_by_conn(c);
+
+	if (ev_is_active(&q->watchdog))
+		ev_timer_again(EV_A_ &q->watchdog);
+}
+
+/*
+ * A late answer on the old socket could be mistaken for the answer
+ * to the next request, so start over with a new one.
+ */
+static void queue_conn_reset(EV_P_ struct queue *q)
+{
+	struct conn *c = q->conn;
+	char *name = strdup(nl_conn_get_name(c));
+
+	AN(name);
+	nl_conn_close(EV_A_ c);
+	AN(nl_conn_open(0, c, name));
+	free(name);
+}
+
+static void queue_watchdog_cb(EV_P_ ev_timer *w, int revents)
+{
+	struct queue *q = rb_container_of(w, struct queue, watchdog);
+
+	fr_unused(revents);
+	ev_timer_stop(EV_A_ w);
+	AN(q->is_busy);
+	AN(q->sent);
+	fr_printf(ERROR, "%s: request has hung for %.1fs, resetting connection\n",
+		  nl_conn_get_name(q->conn), ev_time() - q->sent_at);
+	queue_stats[q->sent->kind].timeouts++;
+	queue_conn_reset(EV_A_ q);
+	handle_queue_completed(EV_A_ q, ETIMEDOUT);
+	if (!q->is_busy)
+		queue_process_loop(EV_A_ q);
+}
+
+/*
+ * mark it, and hand back the completion, which must be called after the
+ * queue is consistent again, as it may schedule new items
+ */
+static struct queue_item queue_item_cancel(struct queue *q, struct queue_item *qi)
+{
+	struct queue_item done = *qi;
+
+	AN(qi->state == QUEUE_ITEM_STATE_NEW);
+	queue_key_erase(q, qi);
+	qi->state = QUEUE_ITEM_STATE_CANCELLED;
+	qi->completed = NULL;
+	return done;
+}
+
+static void queue_item_cancelled(EV_P_ const struct queue_item *done)
+{
+	if (done->completed)
+		done->completed(EV_A_ done->data, ECANCELED);
+}
+
+int queue_cancel(EV_P_ const enum queue_lane lane, const uint64_t key)
+{
+	struct queue *q = queue_by_lane(lane);
+	struct queue_item *qi = queue_key_lookup(q, key);
+	struct queue_item done;
+
+	if (qi == NULL)
+		return false;
+	done = queue_item_cancel(q, qi);
+	queue_item_cancelled(EV_A_ &done);
+	return true;
+}
+
+static void queue_append(EV_P_ struct queue *q, const enum queue_class cls, struct queue_item *qi)
+{
+	struct queue_list *l;
+
+	AN(cls < QUEUE_CLASS_CNT);
+	l = &q->list[cls];
+	if (l->tail != NULL)
+		l->tail->next = qi;
+	else
+		l->head = qi;
+	l->tail = qi;
+	if (!q->is_busy)
+		queue_process_loop(EV_A_ q);
+}
+
+static struct queue_item *queue_item_alloc(const enum queue_kind kind, void (*execute)(EV_P_ void *data), void (*completed)(EV_P_ void *data, int nl_errno), void *data)
 {
 	struct queue_item *qi;
 
 	AN(execute);
+	AN(kind < QUEUE_KIND_CNT);
 	qi = fr_malloc(sizeof(struct queue_item));
+	qi->kind = kind;
 	qi->execute = execute;
 	qi->completed = completed;
 	qi->data = data;
+	return qi;
+}
 
-	if (Q.tail != NULL)
-		Q.tail->next = qi;
-	else
-		Q.head = qi;
-	Q.tail = qi;
-	if (!Q.is_busy)
-		queue_process_loop(EV_A);
+void queue_schedule(EV_P_ void (*execute)(EV_P_ void *data), void (*completed)(EV_P_ void *data, int nl_errno), void *data)
+{
+	queue_schedule_in(EV_A_ QUEUE_LANE_DUMP, QUEUE_CLASS_BULK, QUEUE_KIND_DUMP, execute, completed, data);
+}
+
+void queue_schedule_in(EV_P_ const enum queue_lane lane, const enum queue_class cls, const enum queue_kind kind, void (*execute)(EV_P_ void *data), void (*completed)(EV_P_ void *data, int nl_errno), void *data)
+{
+	queue_append(EV_A_ queue_by_lane(lane), cls, queue_item_alloc(kind, execute, completed, data));
 }
 
-struct conn *queue_get_conn(void)
+void queue_schedule_keyed(EV_P_ const enum queue_lane lane, const enum queue_class cls, const enum queue_kind kind, const uint64_t key, void (*execute)(EV_P_ void *data), void (*completed)(EV_P_ void *data, int nl_errno), void *data)
 {
-	AN(Q.conn);
-	return Q.conn;
+	struct queue *q = queue_by_lane(lane);
+	struct queue_item *qi = queue_item_alloc(kind, execute, completed, data);
+	struct queue_item *old = queue_key_lookup(q, key);
+	struct queue_item done = {NULL,};
+
+	/* supersede an unsent item with the same key, even in another class */
+	if (old)
+		done = queue_item_cancel(q, old);
+	qi->has_key = true;
+	qi->key = key;
+	AN(queue_key_insert(q, qi));
+	queue_append(EV_A_ q, cls, qi);
+	queue_item_cancelled(EV_A_ &done);
 }
 
-void queue_init(struct conn *c)
+struct conn *queue_get_conn(const enum queue_lane lane)
 {
-	AZ(Q.conn);
-	memset(&Q, '\0', sizeof(Q));
+	struct queue *q = queue_by_lane(lane);
+
+	AN(q->conn);
+	return q->conn;
+}
+
+void queue_init(const enum queue_lane lane, struct conn *c)
+{
+	struct queue *q = queue_by_lane(lane);
+
+	AZ(q->conn);
+	memset(q, '\0', sizeof(*q));
 	c->on_complete = queue_is_complete;
 	c->on_send_req = queue_has_sent_request;
-	Q.conn = c;
+	c->on_progress = queue_has_progress;
+	q->conn = c;
+	q->deadline = queue_default_deadline[lane];
+	ev_timer_init(&q->watchdog, queue_watchdog_cb, 0., 0.);
 }
 
-void queue_fini(void)
+void queue_fini(const enum queue_lane lane)
 {
-	AN(Q.conn);
-	memset(&Q, '\0', sizeof(Q));
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+	struct queue *q = queue_by_lane(lane);
+
+	AN(q->conn);
+	ev_timer_stop(EV_A_ &q->watchdog);
+	memset(q, '\0', sizeof(*q));
+}
+
+void queue_set_deadline(const enum queue_lane lane, const ev_tstamp deadline)
+{
+	struct queue *q = queue_by_lane(lane);
+
+	AN(deadline > 0.);
+	q->deadline = deadline;
 }
 
 void nl_queue_status(void)
 {
-	fr_printf(DEBUG2, "queue status: %s\n", Q.is_busy ? "is_busy" : "ok");
+	for (int i = 0; i < QUEUE_LANE_CNT; i++)
+		fr_printf(DEBUG2, "queue %d status: %s\n", i, Q[i].is_busy ? "is_busy" : "ok");
 }
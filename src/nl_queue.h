@@ -1,9 +1,66 @@
 /* SPDX-License-Identifier: GPL-2.0-or-later */
 
+#ifndef FLOWER_ROUTE_NL_QUEUE_H
+#define FLOWER_ROUTE_NL_QUEUE_H
+
 #include "nl_common.h"
+#include "hist.h"
+
+enum queue_lane {
+	QUEUE_LANE_DUMP,    /* scans, a dump may take seconds */
+	QUEUE_LANE_INSTALL, /* rule changes, latency critical */
+	QUEUE_LANE_CNT,
+};
+
+/* within a lane, items in a lower class are sent first */
+enum queue_class {
+	QUEUE_CLASS_URGENT, /* target and failover rules */
+	QUEUE_CLASS_BULK,   /* route rules */
+	QUEUE_CLASS_CNT,
+};
+
+/* what the item does, for the latency statistics */
+enum queue_kind {
+	QUEUE_KIND_OTHER,
+	QUEUE_KIND_DUMP,
+	QUEUE_KIND_INSTALL,
+	QUEUE_KIND_REPLACE,
+	QUEUE_KIND_UNINSTALL,
+	QUEUE_KIND_PROBE,
+	QUEUE_KIND_CNT,
+};
 
+struct queue_stats {
+	struct hist latency; /* from sending until completed */
+	uint64_t timeouts;
+};
+
+/*
+ * nl_errno is 0 or a positive errno, a request that gets no answer
+ * before the lane's deadline, is completed with ETIMEDOUT, and the
+ * connection is reset
+ */
+
+/* schedule in the bulk class of the dump lane */
 void queue_schedule(EV_P_ void (*execute)(EV_P_ void *data), void (*completed)(EV_P_ void *data, int nl_errno), void *data); /* XXX make nl_errno const */
-void queue_init(struct conn *c);
-void queue_fini(void);
-struct conn *queue_get_conn(void);
+void queue_schedule_in(EV_P_ const enum queue_lane lane, const enum queue_class cls, const enum queue_kind kind, void (*execute)(EV_P_ void *data), void (*completed)(EV_P_ void *data, int nl_errno), void *data);
+/*
+ * a keyed item supersedes an unsent item with the same key, cancelled
+ * items are not executed, and are completed with ECANCELED right away
+ */
+void queue_schedule_keyed(EV_P_ const enum queue_lane lane, const enum queue_class cls, const enum queue_kind kind, const uint64_t key, void (*execute)(EV_P_ void *data), void (*completed)(EV_P_ void *data, int nl_errno), void *data);
+int queue_cancel(EV_P_ const enum queue_lane lane, const uint64_t key);
+void queue_init(const enum queue_lane lane, struct conn *c);
+void queue_fini(const enum queue_lane lane);
+void queue_set_deadline(const enum queue_lane lane, const ev_tstamp deadline);
+const struct queue_stats *queue_get_stats(const enum queue_kind kind);
+ev_tstamp queue_stats_percentile(const enum queue_kind kind, const double pct);
+void queue_stats_print(void);
+const char *queue_kind_name(const enum queue_kind kind);
+const char *queue_lane_name(const enum queue_lane lane);
+unsigned int queue_get_depth(const enum queue_lane lane);
+unsigned int queue_get_in_flight(const enum queue_lane lane);
+struct conn *queue_get_conn(const enum queue_lane lane);
 void nl_queue_status(void);
+
+#endif
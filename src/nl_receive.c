@@ -16,6 +16,7 @@
 #include "nl_receive.h"
 #include "nl_decode.h"
 #include "nl_decode_common.h"
+#include "capture.h"
 
 /* error handling inspired by Linux's tools/net/ynl/lib/ynl.c */
 
@@ -27,27 +28,55 @@ static const struct type_map nlmsgerr_attr_types[NLMSGERR_ATTR_MAX+1] = {
 };
 decode_nlattr_cb(nlmsgerr, NLMSGERR_ATTR_MAX, true)
 
+static struct nl_error_stats nl_error_stats[NL_ERROR_STATS_MAX];
+
+static void nl_error_record(const unsigned int code, const char *msg)
+{
+	struct nl_error_stats *st;
+	unsigned int i;
+
+	if (msg == NULL)
+		msg = "";
+	for (i = 0; i < NL_ERROR_STATS_MAX - 1; i++) {
+		st = &nl_error_stats[i];
+		if (st->cnt == 0) {
+			st->code = code;
+			snprintf(st->msg, sizeof(st->msg), "%s", msg);
+			break;
+		}
+		if (st->code == code && strncmp(st->msg, msg, sizeof(st->msg) - 1) == 0)
+			break;
+	}
+	nl_error_stats[i].cnt++;
+}
+
+const struct nl_error_stats *nl_receive_get_error_stats(void)
+{
+	return nl_error_stats;
+}
+
 static int my_ext_ack_check(unsigned int code, const struct nlmsghdr *nlh, unsigned int hlen)
 {
 	struct nlattr *tb[NLMSGERR_ATTR_MAX+1] = {0};
-	int ret;
-
-	fr_printf(ERROR, "Netlink error: %d (%s)\n", code, strerror(code));
+	const char *msg = NULL;
+	int ret = MNL_CB_OK;
 
-	if (!(nlh->nlmsg_flags & NLM_F_ACK_TLVS))
-		return MNL_CB_OK;
+	fr_printf_ratelimited(ERROR, "Netlink error: %d (%s)\n", code, strerror(code));
 
-	ret = mnl_attr_parse(nlh, hlen, decode_nlattr_nlmsgerr_cb, tb);
-	if (ret != MNL_CB_OK)
-		return ret;
+	if (nlh->nlmsg_flags & NLM_F_ACK_TLVS)
+		ret = mnl_attr_parse(nlh, hlen, decode_nlattr_nlmsgerr_cb, tb);
 
-	if (tb[NLMSGERR_ATTR_MSG])
-		fr_printf(ERROR, "Netlink error message: %s\n", mnl_attr_get_str(tb[NLMSGERR_ATTR_MSG]));
+	if (tb[NLMSGERR_ATTR_MSG]) {
+		msg = mnl_attr_get_str(tb[NLMSGERR_ATTR_MSG]);
+		fr_printf_ratelimited(ERROR, "Netlink error message: %s\n", msg);
+	}
 
 	if (tb[NLMSGERR_ATTR_OFFS] || tb[NLMSGERR_ATTR_MISS_TYPE] || tb[NLMSGERR_ATTR_MISS_NEST])
 		fr_printf(DEBUG2, "Netlink error: got additional info\n");
 
-	return MNL_CB_OK;
+	nl_error_record(code, msg);
+
+	return ret;
 }
 
 static int my_mnl_cb_noop(const struct nlmsghdr *nlh, void *data)
@@ -98,6 +127,14 @@ static const mnl_cb_t my_mnl_cb_array[] = {
 	[NLMSG_OVERRUN] = my_mnl_cb_noop,
 };
 
+/* one datagram, through the decoders, also used for replaying captures */
+int nl_receive_datagram(struct conn *c, const void *buf, const size_t len)
+{
+	capture_datagram(c, buf, len);
+	c->rx_bytes += len;
+	return mnl_cb_run2(buf, len, c->seq, c->portid, decode_nlmsg_cb, c, my_mnl_cb_array, MNL_ARRAY_SIZE(my_mnl_cb_array));
+}
+
 void nl_receive_cb(EV_P_ struct ev_io *w, int revents)
 {
 	fr_unused(revents);
@@ -111,8 +148,10 @@ void nl_receive_cb(EV_P_ struct ev_io *w, int revents)
 
 	AN(c->on_complete);
 	len = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+	if (len > 0 && c->on_progress)
+		c->on_progress(EV_A_ c);
 	while (len > 0) {
-		ret = mnl_cb_run2(buf, len, c->seq, c->portid, decode_nlmsg_cb, c, my_mnl_cb_array, MNL_ARRAY_SIZE(my_mnl_cb_array));
+		ret = nl_receive_datagram(c, buf, len);
 		if (ret == MNL_CB_OK) {
 			fr_printf(DEBUG2, "mnl_cb_run: %d (MNL_CB_OK)\n", ret);
 		} else if (ret == MNL_CB_STOP) {
@@ -135,6 +174,11 @@ void nl_receive_cb(EV_P_ struct ev_io *w, int revents)
 
 	ev_io_stop(EV_A_ &c->w);
 
-	if (has_completed)
+	if (has_completed) {
+		if (retval == 0)
+			c->rx_acks++;
+		else
+			c->rx_errors++;
 		c->on_complete(EV_A_ c, retval);
+	}
 }
@@ -3,3 +3,16 @@
 #include "nl_common.h"
 
 void nl_receive_cb(EV_P_ struct ev_io *w, int revents);
+int nl_receive_datagram(struct conn *c, const void *buf, const size_t len);
+
+/* netlink errors by errno and extended ack message */
+#define NL_ERROR_STATS_MAX 16
+#define NL_ERROR_MSG_LEN 128
+
+struct nl_error_stats {
+	unsigned int code; /* 0 in the last slot, for those that didn't fit */
+	char msg[NL_ERROR_MSG_LEN];
+	uint64_t cnt;
+};
+
+const struct nl_error_stats *nl_receive_get_error_stats(void);
@@ -26,6 +26,7 @@ int nl_send_req(EV_P_ struct conn *c, struct nlmsghdr *nlh)
 		perror("mnl_socket_sendto");
 		return -1;
 	}
+	c->tx_requests++;
 
 	if (c->on_send_req)
 		c->on_send_req(c);
@@ -5,6 +5,7 @@
 
 #include "rbtree.h"
 #include "common.h"
+#include "trace.h"
 
 enum obj_operating_mode {
 	OBJ_MODE_NORMAL,
@@ -52,6 +53,7 @@ struct obj_link {
 	uint8_t lladdr[ETH_ALEN];
 	char *ifname;
 	struct rb_root fdb;
+	uint32_t nl_fp; /* fingerprint of the last netlink message */
 };
 
 struct obj_target;
@@ -62,24 +64,39 @@ struct obj_neigh {
 	struct rb_node node;
 	struct af_addr addr;
 	uint8_t lladdr[ETH_ALEN];
-	struct obj_target *targets; /* TODO */
+	uint16_t nud_state;
+	ev_tstamp probed_at;
+	uint32_t nl_fp; /* fingerprint of the last netlink message */
+	struct obj_nexthop *nexthops; /* nexthops via this neighbour, linked by n_next */
 };
 
+/* links a target to one of it's neighbours */
 struct obj_nexthop {
 	struct obj_neigh *neigh;
-	struct obj_nexthop *next;
+	struct obj_target *target;
+	struct obj_nexthop *next;   /* next nexthop of the target */
+	struct obj_nexthop *n_next; /* next nexthop of the neighbour */
 };
 
+/* max. number of hash buckets, and thereby ECMP members, per target */
+#define OBJ_TARGET_MAX_BUCKETS 8
+
 struct obj_rule;
 
 struct obj_target {
 	struct obj_core obj;
+	uint32_t nh_id; /* kernel nexthop object id, 0 = not a nexthop object */
+	struct rb_node nh_node; /* used in the nexthop object tree */
+	uint32_t *nh_grp; /* member ids, if nh_id is a nexthop group */
+	unsigned int nh_grp_cnt;
+	uint8_t is_multipath;
 	unsigned int nexthop_cnt;
-	struct obj_nexthop *nexthop;
+	struct obj_nexthop *nexthop; /* sorted by neighbour */
 	struct obj_route *first_route;
 	struct obj_route *last_route;
-	struct obj_target *n_next_target; /* used in obj_neigh->targets linked list */
-	struct obj_rule *rule;
+	struct obj_rule *rule; /* owns the target's chain, and is hash bucket 0 */
+	unsigned int bucket_cnt;
+	struct obj_rule *bucket_rule[OBJ_TARGET_MAX_BUCKETS]; /* buckets 1 and up, in rule's chain */
 };
 
 struct obj_route {
@@ -88,8 +105,10 @@ struct obj_route {
 	struct rb_node node;
 	struct obj_target *target;
 	struct obj_route *t_next_route;
+	struct obj_route *t_prev_route;
 	struct obj_rule *target_rule;
 	struct obj_rule *rule;
+	uint32_t nl_fp; /* fingerprint of the last netlink message */
 };
 
 enum obj_rule_state {
@@ -98,8 +117,18 @@ enum obj_rule_state {
 	OBJ_RULE_STATE_WANT,    /* have  = NUlL, want != NULL */
 	OBJ_RULE_STATE_QUEUED,  /* queued for installation */
 	OBJ_RULE_STATE_PENDING, /* pending installation */
+	OBJ_RULE_STATE_FAILED,  /* request failed, retried after a backoff */
 	OBJ_RULE_STATE_OK,      /* have != NULL, want == have */
 	OBJ_RULE_STATE_ZOMBIE,  /* have  = NULL, want  = NULL */
+	OBJ_RULE_STATE_CNT,
+};
+
+/* what a queued, but unsent, request will do */
+enum obj_rule_op {
+	OBJ_RULE_OP_NONE,
+	OBJ_RULE_OP_INSTALL,
+	OBJ_RULE_OP_REPLACE,
+	OBJ_RULE_OP_UNINSTALL,
 };
 
 enum obj_rule_type {
@@ -113,6 +142,15 @@ struct obj_rule {
 	struct obj_core obj;
 	enum obj_rule_type type;
 	enum obj_rule_state state;
+	enum obj_rule_op queued_op; /* only while OBJ_RULE_STATE_QUEUED */
+	enum obj_rule_op pending_op; /* last request sent */
+	int nl_errno; /* of the last failed request */
+	unsigned int failures; /* in a row */
+	ev_timer retry_timer;
+	uint32_t in_hw_count; /* as reported by the kernel */
+	unsigned int hw_retries; /* re-placements, while not in hardware */
+	unsigned int terse_gen; /* last terse dump that listed it */
+	uint8_t dev; /* index into config->ifidx */
 	uint32_t chain_no;
 	uint16_t prio;
 	uint8_t have_laf; /* TODO replace with OBJ_RULE_TYPE_FOUND */
@@ -123,6 +161,8 @@ struct obj_rule {
 	struct obj_route *route;
 	struct tc_rule *have;
 	struct tc_rule *want;
+	struct obj_rule *mirror; /* copies on the other devices, linked from the one on the first */
+	struct trace trace; /* of the change in progress */
 };
 
 /* when neigh's lladdr changes it needs to notify all it's targets
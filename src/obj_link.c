@@ -192,7 +192,7 @@ void obj_link_netlink_update(const uint16_t nlmsg_type, const int ifindex, const
 	else if (changes > 0)
 		obj_link_update(l);
 	else
-		fr_printf(ERROR, "link: no changes\n");
+		fr_printf(DEBUG2, "link: no changes\n");
 }
 
 void obj_link_print(struct obj_link *l)
@@ -3,6 +3,10 @@
 #include "obj_neigh.h"
 #include "obj_link.h"
 #include "obj_target.h"
+#include "neigh_action.h"
+
+/* min. seconds between asking the kernel to resolve the same neighbour */
+#define OBJ_NEIGH_PROBE_INTERVAL 5.
 
 static int obj_neigh_cnt;
 
@@ -27,12 +31,11 @@ static void obj_neigh_reap(struct obj_neigh *n)
 	obj_assert_kind(n, NEIGH);
 	AN(n->obj.refcnt == 0);
 	n->obj.state = OBJ_STATE_ZOMBIE;
-	for (struct obj_target *t = n->targets, *nt; t; t = nt) {
-		nt = t->n_next_target;
-		t->n_next_target = NULL;
-		obj_target_unref(t);
-		// TODO remove neigh reference from target completely
+	for (struct obj_nexthop *nh = n->nexthops, *next; nh; nh = next) {
+		next = nh->n_next;
+		obj_target_neigh_gone(nh);
 	}
+	AZ(n->nexthops);
 
 	l = n->link;
 	if (l)
@@ -131,6 +134,8 @@ void obj_neigh_print(const struct obj_neigh *n)
 	struct obj_link *l = n->link;
 	char out[INET6_ADDRSTRLEN];
 
+	if (!DBG_LEVEL(INFO))
+		return;
 	fr_printf(INFO, "neigh: %d %s (vlan id: %d)", l->ifindex, l->ifname, l->vlan_id);
 	if (n->addr.af > 0) {
 		if (inet_ntop(n->addr.af, &n->addr.in, out, sizeof(out)))
@@ -139,13 +144,39 @@ void obj_neigh_print(const struct obj_neigh *n)
 	fr_printf(INFO, ", lladdr: %02x:%02x:%02x:%02x:%02x:%02x",
 			n->lladdr[0], n->lladdr[1], n->lladdr[2],
 			n->lladdr[3], n->lladdr[4], n->lladdr[5]);
-	fr_printf(INFO, "\n");
+	fr_printf(INFO, ", nud: %04x\n", n->nud_state);
+}
+
+/* the kernel only reports an lladdr in these states, see NUD_VALID */
+#define OBJ_NEIGH_NUD_VALID (NUD_PERMANENT | NUD_NOARP | NUD_REACHABLE | NUD_PROBE | NUD_STALE | NUD_DELAY)
+
+int obj_neigh_is_reachable(const struct obj_neigh *n)
+{
+	obj_assert_kind(n, NEIGH);
+	return (n->nud_state & OBJ_NEIGH_NUD_VALID) != 0;
+}
+
+/* have the kernel resolve a neighbour, instead of waiting for trapped traffic */
+void obj_neigh_probe(struct obj_neigh *n)
+{
+	ev_tstamp now = ev_now(EV_DEFAULT);
+
+	obj_assert_kind(n, NEIGH);
+	if (n->link == NULL)
+		return;
+	if (n->nud_state & NUD_INCOMPLETE)
+		return; /* already resolving */
+	if (n->probed_at > 0. && now - n->probed_at < OBJ_NEIGH_PROBE_INTERVAL)
+		return;
+	n->probed_at = now;
+	fr_printf(DEBUG1, "probing neigh\n");
+	neigh_action_probe(n->link->ifindex, &n->addr);
 }
 
 static void obj_neigh_notify_targets(struct obj_neigh *n)
 {
-	for (struct obj_target *t = n->targets; t; t = t->n_next_target)
-		obj_target_neigh_update(t);
+	for (struct obj_nexthop *nh = n->nexthops; nh; nh = nh->n_next)
+		obj_target_neigh_update(nh->target);
 }
 
 void obj_neigh_link_update(struct obj_neigh *n)
@@ -195,7 +226,7 @@ static struct obj_neigh *obj_neigh_alloc(void)
 	return n;
 }
 
-void obj_neigh_netlink_update(const uint16_t nlmsg_type, const int ifindex, const uint8_t af, const union some_in_addr *addr, const uint8_t (*lladdr)[ETH_ALEN])
+void obj_neigh_netlink_update(const uint16_t nlmsg_type, const int ifindex, const uint8_t af, const union some_in_addr *addr, const uint8_t (*lladdr)[ETH_ALEN], const uint16_t nud_state)
 {
 	struct af_addr af_addr;
 	struct obj_neigh *n;
@@ -223,7 +254,14 @@ void obj_neigh_netlink_update(const uint16_t nlmsg_type, const int ifindex, cons
 		n->link = obj_link_weak_ref(l);
 	}
 
+	int was_reachable = obj_neigh_is_reachable(n);
+
 	changes += lladdr_set(&n->lladdr, lladdr);
+	n->nud_state = nud_state;
+	if (obj_neigh_is_reachable(n) != was_reachable)
+		changes++;
+	if (n->obj.state == OBJ_STATE_PRESENT)
+		changes++; /* first seen in the kernel */
 
 	if (is_new)
 		obj_neigh_new(n);
@@ -249,7 +287,9 @@ struct obj_neigh *obj_neigh_netlink_get(const int ifindex, uint8_t af, const uni
 	if (is_new) {
 		n = obj_neigh_alloc();
 		memcpy(&n->addr, &af_addr, sizeof(struct af_addr));
-		n->link = obj_link_ref(l);
+		n->link = obj_link_weak_ref(l);
+		/* unresolved until the kernel tells otherwise */
+		obj_neigh_fdb_insert(n);
 	}
 
 	return n;
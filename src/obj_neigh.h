@@ -2,10 +2,12 @@
 
 #include "obj.h"
 
-void obj_neigh_netlink_update(const uint16_t nlmsg_type, const int ifindex, const uint8_t af, const union some_in_addr *addr, const uint8_t (*lladdr)[ETH_ALEN]);
+void obj_neigh_netlink_update(const uint16_t nlmsg_type, const int ifindex, const uint8_t af, const union some_in_addr *addr, const uint8_t (*lladdr)[ETH_ALEN], const uint16_t nud_state);
 struct obj_neigh *obj_neigh_netlink_get(const int ifindex, uint8_t af, const union some_in_addr *addr);
 void obj_neigh_link_update(struct obj_neigh *n);
 void obj_neigh_print(const struct obj_neigh *n);
+int obj_neigh_is_reachable(const struct obj_neigh *n);
+void obj_neigh_probe(struct obj_neigh *n);
 
 struct obj_neigh *obj_neigh_ref(struct obj_neigh *n);
 void obj_neigh_unref(struct obj_neigh *n);
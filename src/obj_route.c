@@ -38,7 +38,7 @@ static void obj_route_reap(struct obj_route *r)
 obj_generic_ref(route, ROUTE)
 obj_generic_unref(route, ROUTE)
 
-static struct obj_route *obj_route_lookup(const struct af_addr *dst)
+struct obj_route *obj_route_lookup(const struct af_addr *dst)
 {
 	struct rb_node *node = obj_route_tree.rb_node;
 	struct obj_route *this;
@@ -139,7 +139,8 @@ void obj_route_netlink_update(const uint16_t nlmsg_type, struct obj_target *t, c
 		changes++;
 	}
 
-	if (t->rule && t->rule->state == OBJ_RULE_STATE_OK && !r->rule)
+	/* a route moved to another target, must follow it to the new chain */
+	if (obj_target_is_ready(t) && (!r->rule || changes > 0))
 		obj_route_install(r);
 
 	if (is_new)
@@ -152,7 +153,7 @@ static int obj_route_prepare_rule(struct obj_route *r, struct obj_rule *target_r
 {
 	AN(r);
 	AN(target_rule);
-	AN(target_rule->state == OBJ_RULE_STATE_OK);
+	AN(obj_rule_is_ok(target_rule));
 	tc_rule_init(tcr);
 	memcpy(&tcr->af_addr, &r->dst, sizeof(struct af_addr));
 	tcr->goto_target = target_rule->chain_no;
@@ -187,7 +188,12 @@ void obj_route_install(struct obj_route *r)
 				obj_rule_unref(old_rule);
 			}
 		} else {
-			r->target_rule = obj_rule_ref(target_rule);
+			/* still holding the target rule, if placement failed before */
+			if (r->target_rule != target_rule) {
+				if (r->target_rule)
+					obj_rule_unref(r->target_rule);
+				r->target_rule = obj_rule_ref(target_rule);
+			}
 			r->rule = obj_rule_request(&new_tcr);
 		}
 	} else {
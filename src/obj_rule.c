@@ -6,19 +6,65 @@
 #include "nl_queue.h"
 #include "hexdump.h"
 #include "tc_action.h"
+#include "tc_dry_run.h"
 
 static struct rb_root obj_rule_pos_tree = RB_ROOT; /* positional */
 static struct rb_root obj_rule_laf_tree = RB_ROOT; /* lost and found */
+static struct rb_root obj_rule_neg_tree = RB_ROOT; /* negative cache */
 static int obj_rule_pin_changes; /* TODO change to enum */
 static int obj_rule_cnt;
+static unsigned int obj_rule_terse_gen = 1; /* current terse dump */
+static int obj_rule_terse_suspect; /* the current terse dump didn't match */
+
+#define OBJ_RULE_RETRY_MIN 1.   /* seconds, after the first failure */
+#define OBJ_RULE_RETRY_MAX 64.  /* seconds, cap for the backoff */
+#define OBJ_RULE_NEG_TTL   300. /* seconds, to remember unoffloadable rules */
+#define OBJ_RULE_HW_RETRIES 3   /* re-placements, before leaving it in software */
+#define OBJ_RULE_PRIO_HINTS 8   /* chains, that keep a hint for placing rules */
+
+/* a flush in progress */
+struct obj_rule_flush {
+	unsigned int pending; /* chains */
+	void (*done)(void *data);
+	void *data;
+};
+
+struct obj_rule_flush_chain {
+	unsigned int dev;
+	uint32_t chain_no;
+};
+
+/* the prios in [min_prio, next) are all taken, on the first device */
+struct obj_rule_prio_hint {
+	uint16_t min_prio;
+	uint32_t next; /* UINT16_MAX + 1, when the chain is full */
+};
+
+static struct obj_rule_prio_hint obj_rule_prio_hints[OBJ_RULE_PRIO_HINTS];
+
+/* rules that the kernel, or hardware, will keep refusing */
+struct obj_rule_neg {
+	struct rb_node node;
+	struct tc_rule tcr;
+	int nl_errno;
+	ev_tstamp until;
+};
 
 /*
  * the positional tree is used for stuff once we want it to be there
  * the lost and found tree is used to briefly keep track of objects
  * found in the kernel, until requested (or removed), and is used
  * for maintaining stability across process restarts
+ *
+ * both trees are per device, rules are placed on the first device,
+ * which then owns a mirror rule, at the same position, on each of
+ * the other devices, so the rest of the graph is shared by all
  */
 
+/* only rules on the first device have mirrors */
+#define obj_rule_for_each_mirror(r, m) \
+	for (struct obj_rule *m = (r)->dev == 0 ? (r)->mirror : NULL; m; m = m->mirror)
+
 int obj_rule_count(void)
 {
 	return obj_rule_cnt;
@@ -31,6 +77,32 @@ void obj_rule_unset_target(struct obj_rule *r)
 		obj_target_weak_unref(r->target);
 		r->target = NULL;
 	}
+	obj_rule_for_each_mirror(r, m)
+		obj_rule_unset_target(m);
+}
+
+/* the mirrors are left to be uninstalled on their own */
+static void obj_rule_drop_mirrors(struct obj_rule *r)
+{
+	struct obj_rule *m = r->mirror, *next;
+
+	r->mirror = NULL;
+	for (; m; m = next) {
+		next = m->mirror;
+		m->mirror = NULL;
+		obj_rule_unref(m);
+	}
+}
+
+static void obj_rule_prio_hint_lower(const struct obj_rule *r)
+{
+	struct obj_rule_prio_hint *hint;
+
+	if (r->dev != 0 || r->chain_no >= OBJ_RULE_PRIO_HINTS)
+		return;
+	hint = &obj_rule_prio_hints[r->chain_no];
+	if (r->prio >= hint->min_prio && r->prio < hint->next)
+		hint->next = r->prio;
 }
 
 static void obj_rule_reap(struct obj_rule *r)
@@ -38,6 +110,7 @@ static void obj_rule_reap(struct obj_rule *r)
 	AN(r->obj.refcnt == 0);
 	r->obj.state = OBJ_STATE_ZOMBIE;
 	obj_rule_unset_target(r);
+	obj_rule_drop_mirrors(r);
 	if (r->want) {
 		free(r->want);
 		r->want = NULL;
@@ -53,6 +126,7 @@ static void obj_rule_reap(struct obj_rule *r)
 	if (r->have_pos) {
 		rb_erase(&r->pos_node, &obj_rule_pos_tree);
 		r->have_pos = false;
+		obj_rule_prio_hint_lower(r);
 	}
 	obj_free(r);
 	AN(obj_rule_cnt--);
@@ -61,14 +135,41 @@ static void obj_rule_reap(struct obj_rule *r)
 /* define helpers, after obj_rule_reap */
 obj_generic_ref(rule, RULE)
 
+static void obj_rule_retry_stop(struct obj_rule *r)
+{
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+
+	if (!ev_is_active(&r->retry_timer))
+		return;
+	ev_timer_stop(EV_A_ &r->retry_timer);
+	obj_unref(&r->obj); /* the timer's reference */
+}
+
 void obj_rule_unref(struct obj_rule *r)
 {
 	obj_assert_kind(r, RULE);
 	obj_unref(&r->obj);
+	if (r->obj.refcnt == 1 && ev_is_active(&r->retry_timer)) {
+		/* only the retry is left, so give up on it */
+		obj_rule_retry_stop(r);
+	}
+	if (r->obj.refcnt == 1 && r->want && r->state == OBJ_RULE_STATE_QUEUED &&
+	    obj_get_operating_mode() == OBJ_MODE_NORMAL &&
+		 r->type != OBJ_RULE_TYPE_STATIC) {
+		/* only the unsent request is left, so call it off */
+		obj_rule_ref(r);
+		obj_rule_uninstall(r);
+		obj_rule_unref(r);
+		return;
+	}
 	if (r->obj.refcnt == 0 && r->want && r->have &&
 	    obj_get_operating_mode() == OBJ_MODE_NORMAL &&
 		 r->type != OBJ_RULE_TYPE_STATIC) {
+		/* the uninstall may complete synchronously, and reap the rule */
+		obj_rule_ref(r);
 		obj_rule_uninstall(r);
+		obj_rule_unref(r);
+		return;
 	}
 	if (obj_is_reapable(&r->obj))
 		obj_rule_reap(r);
@@ -80,6 +181,8 @@ void obj_rule_set_target(struct obj_rule *r, struct obj_target *t)
 	obj_assert_kind(t, TARGET);
 	AZ(r->target);
 	r->target = obj_target_weak_ref(t);
+	obj_rule_for_each_mirror(r, m)
+		obj_rule_set_target(m, t);
 }
 
 static int u16cmp(const uint16_t a, const uint16_t b)
@@ -92,13 +195,22 @@ static int u32cmp(const uint32_t a, const uint32_t b)
 	return ((int) a) - b;
 }
 
-static struct obj_rule *obj_rule_laf_lookup(const struct tc_rule *tcr)
+static int obj_rule_laf_cmp(const unsigned int dev, const struct tc_rule *tcr, const struct obj_rule *this)
+{
+	int ret = memcmp(tcr, this->have, sizeof(struct tc_rule));
+
+	if (ret == 0)
+		ret = ((int) dev) - this->dev;
+	return ret;
+}
+
+static struct obj_rule *obj_rule_laf_lookup(const unsigned int dev, const struct tc_rule *tcr)
 {
 	struct rb_node *node = obj_rule_laf_tree.rb_node;
 
 	while (node) {
 		struct obj_rule *this = rb_container_of(node, struct obj_rule, laf_node);
-		int ret = memcmp(tcr, this->have, sizeof(struct tc_rule));
+		int ret = obj_rule_laf_cmp(dev, tcr, this);
 
 		if (ret < 0)
 			node = node->rb_left;
@@ -119,7 +231,7 @@ static int obj_rule_laf_insert(struct obj_rule *r)
 	/* Figure out where to put new node */
 	while (*new) {
 		struct obj_rule *this = rb_container_of(*new, struct obj_rule, laf_node);
-		int ret = memcmp(r->have, this->have, sizeof(struct tc_rule));
+		int ret = obj_rule_laf_cmp(r->dev, r->have, this);
 
 		parent = *new;
 		if (ret < 0)
@@ -139,16 +251,25 @@ static int obj_rule_laf_insert(struct obj_rule *r)
 	return 1;
 }
 
-struct obj_rule *obj_rule_pos_lookup(const uint32_t chain_no, const uint16_t prio)
+static int obj_rule_pos_cmp(const unsigned int dev, const uint32_t chain_no, const uint16_t prio, const struct obj_rule *this)
+{
+	int ret = ((int) dev) - this->dev;
+
+	if (ret == 0)
+		ret = u32cmp(chain_no, this->chain_no);
+	if (ret == 0)
+		ret = u16cmp(prio, this->prio);
+	return ret;
+}
+
+struct obj_rule *obj_rule_pos_lookup(const unsigned int dev, const uint32_t chain_no, const uint16_t prio)
 {
 	struct rb_node *node = obj_rule_pos_tree.rb_node;
 
 	while (node) {
 		struct obj_rule *this = rb_container_of(node, struct obj_rule, pos_node);
-		int ret = u32cmp(chain_no, this->chain_no);
+		int ret = obj_rule_pos_cmp(dev, chain_no, prio, this);
 
-		if (ret == 0)
-			ret = u16cmp(prio, this->prio);
 		if (ret < 0)
 			node = node->rb_left;
 		else if (ret > 0)
@@ -159,6 +280,25 @@ struct obj_rule *obj_rule_pos_lookup(const uint32_t chain_no, const uint16_t pri
 	return NULL;
 }
 
+/* lowest positioned rule, at or after (dev, chain_no, prio) */
+static struct rb_node *obj_rule_pos_lower_bound(const unsigned int dev, const uint32_t chain_no, const uint16_t prio)
+{
+	struct rb_node *node = obj_rule_pos_tree.rb_node;
+	struct rb_node *ret = NULL;
+
+	while (node) {
+		struct obj_rule *this = rb_container_of(node, struct obj_rule, pos_node);
+
+		if (obj_rule_pos_cmp(dev, chain_no, prio, this) <= 0) {
+			ret = node;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
+		}
+	}
+	return ret;
+}
+
 static int obj_rule_pos_insert(struct obj_rule *r)
 {
 	AN(r->have_pos == false);
@@ -168,10 +308,7 @@ static int obj_rule_pos_insert(struct obj_rule *r)
 	/* Figure out where to put new node */
 	while (*new) {
 		struct obj_rule *this = rb_container_of(*new, struct obj_rule, pos_node);
-		int ret = u32cmp(r->chain_no, this->chain_no);
-
-		if (ret == 0)
-			ret = u16cmp(r->prio, this->prio);
+		int ret = obj_rule_pos_cmp(r->dev, r->chain_no, r->prio, this);
 
 		parent = *new;
 		if (ret < 0)
@@ -197,12 +334,251 @@ static void obj_rule_pre_install(void *data)
 
 	AN(r->state == OBJ_RULE_STATE_QUEUED);
 	r->state = OBJ_RULE_STATE_PENDING;
+	r->pending_op = r->queued_op;
+	r->queued_op = OBJ_RULE_OP_NONE;
+	trace_stage(&r->trace, TRACE_STAGE_SENT);
 }
 
-static void obj_rule_post_install(void *data)
+static void obj_rule_cancelled(void *data)
 {
 	struct obj_rule *r = data;
 
+	fr_printf(DEBUG1, "cancelled queued rule change (%d,%d)\n", r->chain_no, r->prio);
+	obj_rule_unref(r);
+}
+
+/* forwarding depends on the target rules, so they go before the routes */
+static enum queue_class obj_rule_class(const struct obj_rule *r)
+{
+	if (r->target || r->type == OBJ_RULE_TYPE_STATIC)
+		return QUEUE_CLASS_URGENT;
+	return QUEUE_CLASS_BULK;
+}
+
+static int obj_rule_neg_cmp(const struct tc_rule *a, const struct tc_rule *b)
+{
+	return memcmp(a, b, sizeof(struct tc_rule));
+}
+
+static struct obj_rule_neg *obj_rule_neg_lookup(const struct tc_rule *tcr)
+{
+	struct rb_node *node = obj_rule_neg_tree.rb_node;
+
+	while (node) {
+		struct obj_rule_neg *this = rb_container_of(node, struct obj_rule_neg, node);
+		int ret = obj_rule_neg_cmp(tcr, &this->tcr);
+
+		if (ret < 0)
+			node = node->rb_left;
+		else if (ret > 0)
+			node = node->rb_right;
+		else
+			return this;
+	}
+	return NULL;
+}
+
+static void obj_rule_neg_insert(const struct tc_rule *tcr, const int nl_errno, const ev_tstamp until)
+{
+	struct rb_node **new = &(obj_rule_neg_tree.rb_node), *parent = NULL;
+	struct obj_rule_neg *neg;
+
+	/* Figure out where to put new node */
+	while (*new) {
+		struct obj_rule_neg *this = rb_container_of(*new, struct obj_rule_neg, node);
+		int ret = obj_rule_neg_cmp(tcr, &this->tcr);
+
+		parent = *new;
+		if (ret < 0) {
+			new = &((*new)->rb_left);
+		} else if (ret > 0) {
+			new = &((*new)->rb_right);
+		} else {
+			this->nl_errno = nl_errno;
+			this->until = until;
+			return;
+		}
+	}
+
+	neg = fr_malloc(sizeof(struct obj_rule_neg));
+	memcpy(&neg->tcr, tcr, sizeof(struct tc_rule));
+	neg->nl_errno = nl_errno;
+	neg->until = until;
+
+	/* Add new node and rebalance tree. */
+	rb_link_node(&neg->node, parent, new);
+	rb_insert_color(&neg->node, &obj_rule_neg_tree);
+}
+
+static void obj_rule_neg_clear(void)
+{
+	for (struct rb_node *n = rb_first(&obj_rule_neg_tree), *nn; n; n = nn) {
+		nn = rb_next(n);
+		rb_erase(n, &obj_rule_neg_tree);
+		free(rb_container_of(n, struct obj_rule_neg, node));
+	}
+}
+
+/* errors, that retrying the same rule won't fix */
+static int obj_rule_is_unoffloadable(const int nl_errno)
+{
+	return nl_errno == EOPNOTSUPP || nl_errno == EINVAL;
+}
+
+static void obj_rule_update_state(struct obj_rule *r);
+static void obj_rule_queue_replace(struct obj_rule *r);
+
+/* with skip_hw, software is where it is meant to be */
+static int obj_rule_wants_hw(void)
+{
+	return !(config->flower_flags & TCA_CLS_FLAGS_SKIP_HW);
+}
+
+static int obj_rule_is_in_hw(const struct obj_rule *r)
+{
+	return !obj_rule_wants_hw() || r->in_hw_count > 0;
+}
+
+static void obj_rule_retry_cb(EV_P_ ev_timer *w, int revents)
+{
+	struct obj_rule *r = rb_container_of(w, struct obj_rule, retry_timer);
+
+	fr_unused(revents);
+	ev_timer_stop(EV_A_ w);
+	fr_printf_ratelimited(INFO, "retrying rule (%d,%d)\n", r->chain_no, r->prio);
+	if (r->state == OBJ_RULE_STATE_OK && !obj_rule_is_in_hw(r)) {
+		/* a replace gives the driver another go at it */
+		r->state = OBJ_RULE_STATE_WANT;
+		obj_rule_queue_replace(r);
+	} else {
+		obj_rule_update_state(r);
+	}
+	obj_rule_unref(r); /* the timer's reference */
+}
+
+static void obj_rule_retry_start(struct obj_rule *r, const ev_tstamp delay)
+{
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+
+	AZ(ev_is_active(&r->retry_timer));
+	ev_timer_init(&r->retry_timer, obj_rule_retry_cb, delay, 0.);
+	ev_timer_start(EV_A_ &r->retry_timer);
+	obj_rule_ref(r);
+}
+
+/* exponential backoff, with jitter so failed rules don't retry in lockstep */
+static ev_tstamp obj_rule_backoff(const unsigned int failures)
+{
+	ev_tstamp delay = OBJ_RULE_RETRY_MIN;
+
+	for (unsigned int i = 1; i < failures && delay < OBJ_RULE_RETRY_MAX; i++)
+		delay *= 2.;
+	if (delay > OBJ_RULE_RETRY_MAX)
+		delay = OBJ_RULE_RETRY_MAX;
+	return delay * (.75 + .5 * rand() / RAND_MAX);
+}
+
+static void obj_rule_fail(struct obj_rule *r, const int nl_errno, ev_tstamp delay)
+{
+	r->state = OBJ_RULE_STATE_FAILED;
+	r->nl_errno = nl_errno;
+	r->failures++;
+	if (delay == 0.)
+		delay = obj_rule_backoff(r->failures);
+	fr_printf_ratelimited(INFO, "rule (%d,%d) failed: %s, retry in %.1fs\n",
+			      r->chain_no, r->prio, strerror(nl_errno), delay);
+	obj_rule_retry_start(r, delay);
+}
+
+/* don't send what is known to fail, wait for the cache entry to expire */
+static int obj_rule_neg_check(struct obj_rule *r)
+{
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+	struct obj_rule_neg *neg;
+	ev_tstamp now = ev_now(EV_A);
+
+	if (r->want == NULL)
+		return false;
+	neg = obj_rule_neg_lookup(r->want);
+	if (neg == NULL)
+		return false;
+	if (neg->until <= now) {
+		rb_erase(&neg->node, &obj_rule_neg_tree);
+		free(neg);
+		return false;
+	}
+	obj_rule_fail(r, neg->nl_errno, neg->until - now);
+	return true;
+}
+
+static void obj_rule_delete(struct obj_rule *r);
+
+/* one of ours, that the kernel has kept in software only */
+static void obj_rule_check_hw(struct obj_rule *r, const uint32_t in_hw_count)
+{
+	r->in_hw_count = in_hw_count;
+	if (obj_rule_is_in_hw(r)) {
+		r->hw_retries = 0;
+		return;
+	}
+	if (r->state != OBJ_RULE_STATE_OK || r->have->type == TC_RULE_TYPE_ALIEN)
+		return;
+	if (ev_is_active(&r->retry_timer) || r->hw_retries > OBJ_RULE_HW_RETRIES)
+		return;
+	r->hw_retries++;
+	if (r->hw_retries > OBJ_RULE_HW_RETRIES) {
+		fr_printf_ratelimited(ERROR, "rule (%d,%d) is not in hardware, leaving it in software\n",
+				      r->chain_no, r->prio);
+		return;
+	}
+	fr_printf_ratelimited(ERROR, "rule (%d,%d) is not in hardware, re-placing it\n",
+			      r->chain_no, r->prio);
+	obj_rule_retry_start(r, obj_rule_backoff(r->hw_retries));
+}
+
+static void obj_rule_trace_finish(struct obj_rule *r)
+{
+	trace_finish(&r->trace, r->dev, r->chain_no, r->prio);
+}
+
+/* the echo, that confirms the change, usually comes before the ack */
+static void obj_rule_trace_acked(struct obj_rule *r, const enum obj_rule_op op)
+{
+	if (r->state == OBJ_RULE_STATE_QUEUED)
+		return; /* an ack for an older request */
+	trace_stage(&r->trace, TRACE_STAGE_ACKED);
+	if (op == OBJ_RULE_OP_UNINSTALL || r->trace.ts[TRACE_STAGE_OK] != 0.)
+		obj_rule_trace_finish(r);
+}
+
+static void obj_rule_trace_ok(struct obj_rule *r)
+{
+	trace_stage(&r->trace, TRACE_STAGE_OK);
+	/* unless it was never sent, the ack is still to come */
+	if (r->trace.ts[TRACE_STAGE_ACKED] != 0. || r->trace.ts[TRACE_STAGE_SENT] == 0.)
+		obj_rule_trace_finish(r);
+}
+
+static void obj_rule_done(void *data, const int nl_errno)
+{
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+	struct obj_rule *r = data;
+	enum obj_rule_op op = r->pending_op;
+
+	if (nl_errno == 0) {
+		r->failures = 0;
+		r->nl_errno = 0;
+		obj_rule_trace_acked(r, op);
+	} else if (r->state != OBJ_RULE_STATE_PENDING) {
+		/* a newer request, or the kernel, has moved on */
+	} else if (nl_errno == ENOENT && op != OBJ_RULE_OP_INSTALL) {
+		/* it is already gone */
+		obj_rule_delete(r);
+	} else {
+		if (obj_rule_is_unoffloadable(nl_errno) && r->want)
+			obj_rule_neg_insert(r->want, nl_errno, ev_now(EV_A) + OBJ_RULE_NEG_TTL);
+		obj_rule_fail(r, nl_errno, 0.);
+	}
 	obj_rule_unref(r);
 }
 
@@ -210,12 +586,16 @@ static void obj_rule_queue_install(struct obj_rule *r)
 {
 	if (obj_rule_pin_changes < 2)
 		return;
+	if (obj_rule_neg_check(r))
+		return;
 
 	AN(r->state == OBJ_RULE_STATE_WANT);
 	r->state = OBJ_RULE_STATE_QUEUED;
-	fr_printf(INFO, "TRYING TO INSTALL RULE 1 (%d,%d)\n", r->chain_no, r->prio);
+	fr_printf_ratelimited(INFO, "TRYING TO INSTALL RULE 1 (%d,%d)\n", r->chain_no, r->prio);
 
-	tc_action_install(r->chain_no, r->prio, r->want, obj_rule_ref(r));
+	r->queued_op = OBJ_RULE_OP_INSTALL;
+	trace_queued(&r->trace, "install");
+	tc_action_install(r->dev, r->chain_no, r->prio, r->want, obj_rule_class(r), obj_rule_ref(r));
 	fr_printf(DEBUG2, "%s\t%d\n", __func__, r->state);
 }
 
@@ -225,34 +605,86 @@ static void obj_rule_queue_uninstall(struct obj_rule *r)
 		return;
 	AN(r->state == OBJ_RULE_STATE_ALIEN);
 	r->state = OBJ_RULE_STATE_QUEUED;
-	fr_printf(INFO, "TRYING TO UNINSTALL RULE 1\t%d\t%d\n", r->chain_no, r->prio);
+	fr_printf_ratelimited(INFO, "TRYING TO UNINSTALL RULE 1\t%d\t%d\n", r->chain_no, r->prio);
 	//if (r->chain_no != 0 && r->chain_no != 4 && r->chain_no != 6) {
-	tc_action_install(r->chain_no, r->prio, NULL, obj_rule_ref(r));
+	r->queued_op = OBJ_RULE_OP_UNINSTALL;
+	trace_queued(&r->trace, "uninstall");
+	tc_action_install(r->dev, r->chain_no, r->prio, NULL, obj_rule_class(r), obj_rule_ref(r));
 	/* uninstall update should trigger removal and new install */
 	//}
 	/* TODO add error handler */
 }
 
+static void obj_rule_queue_replace(struct obj_rule *r)
+{
+	if (obj_rule_pin_changes < 2)
+		return;
+	if (obj_rule_neg_check(r))
+		return;
+	AN(r->state == OBJ_RULE_STATE_WANT);
+	r->state = OBJ_RULE_STATE_QUEUED;
+	fr_printf_ratelimited(INFO, "TRYING TO REPLACE RULE\t%d\t%d\n", r->chain_no, r->prio);
+	r->queued_op = OBJ_RULE_OP_REPLACE;
+	trace_queued(&r->trace, "replace");
+	tc_action_replace(r->dev, r->chain_no, r->prio, r->want, obj_rule_class(r), obj_rule_ref(r));
+}
+
+/* drop an unsent request, that is no longer needed */
+static void obj_rule_cancel_queued(struct obj_rule *r)
+{
+	if (r->state != OBJ_RULE_STATE_QUEUED)
+		return;
+	r->queued_op = OBJ_RULE_OP_NONE;
+	/* the cancelled callback unrefs, so keep the rule alive */
+	obj_rule_ref(r);
+	tc_action_cancel(r->dev, r->chain_no, r->prio);
+	obj_rule_unref(r);
+}
+
+/*
+ * An unsent request of the same kind already covers the latest want,
+ * as it is updated in place, otherwise a new request supersedes it.
+ */
+static int obj_rule_is_queued(const struct obj_rule *r, const enum obj_rule_op op)
+{
+	return r->state == OBJ_RULE_STATE_QUEUED && r->queued_op == op;
+}
+
 static void obj_rule_update_state(struct obj_rule *r)
 {
 	if (obj_rule_pin_changes == 0)
 		return;
-	if (r->state == OBJ_RULE_STATE_QUEUED)
-		return; /* XXX */
+	if (ev_is_active(&r->retry_timer))
+		return; /* backing off, until the want changes */
 	if (r->want == NULL && r->have == NULL) {
+		obj_rule_cancel_queued(r);
 		if (r->state != OBJ_RULE_STATE_NEW)
 			r->state = OBJ_RULE_STATE_ZOMBIE;
 	} else if (r->want == NULL) {
+		if (obj_rule_is_queued(r, OBJ_RULE_OP_UNINSTALL))
+			return;
 		r->state = OBJ_RULE_STATE_ALIEN;
 		obj_rule_queue_uninstall(r);
 	} else if (r->have == NULL) {
+		if (obj_rule_is_queued(r, OBJ_RULE_OP_INSTALL))
+			return;
 		r->state = OBJ_RULE_STATE_WANT;
 		obj_rule_queue_install(r);
 	} else if (memcmp(r->want, r->have, sizeof(struct tc_rule)) == 0) {
+		obj_rule_cancel_queued(r);
 		r->state = OBJ_RULE_STATE_OK;
+		obj_rule_trace_ok(r);
 		if (r->target)
 			obj_target_notify_routes(r->target);
+	} else if (r->have->type != TC_RULE_TYPE_ALIEN) {
+		/* both are flower rules of ours, so overwrite it in place */
+		if (obj_rule_is_queued(r, OBJ_RULE_OP_REPLACE))
+			return;
+		r->state = OBJ_RULE_STATE_WANT;
+		obj_rule_queue_replace(r);
 	} else {
+		if (obj_rule_is_queued(r, OBJ_RULE_OP_UNINSTALL))
+			return;
 		r->state = OBJ_RULE_STATE_ALIEN;
 		obj_rule_queue_uninstall(r);
 	}
@@ -317,15 +749,17 @@ static struct obj_rule *obj_rule_alloc(void)
 	return r;
 }
 
-void obj_rule_netlink_found(const uint16_t nlmsg_type, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr)
+void obj_rule_netlink_found(const uint16_t nlmsg_type, const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, const uint32_t in_hw_count)
 {
 	if (tcr)
 		tc_rule_print(tcr);
+	if (config->dry_run)
+		tc_dry_run_found(nlmsg_type, dev, chain_no, prio, tcr);
 
-	struct obj_rule *r = obj_rule_pos_lookup(chain_no, prio);
+	struct obj_rule *r = obj_rule_pos_lookup(dev, chain_no, prio);
 
 	if (r == NULL) {
-		r = obj_rule_laf_lookup(tcr);
+		r = obj_rule_laf_lookup(dev, tcr);
 		if (r && (r->chain_no != chain_no || r->prio != prio))
 			r = NULL;
 	}
@@ -344,9 +778,11 @@ void obj_rule_netlink_found(const uint16_t nlmsg_type, const uint32_t chain_no,
 
 	if (is_new) {
 		r = obj_rule_alloc();
+		r->dev = dev;
 		r->chain_no = chain_no;
 		r->prio = prio;
 	} else {
+		AN(r->dev == dev);
 		AN(r->chain_no == chain_no);
 		AN(r->prio == prio);
 	}
@@ -365,13 +801,208 @@ void obj_rule_netlink_found(const uint16_t nlmsg_type, const uint32_t chain_no,
 
 	if (is_new)
 		obj_rule_new(r);
-	else if (changes > 0)
-		obj_rule_update(r);
+	else if (changes > 0 || r->state == OBJ_RULE_STATE_PENDING)
+		obj_rule_update(r); /* a replace may not change anything */
+	obj_rule_check_hw(r, in_hw_count);
+}
+
+/*
+ * terse dumps only tell us which filters exist, their flags and
+ * offload state, so that is all that can be compared with have,
+ * anything unexpected makes the chain suspect, and warrants a full dump
+ */
+void obj_rule_terse_seen(const unsigned int dev, const uint32_t chain_no, const uint16_t prio, const int is_flower, const uint32_t flower_flags, const uint32_t in_hw_count)
+{
+	struct obj_rule *r = obj_rule_pos_lookup(dev, chain_no, prio);
+
+	if (r == NULL || r->have == NULL) {
+		fr_printf(DEBUG1, "terse: unknown rule (%d,%d)\n", chain_no, prio);
+		obj_rule_terse_suspect = true;
+		return;
+	}
+	obj_assert_kind(r, RULE);
+	r->terse_gen = obj_rule_terse_gen;
+
+	if (r->have->flower_flags != flower_flags ||
+	    (!is_flower && r->have->type != TC_RULE_TYPE_ALIEN)) {
+		fr_printf(DEBUG1, "terse: rule (%d,%d) differs\n", chain_no, prio);
+		obj_rule_terse_suspect = true;
+		return;
+	}
+	obj_rule_check_hw(r, in_hw_count);
+}
+
+/* after a terse dump of chain_no, returns true if a full dump is needed */
+int obj_rule_terse_verify(const unsigned int dev, const uint32_t chain_no)
+{
+	int suspect = obj_rule_terse_suspect;
+
+	for (struct rb_node *n = obj_rule_pos_lower_bound(dev, chain_no, 0); n; n = rb_next(n)) {
+		struct obj_rule *r = rb_container_of(n, struct obj_rule, pos_node);
+
+		if (r->dev != dev || r->chain_no != chain_no)
+			break;
+		if (r->have == NULL || r->terse_gen == obj_rule_terse_gen)
+			continue;
+		fr_printf(DEBUG1, "terse: rule (%d,%d) is missing\n", r->chain_no, r->prio);
+		suspect = true;
+	}
+
+	obj_rule_terse_gen++;
+	obj_rule_terse_suspect = false;
+	return suspect;
+}
+
+/* the chain has been emptied, so sweep its rules in one go */
+static void obj_rule_flush_sweep(const unsigned int dev, const uint32_t chain_no)
+{
+	struct obj_rule **rules;
+	unsigned int cnt = 0;
+	struct rb_node *first = obj_rule_pos_lower_bound(dev, chain_no, 0);
+
+	for (struct rb_node *n = first; n; n = rb_next(n)) {
+		struct obj_rule *r = rb_container_of(n, struct obj_rule, pos_node);
+
+		if (r->dev != dev || r->chain_no != chain_no)
+			break;
+		cnt++;
+	}
+
+	/* deleting can reap rules, so hold on to them all first */
+	rules = fr_malloc(sizeof(struct obj_rule *) * (cnt + 1));
+	cnt = 0;
+	for (struct rb_node *n = first; n; n = rb_next(n)) {
+		struct obj_rule *r = rb_container_of(n, struct obj_rule, pos_node);
+
+		if (r->dev != dev || r->chain_no != chain_no)
+			break;
+		rules[cnt++] = obj_rule_ref(r);
+	}
+	for (unsigned int i = 0; i < cnt; i++) {
+		if (rules[i]->have)
+			obj_rule_delete(rules[i]);
+	}
+	for (unsigned int i = 0; i < cnt; i++)
+		obj_rule_unref(rules[i]);
+	free(rules);
+}
+
+static void obj_rule_flushed(const unsigned int dev, const uint32_t chain_no, void *data, const int nl_errno)
+{
+	struct obj_rule_flush *f = data;
+
+	if (nl_errno == 0 || nl_errno == ENOENT)
+		obj_rule_flush_sweep(dev, chain_no);
+	else
+		fr_printf(ERROR, "flushing chain %d on %s failed: %s\n", chain_no, filter_dev_name(dev), strerror(nl_errno));
+
+	AN(f->pending > 0);
+	if (--f->pending > 0)
+		return;
+	if (f->done)
+		f->done(f->data);
+	free(f);
+}
+
+/*
+ * empties every chain that has rules, with a single request per chain,
+ * instead of one per rule, and then sweeps the rules in those chains,
+ * while pinned nothing is re-installed, returns the number of chains,
+ * done is only called when that is non-zero
+ */
+int obj_rule_flush(void (*done)(void *data), void *data)
+{
+	struct obj_rule_flush *f = fr_malloc(sizeof(struct obj_rule_flush));
+	struct obj_rule *last = NULL;
+	unsigned int cnt = 0;
+
+	for (struct rb_node *n = rb_first(&obj_rule_pos_tree); n; n = rb_next(n)) {
+		struct obj_rule *r = rb_container_of(n, struct obj_rule, pos_node);
+
+		if (r->have == NULL || (last && r->dev == last->dev && r->chain_no == last->chain_no))
+			continue;
+		last = r;
+		cnt++;
+	}
+	if (cnt == 0) {
+		free(f);
+		return 0;
+	}
+
+	fr_printf(INFO, "flushing %u chains\n", cnt);
+	f->pending = cnt;
+	f->done = done;
+	f->data = data;
+
+	/* collected first, as completions can be synchronous */
+	struct obj_rule_flush_chain *chains = fr_malloc(sizeof(struct obj_rule_flush_chain) * cnt);
+
+	cnt = 0;
+	for (struct rb_node *n = rb_first(&obj_rule_pos_tree); n; n = rb_next(n)) {
+		struct obj_rule *r = rb_container_of(n, struct obj_rule, pos_node);
+
+		if (r->have == NULL || (cnt > 0 && r->dev == chains[cnt - 1].dev &&
+					r->chain_no == chains[cnt - 1].chain_no))
+			continue;
+		chains[cnt].dev = r->dev;
+		chains[cnt].chain_no = r->chain_no;
+		cnt++;
+	}
+	for (unsigned int i = 0; i < cnt; i++)
+		tc_action_flush_chain(chains[i].dev, chains[i].chain_no, QUEUE_CLASS_URGENT, f);
+	free(chains);
+	return cnt;
+}
+
+/*
+ * place a copy of r at the same position on each of the other devices,
+ * taking over what was found there, the mirrors follow r's want
+ */
+static void obj_rule_mirror(struct obj_rule *r)
+{
+	struct obj_rule **tail = &r->mirror;
+
+	AZ(r->dev);
+	AZ(r->mirror);
+	AN(r->want);
+	for (unsigned int dev = 1; dev < filter_dev_cnt(); dev++) {
+		struct obj_rule *m = obj_rule_pos_lookup(dev, r->chain_no, r->prio);
+
+		if (m == NULL) {
+			m = obj_rule_alloc();
+			m->dev = dev;
+			m->chain_no = r->chain_no;
+			m->prio = r->prio;
+			obj_rule_pos_insert(m);
+		} else if (m->have_laf) {
+			rb_erase(&m->laf_node, &obj_rule_laf_tree);
+			m->have_laf = false;
+		}
+		AZ(m->mirror);
+		m->type = r->type;
+		if (m->want == NULL)
+			m->want = fr_malloc(sizeof(struct tc_rule));
+		memcpy(m->want, r->want, sizeof(struct tc_rule));
+		*tail = obj_rule_ref(m);
+		tail = &m->mirror;
+	}
+}
+
+int obj_rule_is_ok(const struct obj_rule *r)
+{
+	obj_assert_kind(r, RULE);
+	if (r->state != OBJ_RULE_STATE_OK)
+		return false;
+	obj_rule_for_each_mirror(r, m) {
+		if (m->state != OBJ_RULE_STATE_OK)
+			return false;
+	}
+	return true;
 }
 
 void obj_rule_static_want(const uint32_t chain_no, const uint16_t prio, const struct tc_rule *tcr)
 {
-	struct obj_rule *r = obj_rule_pos_lookup(chain_no, prio);
+	struct obj_rule *r = obj_rule_pos_lookup(0, chain_no, prio);
 
 	AN(r == NULL);
 	r = obj_rule_alloc();
@@ -382,34 +1013,65 @@ void obj_rule_static_want(const uint32_t chain_no, const uint16_t prio, const st
 	r->want = fr_malloc(sizeof(struct tc_rule));
 	memcpy(r->want, tcr, sizeof(struct tc_rule));
 	obj_rule_pos_insert(r);
-	obj_rule_update_state(r);
+	obj_rule_mirror(r);
+	obj_rule_queue_request(r);
 }
 
 void obj_rule_uninstall(struct obj_rule *r)
 {
+	obj_rule_retry_stop(r);
 	if (r->want) {
 		free(r->want);
 		r->want = NULL;
 	}
 	obj_rule_update_state(r);
+	obj_rule_for_each_mirror(r, m)
+		obj_rule_uninstall(m);
 }
 
-struct obj_rule *obj_rule_prime_request(const struct tc_rule *tcr)
+static void obj_rule_set_want(struct obj_rule *r, const struct tc_rule *tcr)
 {
-	struct obj_rule *r = obj_rule_laf_lookup(tcr);
-
-	if (r) {
-		/* rule was found in the lost and found tree */
-		obj_rule_ref(r);
-		AN(r->have != NULL);
-		AN(r->want == NULL);
+	if (r->want == NULL) {
 		r->want = fr_malloc(sizeof(struct tc_rule));
-		memcpy(r->want, tcr, sizeof(struct tc_rule));
-		AN(r->have_laf == true);
-		rb_erase(&r->laf_node, &obj_rule_laf_tree);
-		r->have_laf = false;
-		return obj_rule_ref(r);
+	} else if (memcmp(r->want, tcr, sizeof(struct tc_rule)) == 0) {
+		return;
 	}
+	/* update in place, as a queued action may still point to it */
+	memcpy(r->want, tcr, sizeof(struct tc_rule));
+	obj_rule_retry_stop(r);
+	obj_rule_update_state(r);
+}
+
+void obj_rule_replace_want(struct obj_rule *r, const struct tc_rule *tcr)
+{
+	obj_assert_kind(r, RULE);
+	AN(tcr);
+	obj_rule_set_want(r, tcr);
+	obj_rule_for_each_mirror(r, m)
+		obj_rule_set_want(m, tcr);
+}
+
+static struct obj_rule *obj_rule_claim_found(struct obj_rule *r, const struct tc_rule *tcr)
+{
+	/* rule was found in the lost and found tree */
+	obj_rule_ref(r);
+	AN(r->have != NULL);
+	AN(r->want == NULL);
+	r->want = fr_malloc(sizeof(struct tc_rule));
+	memcpy(r->want, tcr, sizeof(struct tc_rule));
+	AN(r->have_laf == true);
+	rb_erase(&r->laf_node, &obj_rule_laf_tree);
+	r->have_laf = false;
+	obj_rule_mirror(r);
+	return obj_rule_ref(r);
+}
+
+struct obj_rule *obj_rule_prime_request(const struct tc_rule *tcr)
+{
+	struct obj_rule *r = obj_rule_laf_lookup(0, tcr);
+
+	if (r)
+		return obj_rule_claim_found(r, tcr);
 
 	uint32_t chain_no = 0;
 	uint16_t prio = 0;
@@ -423,15 +1085,37 @@ struct obj_rule *obj_rule_prime_request(const struct tc_rule *tcr)
 		r->want = fr_malloc(sizeof(struct tc_rule));
 		memcpy(r->want, tcr, sizeof(struct tc_rule));
 		obj_rule_pos_insert(r);
+		obj_rule_mirror(r);
 		return r;
 	}
 
 	return NULL;
 }
 
+/* for rules which must share a chain, eg. the hash buckets of a target */
+struct obj_rule *obj_rule_prime_request_in_chain(const uint32_t chain_no, const struct tc_rule *tcr)
+{
+	struct obj_rule *r = obj_rule_laf_lookup(0, tcr);
+
+	if (r && r->chain_no == chain_no)
+		return obj_rule_claim_found(r, tcr);
+
+	r = obj_rule_ref(obj_rule_alloc());
+	r->chain_no = chain_no;
+	r->prio = obj_rule_find_available_prio(chain_no, 1);
+	AN(r->prio); /* a target's chain only holds its buckets */
+	r->want = fr_malloc(sizeof(struct tc_rule));
+	memcpy(r->want, tcr, sizeof(struct tc_rule));
+	obj_rule_pos_insert(r);
+	obj_rule_mirror(r);
+	return r;
+}
+
 void obj_rule_queue_request(struct obj_rule *r)
 {
 	obj_rule_update_state(r);
+	obj_rule_for_each_mirror(r, m)
+		obj_rule_update_state(m);
 }
 
 struct obj_rule *obj_rule_request(const struct tc_rule *tcr)
@@ -448,7 +1132,7 @@ void obj_rule_print_all(void)
 	for (struct rb_node *n = rb_first(&obj_rule_pos_tree); n; n = rb_next(n)) {
 		struct obj_rule *r = rb_container_of(n, struct obj_rule, pos_node);
 
-		fr_printf(INFO, "rule % 6d % 6d  %d  ", r->chain_no, r->prio, r->state);
+		fr_printf(INFO, "rule %d % 6d % 6d  %d  ", r->dev, r->chain_no, r->prio, r->state);
 		struct tc_rule *tcr_h = r->have;
 
 		if (tcr_h)
@@ -496,7 +1180,7 @@ void obj_rule_print_all(void)
 	for (struct rb_node *n = rb_first(&obj_rule_laf_tree); n; n = rb_next(n)) {
 		struct obj_rule *r = rb_container_of(n, struct obj_rule, laf_node);
 
-		fr_printf(INFO, " ??? % 6d % 6d ", r->chain_no, r->prio);
+		fr_printf(INFO, " ??? %d % 6d % 6d ", r->dev, r->chain_no, r->prio);
 		struct tc_rule *tcr_h = r->have;
 
 		if (tcr_h)
@@ -507,28 +1191,107 @@ void obj_rule_print_all(void)
 	}
 }
 
-uint16_t obj_rule_find_available_prio(const uint32_t chain_no, const uint16_t min_prio)
+void obj_rule_get_hw_stats(struct obj_rule_hw_stats *st)
+{
+	memset(st, '\0', sizeof(struct obj_rule_hw_stats));
+	for (struct rb_node *n = rb_first(&obj_rule_pos_tree); n; n = rb_next(n)) {
+		struct obj_rule *r = rb_container_of(n, struct obj_rule, pos_node);
+
+		if (r->have == NULL || r->have->type >= TC_RULE_TYPE_MAX)
+			continue;
+		st->total[r->have->type]++;
+		if (r->in_hw_count > 0)
+			st->in_hw[r->have->type]++;
+	}
+}
+
+static const char * const obj_rule_state_names[OBJ_RULE_STATE_CNT] = {
+	[OBJ_RULE_STATE_NEW] = "new",
+	[OBJ_RULE_STATE_ALIEN] = "alien",
+	[OBJ_RULE_STATE_WANT] = "want",
+	[OBJ_RULE_STATE_QUEUED] = "queued",
+	[OBJ_RULE_STATE_PENDING] = "pending",
+	[OBJ_RULE_STATE_FAILED] = "failed",
+	[OBJ_RULE_STATE_OK] = "ok",
+	[OBJ_RULE_STATE_ZOMBIE] = "zombie",
+};
+
+const char *obj_rule_state_str(const enum obj_rule_state state)
 {
-	uint16_t ret = 0;
+	AN(state < OBJ_RULE_STATE_CNT);
+	return obj_rule_state_names[state];
+}
 
+/* mirrors count on their own, as each is a rule in the kernel */
+void obj_rule_get_state_stats(struct obj_rule_state_stats *st)
+{
+	memset(st, '\0', sizeof(struct obj_rule_state_stats));
 	for (struct rb_node *n = rb_first(&obj_rule_pos_tree); n; n = rb_next(n)) {
 		struct obj_rule *r = rb_container_of(n, struct obj_rule, pos_node);
 
-		if (r->chain_no < chain_no)
+		st->cnt[r->state]++;
+	}
+	/* found, but not positioned yet */
+	for (struct rb_node *n = rb_first(&obj_rule_laf_tree); n; n = rb_next(n)) {
+		struct obj_rule *r = rb_container_of(n, struct obj_rule, laf_node);
+
+		if (!r->have_pos)
+			st->cnt[r->state]++;
+	}
+}
+
+void obj_rule_print_hw_report(void)
+{
+	struct obj_rule_hw_stats st;
+
+	if (!obj_rule_wants_hw())
+		return;
+	obj_rule_get_hw_stats(&st);
+	for (int i = 0; i < TC_RULE_TYPE_MAX; i++) {
+		if (st.total[i] == 0)
 			continue;
-		if (r->chain_no > chain_no)
-			break;
-		if (ret == 0 && r->prio > min_prio)
-			break;
-		if (r->prio == ret || ret < min_prio)
-			ret = r->prio + 1;
-		else if (ret >= min_prio)
-			break;
+		fr_printf(INFO, "in hw: %-14s %6u / %6u (%5.1f%%)\n", tc_rule_state_str(i),
+			  st.in_hw[i], st.total[i], 100. * st.in_hw[i] / st.total[i]);
+		if (i != TC_RULE_TYPE_ALIEN && st.in_hw[i] != st.total[i])
+			fr_printf(ERROR, "%u %s rules are not in hardware\n",
+				  st.total[i] - st.in_hw[i], tc_rule_state_str(i));
 	}
-	if (ret < min_prio)
-		ret = min_prio;
-	AN(ret >= min_prio);
-	return ret;
+}
+
+/*
+ * lowest free prio, at or above min_prio, on the first device, or 0 if
+ * the chain is full, the mirrors follow
+ *
+ * Routes are placed one after another, so a hint per chain remembers
+ * how far up the prios are known to be taken, and is lowered again when
+ * a rule below it is reaped.
+ */
+uint16_t obj_rule_find_available_prio(const uint32_t chain_no, const uint16_t min_prio)
+{
+	struct obj_rule_prio_hint *hint = NULL;
+	uint32_t prio = min_prio;
+
+	if (chain_no < OBJ_RULE_PRIO_HINTS) {
+		hint = &obj_rule_prio_hints[chain_no];
+		if (hint->min_prio == min_prio && hint->next > prio)
+			prio = hint->next;
+	}
+	if (prio <= UINT16_MAX) {
+		for (struct rb_node *n = obj_rule_pos_lower_bound(0, chain_no, prio); n; n = rb_next(n)) {
+			struct obj_rule *r = rb_container_of(n, struct obj_rule, pos_node);
+
+			if (r->dev != 0 || r->chain_no != chain_no || r->prio != prio)
+				break;
+			prio++;
+		}
+	}
+	if (hint) {
+		hint->min_prio = min_prio;
+		hint->next = prio;
+	}
+	if (prio > UINT16_MAX)
+		return 0;
+	return prio;
 }
 
 void obj_rule_clear_all(void)
@@ -541,20 +1304,28 @@ void obj_rule_clear_all(void)
 		obj_set_state(rule, r, PRESENT);
 		obj_rule_unref(r);
 	}
-	for (struct rb_node *n = rb_first(&obj_rule_pos_tree), *nn; n; n = nn) {
-		nn = rb_next(n);
+	/* backwards, as reaping a rule on the first device reaps its mirrors */
+	for (struct rb_node *n = rb_last(&obj_rule_pos_tree), *nn; n; n = nn) {
+		nn = rb_prev(n);
 		struct obj_rule *r = rb_container_of(n, struct obj_rule, pos_node);
 
 		obj_rule_ref(r);
+		obj_rule_retry_stop(r);
 		obj_set_state(rule, r, PRESENT);
 		obj_rule_unref(r);
 	}
+	obj_rule_neg_clear();
 }
 
 void obj_rule_init(void)
 {
 	struct tc_action_callbacks *tacb = tc_action_get_callbacks();
 
+	obj_rule_neg_clear();
+	obj_rule_terse_suspect = false;
+	memset(obj_rule_prio_hints, '\0', sizeof(obj_rule_prio_hints));
 	tacb->pre_install = obj_rule_pre_install;
-	tacb->post_install = obj_rule_post_install;
+	tacb->done = obj_rule_done;
+	tacb->cancelled = obj_rule_cancelled;
+	tacb->flushed = obj_rule_flushed;
 }
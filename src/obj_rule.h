@@ -3,10 +3,27 @@
 #include "obj.h"
 #include "tc_rule.h"
 
-void obj_rule_netlink_found(const uint16_t nlmsg_type, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr);
+struct obj_rule_hw_stats {
+	unsigned int total[TC_RULE_TYPE_MAX];
+	unsigned int in_hw[TC_RULE_TYPE_MAX];
+};
+
+struct obj_rule_state_stats {
+	unsigned int cnt[OBJ_RULE_STATE_CNT];
+};
+
+void obj_rule_netlink_found(const uint16_t nlmsg_type, const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, const uint32_t in_hw_count);
+void obj_rule_terse_seen(const unsigned int dev, const uint32_t chain_no, const uint16_t prio, const int is_flower, const uint32_t flower_flags, const uint32_t in_hw_count);
+int obj_rule_terse_verify(const unsigned int dev, const uint32_t chain_no);
+int obj_rule_flush(void (*done)(void *data), void *data);
 void obj_rule_static_want(const uint32_t chain_no, const uint16_t prio, const struct tc_rule *tcr);
 void obj_rule_print_all(void);
+void obj_rule_get_hw_stats(struct obj_rule_hw_stats *st);
+void obj_rule_print_hw_report(void);
+void obj_rule_get_state_stats(struct obj_rule_state_stats *st);
+const char *obj_rule_state_str(const enum obj_rule_state state);
 struct obj_rule *obj_rule_prime_request(const struct tc_rule *tcr);
+struct obj_rule *obj_rule_prime_request_in_chain(const uint32_t chain_no, const struct tc_rule *tcr);
 void obj_rule_queue_request(struct obj_rule *r);
 struct obj_rule *obj_rule_request(const struct tc_rule *tcr);
 struct obj_rule *obj_rule_ref(struct obj_rule *r);
@@ -16,8 +33,10 @@ uint16_t obj_rule_find_available_prio(const uint32_t chain_no, const uint16_t mi
 void obj_rule_set_target(struct obj_rule *r, struct obj_target *t);
 void obj_rule_unset_target(struct obj_rule *r);
 void obj_rule_uninstall(struct obj_rule *r);
+void obj_rule_replace_want(struct obj_rule *r, const struct tc_rule *tcr);
+int obj_rule_is_ok(const struct obj_rule *r);
 int obj_rule_count(void);
 void obj_rule_init(void);
 void obj_rule_reset_pin(void);
 void obj_rule_clear_all(void);
-struct obj_rule *obj_rule_pos_lookup(const uint32_t chain_no, const uint16_t prio);
+struct obj_rule *obj_rule_pos_lookup(const unsigned int dev, const uint32_t chain_no, const uint16_t prio);
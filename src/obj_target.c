@@ -6,6 +6,7 @@
 #include "obj_rule.h"
 #include "tc_rule.h"
 
+static struct rb_root obj_target_nh_tree = RB_ROOT;
 static int obj_target_cnt;
 
 int obj_target_count(void)
@@ -13,6 +14,25 @@ int obj_target_count(void)
 	return obj_target_cnt;
 }
 
+static void obj_target_drop_rules(struct obj_target *t)
+{
+	for (unsigned int i = 1; i < t->bucket_cnt; i++) {
+		struct obj_rule *r = t->bucket_rule[i];
+
+		if (r) {
+			obj_rule_unset_target(r);
+			obj_rule_unref(r);
+			t->bucket_rule[i] = NULL;
+		}
+	}
+	t->bucket_cnt = 0;
+	if (t->rule) {
+		obj_rule_unset_target(t->rule);
+		obj_rule_unref(t->rule);
+		t->rule = NULL;
+	}
+}
+
 static void obj_target_reap(struct obj_target *t)
 {
 	//struct obj_link *l = t->link;
@@ -20,20 +40,13 @@ static void obj_target_reap(struct obj_target *t)
 	AN(t->obj.refcnt == 0);
 	/* TODO some state assert */
 	/* TODO sanity check for leak */
-	for (struct obj_nexthop *nh = t->nexthop, *next_nh; nh; nh = next_nh) {
-		AN(nh);
-		next_nh = nh->next;
-		obj_neigh_weak_unref(nh->neigh);
-		free(nh);
-	}
+	AZ(t->nexthop); /* each linked nexthop holds a reference */
 	for (struct obj_route *r = t->first_route, *nr; r; r = nr) {
 		nr = r->t_next_route;
 		obj_route_unref(r);
 	}
-	if (t->rule) {
-		obj_rule_unref(t->rule);
-		t->rule = NULL;
-	}
+	obj_target_drop_rules(t);
+	free(t->nh_grp);
 	AN(t->obj.weak_refcnt == 0);
 	obj_free(t);
 	AN(obj_target_cnt--);
@@ -55,22 +68,136 @@ static struct obj_target *obj_target_alloc(void)
 	return t;
 }
 
+static void obj_target_link_nexthop(struct obj_target *t, struct obj_neigh *n)
+{
+	struct obj_nexthop *nh = fr_malloc(sizeof(struct obj_nexthop));
+	struct obj_nexthop **pp = &t->nexthop;
+
+	obj_assert_kind(n, NEIGH);
+	nh->neigh = obj_neigh_weak_ref(n);
+	nh->target = obj_target_ref(t);
+
+	/* append, the caller provides the nexthops in sort order */
+	while (*pp)
+		pp = &(*pp)->next;
+	*pp = nh;
+	t->nexthop_cnt++;
+
+	/* link nexthop to the front of obj_neigh's linked list of nexthops */
+	nh->n_next = n->nexthops;
+	n->nexthops = nh;
+}
+
+/* the caller must hold a reference to nh->target */
+static void obj_target_unlink_nexthop(struct obj_nexthop *nh)
+{
+	struct obj_target *t = nh->target;
+	struct obj_neigh *n = nh->neigh;
+	struct obj_nexthop **pp;
+
+	for (pp = &n->nexthops; *pp; pp = &(*pp)->n_next) {
+		if (*pp == nh) {
+			*pp = nh->n_next;
+			break;
+		}
+	}
+	for (pp = &t->nexthop; *pp; pp = &(*pp)->next) {
+		if (*pp == nh) {
+			*pp = nh->next;
+			break;
+		}
+	}
+	AN(t->nexthop_cnt--);
+	obj_neigh_weak_unref(n);
+	free(nh);
+	obj_target_unref(t);
+}
+
+static void obj_target_unlink_nexthops(struct obj_target *t)
+{
+	while (t->nexthop)
+		obj_target_unlink_nexthop(t->nexthop);
+}
+
+static int obj_target_neigh_cmp(const void *a, const void *b)
+{
+	const struct obj_neigh *na = *(const struct obj_neigh **) a;
+	const struct obj_neigh *nb = *(const struct obj_neigh **) b;
+	int ifa = na->link ? na->link->ifindex : 0;
+	int ifb = nb->link ? nb->link->ifindex : 0;
+
+	if (ifa != ifb)
+		return ifa < ifb ? -1 : 1;
+	return memcmp(&na->addr, &nb->addr, sizeof(struct af_addr));
+}
+
+/* sort and remove duplicates, returns the new count */
+static unsigned int obj_target_sort_neighs(struct obj_neigh **neighs, unsigned int cnt)
+{
+	unsigned int j = 0;
+
+	if (cnt == 0)
+		return 0;
+	qsort(neighs, cnt, sizeof(struct obj_neigh *), obj_target_neigh_cmp);
+	for (unsigned int i = 1; i < cnt; i++) {
+		if (neighs[i] != neighs[j])
+			neighs[++j] = neighs[i];
+	}
+	return j + 1;
+}
+
+static int obj_target_has_neighs(const struct obj_target *t, struct obj_neigh **neighs, const unsigned int cnt)
+{
+	const struct obj_nexthop *nh = t->nexthop;
+
+	if (t->nexthop_cnt != cnt)
+		return false;
+	for (unsigned int i = 0; i < cnt; i++, nh = nh->next) {
+		if (nh->neigh != neighs[i])
+			return false;
+	}
+	return true;
+}
+
 struct obj_target *obj_target_get_unipath(struct obj_neigh *n)
 {
 	obj_assert_kind(n, NEIGH);
-	struct obj_target *t = n->targets;
+	struct obj_target *t;
 
-	if (t && t->nexthop_cnt == 1)
-		return t;
+	/* targets owned by nexthop objects are never shared with plain routes */
+	for (struct obj_nexthop *nh = n->nexthops; nh; nh = nh->n_next) {
+		t = nh->target;
+		if (t->nh_id == 0 && !t->is_multipath)
+			return t;
+	}
 
 	t = obj_target_alloc();
-	t->nexthop_cnt = 1;
-	t->nexthop = fr_malloc(sizeof(struct obj_nexthop));
-	t->nexthop->neigh = obj_neigh_weak_ref(n);
+	obj_target_link_nexthop(t, n);
+
+	return t;
+}
+
+struct obj_target *obj_target_get_multipath(struct obj_neigh **neighs, unsigned int cnt)
+{
+	struct obj_target *t;
+
+	cnt = obj_target_sort_neighs(neighs, cnt);
+	if (cnt == 0)
+		return NULL;
+	if (cnt == 1)
+		return obj_target_get_unipath(neighs[0]);
+
+	/* deduplicate by the sorted set of neighbours */
+	for (struct obj_nexthop *nh = neighs[0]->nexthops; nh; nh = nh->n_next) {
+		t = nh->target;
+		if (t->nh_id == 0 && t->is_multipath && obj_target_has_neighs(t, neighs, cnt))
+			return t;
+	}
 
-	/* link target to the front of obj_neigh's linked list of targets */
-	t->n_next_target = n->targets;
-	n->targets = obj_target_ref(t);
+	t = obj_target_alloc();
+	t->is_multipath = true;
+	for (unsigned int i = 0; i < cnt; i++)
+		obj_target_link_nexthop(t, neighs[i]);
 
 	return t;
 }
@@ -81,19 +208,12 @@ static inline bool is_lladdr_zero(const uint8_t *lladdr)
 			lladdr[3] == 0 && lladdr[4] == 0 && lladdr[5] == 0);
 }
 
-static int obj_target_prepare_rule(struct obj_target *t, struct tc_rule *tcr)
+static int obj_target_prepare_rule(const struct obj_target *t, struct obj_neigh *n, struct tc_rule *tcr)
 {
-	struct obj_nexthop *nh = t->nexthop;
-
-	AN(nh);
-	struct obj_neigh *n = nh->neigh;
-
 	AN(n);
 	struct obj_link *l = n->link;
 
-	/* XXX check NUD state */
-
-	if (l->vlan_id == 0)
+	if (l == NULL || l->vlan_id == 0)
 		return false;
 
 	if (is_lladdr_zero(l->lladdr)) {
@@ -101,14 +221,17 @@ static int obj_target_prepare_rule(struct obj_target *t, struct tc_rule *tcr)
 		return false;
 	}
 
-	if (is_lladdr_zero(n->lladdr)) {
-		fr_printf(DEBUG2, "skipping, neigh lladdr is zero\n");
+	if (!obj_neigh_is_reachable(n) || is_lladdr_zero(n->lladdr)) {
+		fr_printf(DEBUG2, "skipping, neigh is unresolved\n");
+		/* only worth resolving if routes are waiting for it */
+		if (t->first_route)
+			obj_neigh_probe(n);
 		return false;
 	}
 
-	obj_target_print(t);
 	tc_rule_init(tcr);
 	tcr->vlan_id = l->vlan_id;
+	tcr->egress_ifindex = l->lower_ifindex; /* the device the vlan is on */
 	memcpy(&tcr->lladdr.src, &l->lladdr, 6);
 	memcpy(&tcr->lladdr.dst, &n->lladdr, 6);
 	tcr->af_addr.af = n->addr.af;
@@ -116,40 +239,146 @@ static int obj_target_prepare_rule(struct obj_target *t, struct tc_rule *tcr)
 	return true;
 }
 
-static void obj_target_set_rule(struct obj_target *t, struct tc_rule *tcr)
+/*
+ * prepare a forward rule per hash bucket, returns the number of buckets
+ *
+ * unusable nexthops are left out, with more usable nexthops than there
+ * are buckets, only the first ones are used, and when the nexthop count
+ * isn't a power of two, the first nexthops get an extra bucket
+ */
+static unsigned int obj_target_prepare_rules(struct obj_target *t, struct tc_rule *tcrs)
 {
-	if (t->rule) {
-		obj_rule_unset_target(t->rule);
-		obj_rule_unref(t->rule);
-		t->rule = NULL;
+	struct tc_rule members[OBJ_TARGET_MAX_BUCKETS];
+	unsigned int cnt = 0;
+	unsigned int buckets;
+
+	memset(members, '\0', sizeof(members));
+	for (struct obj_nexthop *nh = t->nexthop; nh && cnt < OBJ_TARGET_MAX_BUCKETS; nh = nh->next) {
+		if (obj_target_prepare_rule(t, nh->neigh, &members[cnt]))
+			cnt++;
 	}
-	if (tcr) {
-		t->rule = obj_rule_prime_request(tcr);
-		if (t->rule) {
-			obj_rule_set_target(t->rule, t);
-			obj_rule_queue_request(t->rule);
-		}
-	} else {
+
+	if (cnt <= 1) {
+		memcpy(&tcrs[0], &members[0], sizeof(struct tc_rule));
+		return cnt;
+	}
+
+	for (buckets = 2; buckets < cnt; buckets <<= 1)
+		;
+	for (unsigned int i = 0; i < buckets; i++) {
+		memcpy(&tcrs[i], &members[i % cnt], sizeof(struct tc_rule));
+		tc_rule_set_hash_bucket(&tcrs[i], buckets, i);
+	}
+	return buckets;
+}
+
+/*
+ * trap to the CPU when none of the nexthops are reachable, so the
+ * kernel can fail over, while the routes keep jumping to the chain
+ */
+static int obj_target_prepare_trap_rule(struct obj_target *t, struct tc_rule *tcr)
+{
+	for (struct obj_nexthop *nh = t->nexthop; nh; nh = nh->next) {
+		struct obj_link *l = nh->neigh->link;
+
+		if (l == NULL || l->vlan_id == 0)
+			continue;
+
+		tc_rule_init(tcr);
+		tcr->af_addr.af = nh->neigh->addr.af;
+		tc_rule_set_type_and_traits(tcr, TC_RULE_TYPE_FORWARD_TRAP);
+		return true;
+	}
+	return false;
+}
+
+static void obj_target_set_rules(struct obj_target *t, struct tc_rule *tcrs, unsigned int cnt)
+{
+	obj_target_drop_rules(t);
+	if (cnt == 0) {
 		obj_target_notify_routes(t);
+		return;
+	}
+
+	t->rule = obj_rule_prime_request(&tcrs[0]);
+	if (!t->rule)
+		return;
+	obj_rule_set_target(t->rule, t);
+
+	/* the other buckets go in the chain of the first bucket */
+	t->bucket_cnt = cnt;
+	for (unsigned int i = 1; i < cnt; i++) {
+		t->bucket_rule[i] = obj_rule_prime_request_in_chain(t->rule->chain_no, &tcrs[i]);
+		obj_rule_set_target(t->bucket_rule[i], t);
+	}
+
+	obj_rule_queue_request(t->rule);
+	for (unsigned int i = 1; i < cnt; i++)
+		obj_rule_queue_request(t->bucket_rule[i]);
+}
+
+/*
+ * rewrite the rules in the chain they already have, so the routes
+ * keep jumping to it, and a nexthop change costs a request per bucket
+ * instead of reinstalling every route
+ *
+ * new buckets are added before the existing ones get a wider mask,
+ * and surplus buckets are only dropped after the others cover them
+ */
+static void obj_target_update_rules(struct obj_target *t, struct tc_rule *tcrs, unsigned int cnt)
+{
+	unsigned int old_cnt = t->bucket_cnt;
+
+	AN(t->rule);
+	AN(old_cnt > 0);
+	for (unsigned int i = old_cnt; i < cnt; i++) {
+		t->bucket_rule[i] = obj_rule_prime_request_in_chain(t->rule->chain_no, &tcrs[i]);
+		obj_rule_set_target(t->bucket_rule[i], t);
+		obj_rule_queue_request(t->bucket_rule[i]);
 	}
+
+	obj_rule_replace_want(t->rule, &tcrs[0]);
+	for (unsigned int i = 1; i < cnt && i < old_cnt; i++)
+		obj_rule_replace_want(t->bucket_rule[i], &tcrs[i]);
+
+	for (unsigned int i = cnt; i < old_cnt; i++) {
+		obj_rule_unset_target(t->bucket_rule[i]);
+		obj_rule_unref(t->bucket_rule[i]);
+		t->bucket_rule[i] = NULL;
+	}
+	t->bucket_cnt = cnt;
 }
 
 static void obj_target_install(struct obj_target *t)
 {
-	obj_target_print(t);
-	struct tc_rule tcr = {0};
-	int ret = obj_target_prepare_rule(t, &tcr);
+	struct tc_rule tcrs[OBJ_TARGET_MAX_BUCKETS];
+	unsigned int cnt;
 
-	if (!ret)
+	memset(tcrs, '\0', sizeof(tcrs));
+	cnt = obj_target_prepare_rules(t, tcrs);
+	if (cnt == 0)
 		return;
-	tc_rule_print(&tcr);
-	obj_target_set_rule(t, &tcr);
+	obj_target_print(t);
+	tc_rule_print(&tcrs[0]);
+	obj_target_set_rules(t, tcrs, cnt);
+}
+
+int obj_target_is_ready(const struct obj_target *t)
+{
+	obj_assert_kind(t, TARGET);
+	if (!t->rule || !obj_rule_is_ok(t->rule))
+		return false;
+	for (unsigned int i = 1; i < t->bucket_cnt; i++) {
+		if (!obj_rule_is_ok(t->bucket_rule[i]))
+			return false;
+	}
+	return true;
 }
 
 void obj_target_notify_routes(struct obj_target *t)
 {
 	obj_assert_kind(t, TARGET);
-	if (t->rule && t->rule->state == OBJ_RULE_STATE_OK) {
+	if (obj_target_is_ready(t)) {
 		for (struct obj_route *r = t->first_route; r; r = r->t_next_route) {
 			AN(r->target == t);
 			obj_route_install(r);
@@ -160,21 +389,34 @@ void obj_target_notify_routes(struct obj_target *t)
 void obj_target_neigh_update(struct obj_target *t)
 {
 	obj_assert_kind(t, TARGET);
-	struct tc_rule new_tcr = {0};
-	int ret = obj_target_prepare_rule(t, &new_tcr);
-
-	if (ret) {
-		if (t->rule) {
-			struct tc_rule *current_tcr = t->rule->want;
-
-			if (current_tcr && memcmp(current_tcr, &new_tcr, sizeof(struct tc_rule)) != 0)
-				obj_target_set_rule(t, &new_tcr);
-		}
+	struct tc_rule new_tcrs[OBJ_TARGET_MAX_BUCKETS];
+	unsigned int cnt;
+
+	memset(new_tcrs, '\0', sizeof(new_tcrs));
+	cnt = obj_target_prepare_rules(t, new_tcrs);
+	if (cnt == 0 && t->rule && obj_target_prepare_trap_rule(t, &new_tcrs[0]))
+		cnt = 1;
+
+	if (cnt == 0) {
+		obj_target_set_rules(t, NULL, 0);
+	} else if (!t->rule) {
+		/* became usable after routes were linked */
+		if (t->first_route)
+			obj_target_set_rules(t, new_tcrs, cnt);
 	} else {
-		obj_target_set_rule(t, NULL);
+		obj_target_update_rules(t, new_tcrs, cnt);
 	}
 }
 
+void obj_target_neigh_gone(struct obj_nexthop *nh)
+{
+	struct obj_target *t = obj_target_ref(nh->target);
+
+	obj_target_unlink_nexthop(nh);
+	obj_target_neigh_update(t);
+	obj_target_unref(t);
+}
+
 void obj_target_link_route(struct obj_target *t, struct obj_route *r)
 {
 	obj_assert_kind(t, TARGET);
@@ -182,6 +424,7 @@ void obj_target_link_route(struct obj_target *t, struct obj_route *r)
 	AZ(r->target);
 	r->target = obj_target_weak_ref(t);
 	obj_route_ref(r);
+	r->t_prev_route = t->last_route;
 	if (t->last_route)
 		t->last_route->t_next_route = r;
 	else
@@ -201,31 +444,180 @@ void obj_target_unlink_route(struct obj_target *t, struct obj_route *r)
 	AN(r->target == t);
 	obj_target_weak_unref(r->target);
 	r->target = NULL;
-	struct obj_route **prev_ptr = &t->first_route;
-	struct obj_route *prev = NULL;
-
-	for (struct obj_route *rr = t->first_route; rr; rr = rr->t_next_route) {
-		if (rr == r) {
-			*prev_ptr = rr->t_next_route;
-			if (t->last_route == r)
-				t->last_route = prev;
-			r->t_next_route = NULL;
-			obj_route_unref(r);
-		} else {
-			prev = rr;
-			prev_ptr = &rr->t_next_route;
-		}
+
+	/* doubly linked, as targets can have most of the table */
+	if (r->t_prev_route)
+		r->t_prev_route->t_next_route = r->t_next_route;
+	else
+		t->first_route = r->t_next_route;
+	if (r->t_next_route)
+		r->t_next_route->t_prev_route = r->t_prev_route;
+	else
+		t->last_route = r->t_prev_route;
+	r->t_next_route = NULL;
+	r->t_prev_route = NULL;
+	obj_route_unref(r);
+
+	/* there are many possible nexthop sets, so only keep those in use */
+	if (t->is_multipath && !t->first_route) {
+		obj_target_drop_rules(t);
+		obj_target_unlink_nexthops(t);
 	}
 	obj_route_unref(r);
 	obj_target_unref(t);
 }
 
+struct obj_target *obj_target_nhid_lookup(const uint32_t nh_id)
+{
+	struct rb_node *node = obj_target_nh_tree.rb_node;
+	struct obj_target *this;
+
+	while (node) {
+		this = rb_container_of(node, struct obj_target, nh_node);
+		if (nh_id < this->nh_id)
+			node = node->rb_left;
+		else if (nh_id > this->nh_id)
+			node = node->rb_right;
+		else
+			return this;
+	}
+	return NULL;
+}
+
+static int obj_target_nhid_insert(struct obj_target *t)
+{
+	struct rb_node **new = &(obj_target_nh_tree.rb_node), *parent = NULL;
+	struct obj_target *this;
+
+	obj_assert_kind(t, TARGET);
+	AN(t->nh_id);
+
+	/* Figure out where to put new node */
+	while (*new) {
+		this = rb_container_of(*new, struct obj_target, nh_node);
+
+		parent = *new;
+		if (t->nh_id < this->nh_id)
+			new = &((*new)->rb_left);
+		else if (t->nh_id > this->nh_id)
+			new = &((*new)->rb_right);
+		else
+			return 0;
+	}
+
+	/* Add new node and rebalance tree. */
+	rb_link_node(&t->nh_node, parent, new);
+	rb_insert_color(&t->nh_node, &obj_target_nh_tree);
+
+	return 1;
+}
+
+/* re-point a nexthop object's target, the routes stay linked to it */
+static void obj_target_nhid_set_neighs(struct obj_target *t, struct obj_neigh **neighs, unsigned int cnt)
+{
+	AN(t->nh_id);
+	cnt = obj_target_sort_neighs(neighs, cnt);
+	if (obj_target_has_neighs(t, neighs, cnt))
+		return;
+
+	obj_target_ref(t);
+	obj_target_unlink_nexthops(t);
+	for (unsigned int i = 0; i < cnt; i++)
+		obj_target_link_nexthop(t, neighs[i]);
+	obj_target_neigh_update(t);
+	obj_target_unref(t);
+}
+
+static void obj_target_nhid_group_update(struct obj_target *t)
+{
+	struct obj_neigh **neighs = fr_malloc(sizeof(struct obj_neigh *) * (t->nh_grp_cnt + 1));
+	unsigned int cnt = 0;
+
+	/* TODO respect member weights */
+	for (unsigned int i = 0; i < t->nh_grp_cnt; i++) {
+		struct obj_target *member = obj_target_nhid_lookup(t->nh_grp[i]);
+
+		if (member && member->nexthop)
+			neighs[cnt++] = member->nexthop->neigh;
+	}
+	obj_target_nhid_set_neighs(t, neighs, cnt);
+	free(neighs);
+}
+
+static void obj_target_nhid_notify_groups(const uint32_t member_id)
+{
+	for (struct rb_node *node = rb_first(&obj_target_nh_tree); node; node = rb_next(node)) {
+		struct obj_target *t = rb_container_of(node, struct obj_target, nh_node);
+
+		for (unsigned int i = 0; i < t->nh_grp_cnt; i++) {
+			if (t->nh_grp[i] == member_id) {
+				obj_target_nhid_group_update(t);
+				break;
+			}
+		}
+	}
+}
+
+static void obj_target_nhid_delete(struct obj_target *t)
+{
+	uint32_t nh_id = t->nh_id;
+
+	obj_target_ref(t);
+	rb_erase(&t->nh_node, &obj_target_nh_tree);
+	obj_target_unref(t);
+
+	/* the kernel flushes routes using a deleted nexthop silently */
+	for (struct obj_route *r = t->first_route, *nr; r; r = nr) {
+		nr = r->t_next_route;
+		obj_route_netlink_update(RTM_DELROUTE, t, &r->dst);
+	}
+	obj_target_nhid_set_neighs(t, NULL, 0);
+	obj_target_unref(t);
+
+	obj_target_nhid_notify_groups(nh_id);
+}
+
+void obj_target_nhid_netlink_update(const uint16_t nlmsg_type, const uint32_t nh_id, struct obj_neigh *n, const uint32_t *grp, const unsigned int grp_cnt)
+{
+	struct obj_target *t = obj_target_nhid_lookup(nh_id);
+
+	if (nlmsg_type == RTM_DELNEXTHOP) {
+		if (t)
+			obj_target_nhid_delete(t);
+		return;
+	}
+
+	if (!t) {
+		t = obj_target_alloc();
+		t->nh_id = nh_id;
+		obj_target_nhid_insert(obj_target_ref(t));
+	}
+
+	obj_target_ref(t);
+	free(t->nh_grp);
+	t->nh_grp = NULL;
+	t->nh_grp_cnt = 0;
+	if (grp_cnt > 0) {
+		t->nh_grp = fr_malloc(sizeof(uint32_t) * grp_cnt);
+		memcpy(t->nh_grp, grp, sizeof(uint32_t) * grp_cnt);
+		t->nh_grp_cnt = grp_cnt;
+		obj_target_nhid_group_update(t);
+	} else {
+		obj_target_nhid_set_neighs(t, &n, n ? 1 : 0);
+		obj_target_nhid_notify_groups(nh_id);
+	}
+	obj_target_unref(t);
+}
+
 void obj_target_print(struct obj_target *t)
 {
 	obj_assert_kind(t, TARGET);
-	fr_printf(INFO, "obj_target\t%p\t%d\t%s\n", (void *) t,
-			t->nexthop->neigh->link->vlan_id,
-			t->nexthop->neigh->link->ifname);
-	//print_lladdr(&t->nexthop->neigh->lladdr);
-	print_af_addr(&t->nexthop->neigh->addr);
+	fr_printf(INFO, "obj_target\t%p\tnhid %"PRIu32"\t%u nexthops\n", (void *) t, t->nh_id, t->nexthop_cnt);
+	for (struct obj_nexthop *nh = t->nexthop; nh; nh = nh->next) {
+		struct obj_link *l = nh->neigh->link;
+
+		if (l)
+			fr_printf(INFO, "\t%d\t%s\t", l->vlan_id, l->ifname);
+		print_af_addr(&nh->neigh->addr);
+	}
 }
@@ -5,6 +5,7 @@
 struct obj_target *obj_target_find(const union some_in_addr *nh, const int oif);
 struct obj_target *obj_target_netlink_find(const int oif, uint8_t af, const union some_in_addr *nh);
 struct obj_target *obj_target_get_unipath(struct obj_neigh *n);
+struct obj_target *obj_target_get_multipath(struct obj_neigh **neighs, unsigned int cnt);
 struct obj_target *obj_target_ref(struct obj_target *t);
 void obj_target_unref(struct obj_target *n);
 struct obj_target *obj_target_weak_ref(struct obj_target *t);
@@ -14,4 +15,8 @@ void obj_target_unlink_route(struct obj_target *t, struct obj_route *r);
 void obj_target_print(struct obj_target *t);
 void obj_target_neigh_update(struct obj_target *t);
 void obj_target_notify_routes(struct obj_target *t);
+int obj_target_is_ready(const struct obj_target *t);
 int obj_target_count(void);
+struct obj_target *obj_target_nhid_lookup(const uint32_t nh_id);
+void obj_target_nhid_netlink_update(const uint16_t nlmsg_type, const uint32_t nh_id, struct obj_neigh *n, const uint32_t *grp, const unsigned int grp_cnt);
+void obj_target_neigh_gone(struct obj_nexthop *nh);
@@ -36,6 +36,15 @@ static struct option long_options[] = {
 	{"skip-hw",        no_argument,       0,  2  },
 	{"skip_hw",        no_argument,       0,  2  },
 	{"version",        no_argument,       0,  3  },
+	{"coalesce",       required_argument, 0,  4  },
+	{"full-scans",     no_argument,       0,  5  },
+	{"no-tc-monitor",  no_argument,       0,  6  },
+	{"flush",          no_argument,       0,  7  },
+	{"flush-on-exit",  no_argument,       0,  8  },
+	{"block",          required_argument, 0,  9  },
+	{"metrics-file",   required_argument, 0, 10  },
+	{"capture",        required_argument, 0, 11  },
+	{"metrics-interval", required_argument, 0, 12 },
 	{0,                0,                 0,  0  }
 };
 static const char short_options[] = "i:t:p:P:s:T:vh1";
@@ -51,7 +60,7 @@ static void show_help(FILE *f)
 	fprintf(f, "     (Currently only tested on Connect-X 5 and 6 Dx)\n");
 	fprintf(f, "\n");
 	fprintf(f, "Options:\n");
-	fprintf(f, "\t-i, --iface <iface>               install offload rules on interface\n");
+	fprintf(f, "\t-i, --iface <iface>               install offload rules on interface (repeatable)\n");
 	fprintf(f, "\t-t, --table <table>               routing table to syncronize with\n");
 	fprintf(f, "\t-p, --add-prefix <list> <prefix>  add static prefix\n");
 	fprintf(f, "\t-P, --load-prefix <list> <file>   load static prefixes from file\n");
@@ -59,7 +68,16 @@ static void show_help(FILE *f)
 	fprintf(f, "\t-T, --timeout <secs>              run for <n> seconds, and then exit\n");
 	fprintf(f, "\t-1, --one-off                     just sync once, and then exit\n");
 	fprintf(f, "\t    --skip-hw                     for testing without hardware\n");
-	fprintf(f, "\t    --dry-run                     don't make any changes to TC\n");
+	fprintf(f, "\t    --dry-run                     don't make any changes to TC, report what would change\n");
+	fprintf(f, "\t    --coalesce <msecs>            hold route updates, to merge flaps (dft: 0)\n");
+	fprintf(f, "\t    --full-scans                  always dump filters in full, not tersely\n");
+	fprintf(f, "\t    --no-tc-monitor               don't listen for TC events, rely on scans\n");
+	fprintf(f, "\t    --flush                       remove existing rules, and start afresh\n");
+	fprintf(f, "\t    --flush-on-exit               remove all rules, before exiting\n");
+	fprintf(f, "\t    --block <index>               install rules once, in a TC block shared by the interfaces\n");
+	fprintf(f, "\t    --metrics-file <file>         write metrics to <file>, in Prometheus' text format\n");
+	fprintf(f, "\t    --metrics-interval <secs>     time between metrics writes (dft: 5s)\n");
+	fprintf(f, "\t    --capture <file>              write received netlink messages to <file>, as pcap\n");
 	fprintf(f, "\t-v, --verbose                     increase verbosity\n");
 	fprintf(f, "\t    --version                     show version\n");
 	fprintf(f, "\t-h, --help                        show this help text\n");
@@ -95,7 +113,7 @@ static void validate_options(void)
 	if (config->table_id == 0)
 		bail("missing --table argument");
 
-	if (config->ifidx == 0)
+	if (config->if_cnt == 0)
 		bail("missing --iface argument");
 }
 
@@ -146,13 +164,16 @@ void options_parse(const int argc, char **argv)
 				bail("unknown routing table %s", optarg);
 			break;
 		case 'i':
-			if (config->ifname != NULL)
-				bail("interface should only be specified once");
-			config->ifidx = if_nametoindex(optarg);
-			if (config->ifidx != 0)
-				config->ifname = strdup(optarg);
-			else
+			if (config->if_cnt == CONFIG_MAX_IFACES)
+				bail("too many interfaces, max. %d", CONFIG_MAX_IFACES);
+			val = if_nametoindex(optarg);
+			if (val == 0)
 				bail("invalid interface: %s", optarg);
+			if (config_if_lookup(val) >= 0)
+				bail("interface specified twice: %s", optarg);
+			config->ifidx[config->if_cnt] = val;
+			config->ifname[config->if_cnt] = strdup(optarg);
+			config->if_cnt++;
 			break;
 		case 'p':
 			optarg2 = get_second_argument(argc, argv);
@@ -190,7 +211,7 @@ void options_parse(const int argc, char **argv)
 			run_mode = SHOW_HELP;
 			break;
 		case 1: /* dry-run */
-			config->dry_run = true; // XXX make sure dry_run is followed
+			config->dry_run = true;
 			break;
 		case 2: /* skip hw */
 			config->flower_flags = TCA_CLS_FLAGS_SKIP_HW;
@@ -198,6 +219,52 @@ void options_parse(const int argc, char **argv)
 		case 3: /* version */
 			run_mode = SHOW_VERSION;
 			break;
+		case 4: /* coalesce */
+			val = strtol(optarg, &endptr, 10);
+			if (endptr[0] != '\0')
+				bail("invalid argument: '%s'", optarg);
+			if (val < 0 || val > 60000)
+				bail("coalesce: out of bounds");
+			config->coalesce_ms = val;
+			break;
+		case 5: /* full-scans */
+			config->full_scans = true;
+			break;
+		case 6: /* no-tc-monitor */
+			config->no_tc_monitor = true;
+			break;
+		case 7: /* flush */
+			config->flush = true;
+			break;
+		case 8: /* flush-on-exit */
+			config->flush_on_exit = true;
+			break;
+		case 9: /* block */
+			val = strtol(optarg, &endptr, 10);
+			if (endptr[0] != '\0')
+				bail("invalid argument: '%s'", optarg);
+			if (val <= 0 || val > UINT32_MAX)
+				bail("block: out of bounds");
+			config->block_index = val;
+			break;
+		case 10: /* metrics-file */
+			if (config->metrics_file != NULL)
+				bail("metrics-file should only be specified once");
+			config->metrics_file = strdup(optarg);
+			break;
+		case 11: /* capture */
+			if (config->capture_file != NULL)
+				bail("capture should only be specified once");
+			config->capture_file = strdup(optarg);
+			break;
+		case 12: /* metrics-interval */
+			val = strtol(optarg, &endptr, 10);
+			if (endptr[0] != '\0')
+				bail("invalid argument: '%s'", optarg);
+			if (val <= 0 || val > 3600)
+				bail("metrics-interval: out of bounds");
+			config->metrics_interval = val;
+			break;
 		default:
 			bail(NULL);
 		}
@@ -9,34 +9,57 @@
 #include "nl_queue.h"
 
 #include "obj_rule.h"
+#include "coalesce.h"
+#include "trace.h"
+#include "tc_dry_run.h"
 
 #include "scan.h"
 
 enum scan_state {
 	SCAN_NEW,
+	SCAN_BIND_BLOCK,
 	SCAN_RUN_HELPERS,
 	SCAN_DUMP_CHAINS,
 	SCAN_DUMP_EACH_CHAIN_INIT,
 	SCAN_DUMP_EACH_CHAIN,
+	SCAN_VERIFY_CHAIN,
+	SCAN_FLUSH,
 	SCAN_DONE,
 	SCAN_WAIT,
 };
 
 struct scan {
 	struct conn c;
+	struct conn ic; /* for the install lane */
 	enum scan_state state;
 	int helper_idx;
+	int terse; /* verify chains with terse dumps */
+	int flushed; /* the initial flush is done */
+	int modelled; /* the filters have been dumped into the dry-run model */
 	struct rb_node *next_chain;
+	unsigned int next_dev;
+	unsigned int q_dev;
 	uint32_t q_chain_no;
+	unsigned int q_stat; /* index into scan_stats, of the dump in flight */
+	ev_tstamp q_started;
+	uint64_t q_rx_bytes;
+	ev_tstamp started;
 	ev_timer timer;
 };
 
 static void scan_links(EV_P_ void *data) { struct scan *s = data; nl_dump_link(EV_A_ &s->c); }
 static void scan_neigh4(EV_P_ void *data) { struct scan *s = data; nl_dump_neigh(EV_A_ &s->c, AF_INET); }
 static void scan_neigh6(EV_P_ void *data) { struct scan *s = data; nl_dump_neigh(EV_A_ &s->c, AF_INET6); }
+static void scan_nexthops(EV_P_ void *data) { struct scan *s = data; nl_dump_nexthop(EV_A_ &s->c); }
 static void scan_route4(EV_P_ void *data) { struct scan *s = data; nl_dump_route(EV_A_ &s->c, AF_INET); }
 static void scan_route6(EV_P_ void *data) { struct scan *s = data; nl_dump_route(EV_A_ &s->c, AF_INET6); }
-static void scan_chains(EV_P_ void *data) { struct scan *s = data; filter_dump_chains(EV_A_ &s->c); }
+
+static void scan_bind_block(EV_P_ void *data)
+{
+	struct scan *s = data;
+
+	filter_bind_block(EV_A_ &s->c, s->q_dev);
+}
 
 static void scan_break(EV_P_ void *data)
 {
@@ -44,11 +67,11 @@ static void scan_break(EV_P_ void *data)
 	ev_break(EV_A_ EVBREAK_ALL);
 }
 
-static void scan_chain(EV_P_ void *data)
+static void scan_dry_run_report(EV_P_ void *data)
 {
-	struct scan *s = data;
-
-	filter_dump_chain(EV_A_ &s->c, s->q_chain_no);
+	fr_ev_unused();
+	fr_unused(data);
+	tc_dry_run_report(stdout);
 }
 
 static void scan_filters(EV_P_ void *data)
@@ -56,19 +79,120 @@ static void scan_filters(EV_P_ void *data)
 	struct scan *s = data;
 
 	filter_dump(EV_A_ &s->c);
+	s->modelled = config->dry_run;
+	s->next_dev = 0;
 	s->state = SCAN_DUMP_CHAINS;
 }
 
-static void (*scan_helpers[])(EV_P_ void *data) = {
-	scan_filters,
-	scan_links,
-	scan_neigh4,
-	scan_neigh6,
-	scan_route4,
-	scan_route6,
-	NULL
+static const struct scan_helper {
+	const char *name;
+	void (*fn)(EV_P_ void *data);
+} scan_helpers[] = {
+	{ "filters",  scan_filters },
+	{ "links",    scan_links },
+	{ "neigh4",   scan_neigh4 },
+	{ "neigh6",   scan_neigh6 },
+	{ "nexthops", scan_nexthops }, /* before routes, as they may reference nexthop ids */
+	{ "route4",   scan_route4 },
+	{ "route6",   scan_route6 },
+	{ NULL,       NULL }
 };
 
+#define SCAN_HELPER_CNT (sizeof(scan_helpers) / sizeof(scan_helpers[0]) - 1)
+#define SCAN_STAT_CHAINS SCAN_HELPER_CNT /* all chain dumps together */
+#define SCAN_STAT_TOTAL (SCAN_HELPER_CNT + 1) /* the whole scan */
+#define SCAN_STAT_CNT (SCAN_HELPER_CNT + 2)
+
+/* of the scan in progress, and of the last complete one */
+static struct scan_stats scan_stats_cur[SCAN_STAT_CNT];
+static struct scan_stats scan_stats_last[SCAN_STAT_CNT];
+
+static void scan_stat_begin(struct scan *s, const unsigned int idx)
+{
+	AN(idx < SCAN_STAT_TOTAL);
+	s->q_stat = idx;
+	s->q_started = ev_time();
+	s->q_rx_bytes = s->c.rx_bytes;
+}
+
+static void scan_stat_end(struct scan *s)
+{
+	struct scan_stats *st = &scan_stats_cur[s->q_stat];
+
+	st->dumps++;
+	st->duration += ev_time() - s->q_started;
+	st->rx_bytes += s->c.rx_bytes - s->q_rx_bytes;
+}
+
+static void scan_stats_reset(struct scan *s)
+{
+	memset(scan_stats_cur, '\0', sizeof(scan_stats_cur));
+	s->started = ev_time();
+}
+
+static void scan_stats_done(struct scan *s)
+{
+	struct scan_stats *total = &scan_stats_cur[SCAN_STAT_TOTAL];
+
+	for (unsigned int i = 0; i < SCAN_STAT_TOTAL; i++) {
+		total->dumps += scan_stats_cur[i].dumps;
+		total->rx_bytes += scan_stats_cur[i].rx_bytes;
+	}
+	total->duration = ev_time() - s->started;
+	memcpy(scan_stats_last, scan_stats_cur, sizeof(scan_stats_last));
+}
+
+const char *scan_stats_name(const unsigned int idx)
+{
+	if (idx < SCAN_HELPER_CNT)
+		return scan_helpers[idx].name;
+	if (idx == SCAN_STAT_CHAINS)
+		return "chains";
+	if (idx == SCAN_STAT_TOTAL)
+		return "total";
+	return NULL;
+}
+
+/* NULL past the last one */
+const struct scan_stats *scan_get_stats(const unsigned int idx)
+{
+	if (idx >= SCAN_STAT_CNT)
+		return NULL;
+	return &scan_stats_last[idx];
+}
+
+static void scan_chains(EV_P_ void *data)
+{
+	struct scan *s = data;
+
+	scan_stat_begin(s, SCAN_STAT_CHAINS);
+	filter_dump_chains(EV_A_ &s->c, s->q_dev);
+}
+
+static void scan_chain(EV_P_ void *data)
+{
+	struct scan *s = data;
+
+	scan_stat_begin(s, SCAN_STAT_CHAINS);
+	filter_dump_chain(EV_A_ &s->c, s->q_dev, s->q_chain_no, false);
+}
+
+static void scan_chain_terse(EV_P_ void *data)
+{
+	struct scan *s = data;
+
+	scan_stat_begin(s, SCAN_STAT_CHAINS);
+	filter_dump_chain(EV_A_ &s->c, s->q_dev, s->q_chain_no, true);
+}
+
+static void scan_run_helper(EV_P_ void *data)
+{
+	struct scan *s = data;
+
+	scan_stat_begin(s, s->helper_idx);
+	scan_helpers[s->helper_idx].fn(EV_A_ data);
+}
+
 static void advance_scan(EV_P_ struct scan *s);
 
 static void scan_timeout_cb(EV_P_ ev_timer *w, int revents)
@@ -85,6 +209,13 @@ static void scan_timeout_cb(EV_P_ ev_timer *w, int revents)
 	advance_scan(EV_A_ s);
 }
 
+static void scan_flushed_cb(void *data)
+{
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+
+	advance_scan(EV_A_ data);
+}
+
 static void advance_scan_cb(EV_P_ void *data, int nl_errno)
 {
 	fr_unused(nl_errno);
@@ -93,6 +224,34 @@ static void advance_scan_cb(EV_P_ void *data, int nl_errno)
 	advance_scan(EV_A_ s);
 }
 
+/* a helper, or a chain dump, has completed */
+static void scan_dumped_cb(EV_P_ void *data, int nl_errno)
+{
+	struct scan *s = data;
+
+	scan_stat_end(s);
+	advance_scan_cb(EV_A_ data, nl_errno);
+}
+
+static void scan_helper_done_cb(EV_P_ void *data, int nl_errno)
+{
+	struct scan *s = data;
+
+	s->helper_idx++;
+	scan_dumped_cb(EV_A_ data, nl_errno);
+}
+
+/* an existing clsact qdisc is checked, once the qdiscs have been dumped */
+static void scan_bound_cb(EV_P_ void *data, int nl_errno)
+{
+	struct scan *s = data;
+
+	if (nl_errno != 0 && nl_errno != EEXIST)
+		fr_printf(ERROR, "%s: binding to block %"PRIu32" failed: %s\n",
+			  config->ifname[s->q_dev], config->block_index, strerror(nl_errno));
+	advance_scan(EV_A_ s);
+}
+
 static void advance_scan(EV_P_ struct scan *s)
 {
 	struct chain *ch;
@@ -102,28 +261,53 @@ static void advance_scan(EV_P_ struct scan *s)
 		switch (s->state) {
 		case SCAN_NEW:
 			nl_conn_open(0, &s->c, "scan");
-			queue_init(&s->c);
-			s->state = SCAN_RUN_HELPERS;
-			/* fall-through */
+			queue_init(QUEUE_LANE_DUMP, &s->c);
+			nl_conn_open(0, &s->ic, "install");
+			queue_init(QUEUE_LANE_INSTALL, &s->ic);
+			s->state = config->block_index && !config->dry_run ? SCAN_BIND_BLOCK : SCAN_RUN_HELPERS;
+			break;
+		case SCAN_BIND_BLOCK:
+			fr_printf(DEBUG2, "SCAN_BIND_BLOCK\n");
+			s->q_dev = s->next_dev++;
+			if (s->next_dev >= config->if_cnt)
+				s->state = SCAN_RUN_HELPERS;
+			queue_schedule(EV_A_ scan_bind_block, scan_bound_cb, s);
+			return;
 		case SCAN_RUN_HELPERS:
 			fr_printf(DEBUG2, "SCAN_RUN_HELPERS\n");
-			void (*helper)(EV_P_ void *data) = scan_helpers[s->helper_idx];
-
-			if (helper != NULL) {
-				queue_schedule(EV_A_ helper, advance_scan_cb, s);
-				s->helper_idx++;
+			if (s->helper_idx == 0) {
+				scan_stats_reset(s);
+				/* the kernel doesn't have what would have changed since */
+				if (s->modelled)
+					s->helper_idx++;
+			}
+			if (scan_helpers[s->helper_idx].fn != NULL) {
+				/* the index is bumped on completion, as it may run right away */
+				queue_schedule(EV_A_ scan_run_helper, scan_helper_done_cb, s);
 				return;
 			}
 			s->helper_idx = 0;
+			s->state = config->flush && !s->flushed ? SCAN_FLUSH : SCAN_DONE;
+			break;
+		case SCAN_FLUSH:
+			fr_printf(DEBUG2, "SCAN_FLUSH\n");
+			/* still pinned, so the sweep doesn't re-install anything yet */
+			s->flushed = true;
 			s->state = SCAN_DONE;
+			if (obj_rule_flush(scan_flushed_cb, s) > 0)
+				return;
 			break;
 		case SCAN_DUMP_CHAINS:
 			fr_printf(DEBUG2, "SCAN_DUMP_CHAINS\n");
-			s->state = SCAN_DUMP_EACH_CHAIN_INIT;
-			queue_schedule(EV_A_ scan_chains, advance_scan_cb, s);
+			/* the chains of all devices end up in the same tree */
+			s->q_dev = s->next_dev++;
+			if (s->next_dev >= filter_dev_cnt())
+				s->state = SCAN_DUMP_EACH_CHAIN_INIT;
+			queue_schedule(EV_A_ scan_chains, scan_dumped_cb, s);
 			return;
 		case SCAN_DUMP_EACH_CHAIN_INIT:
 			fr_printf(DEBUG2, "SCAN_DUMP_EACH_CHAIN_INIT\n");
+			s->next_dev = 0;
 			s->next_chain = rb_first(&chain_tree);
 			s->state = s->next_chain == NULL ? SCAN_RUN_HELPERS : SCAN_DUMP_EACH_CHAIN;
 			break;
@@ -131,25 +315,50 @@ static void advance_scan(EV_P_ struct scan *s)
 			fr_printf(DEBUG2, "SCAN_DUMP_EACH_CHAIN\n");
 			AN(s->next_chain);
 			ch = rb_container_of(s->next_chain, struct chain, node);
-			fr_printf(DEBUG2, "dumping chain: %"PRIu32"\n", ch->chain_no);
+			fr_printf(DEBUG2, "dumping chain: %"PRIu32" on %s\n", ch->chain_no, filter_dev_name(s->next_dev));
+			s->q_dev = s->next_dev;
 			s->q_chain_no = ch->chain_no;
-			queue_schedule(EV_A_ scan_chain, advance_scan_cb, s);
+			queue_schedule(EV_A_ s->terse ? scan_chain_terse : scan_chain, scan_dumped_cb, s);
 
+			/* every chain, on each device in turn */
 			s->next_chain = rb_next(s->next_chain);
-			if (s->next_chain == NULL)
+			if (s->next_chain == NULL && ++s->next_dev < filter_dev_cnt())
+				s->next_chain = rb_first(&chain_tree);
+			if (s->terse)
+				s->state = SCAN_VERIFY_CHAIN;
+			else if (s->next_chain == NULL)
 				s->state = SCAN_RUN_HELPERS;
 			return;
+		case SCAN_VERIFY_CHAIN:
+			fr_printf(DEBUG2, "SCAN_VERIFY_CHAIN\n");
+			s->state = s->next_chain == NULL ? SCAN_RUN_HELPERS : SCAN_DUMP_EACH_CHAIN;
+			if (obj_rule_terse_verify(s->q_dev, s->q_chain_no)) {
+				fr_printf(INFO, "chain %"PRIu32" on %s doesn't match, dumping it in full\n",
+					  s->q_chain_no, filter_dev_name(s->q_dev));
+				queue_schedule(EV_A_ scan_chain, scan_dumped_cb, s);
+				return;
+			}
+			break;
 		case SCAN_DONE:
 			fr_printf(DEBUG2, "SCAN_DONE\n");
+			scan_stats_done(s);
+			coalesce_flush(EV_A);
 			obj_rule_remove_pin();
-			obj_rule_print_all();
+			obj_rule_print_hw_report();
+			queue_stats_print();
+			trace_print();
+			/* the first scan is in full, later ones only need to verify */
+			s->terse = !config->full_scans;
 			s->state = SCAN_WAIT;
 			break;
 		case SCAN_WAIT:
 			fr_printf(DEBUG2, "SCAN_WAIT\n");
 
+			/* after the rule changes, that were queued at SCAN_DONE */
+			if (config->dry_run)
+				queue_schedule_in(EV_A_ QUEUE_LANE_INSTALL, QUEUE_CLASS_BULK, QUEUE_KIND_OTHER, scan_dry_run_report, NULL, NULL);
 			if (config->exit_after_first_sync)
-				queue_schedule(EV_A_ scan_break, NULL, NULL);
+				queue_schedule_in(EV_A_ QUEUE_LANE_INSTALL, QUEUE_CLASS_BULK, QUEUE_KIND_OTHER, scan_break, NULL, NULL);
 
 			ev_timer_again(EV_A_ &s->timer);
 			return;
@@ -168,13 +377,15 @@ void scan_init(EV_P)
 
 void scan_fini(EV_P)
 {
-	struct conn *c = queue_get_conn();
+	struct conn *c = queue_get_conn(QUEUE_LANE_DUMP);
 	struct scan *s = rb_container_of(c, struct scan, c);
 
-	queue_fini();
+	queue_fini(QUEUE_LANE_DUMP);
+	queue_fini(QUEUE_LANE_INSTALL);
 	if (s) {
 		ev_timer_stop(EV_A_ &s->timer);
 		nl_conn_close(EV_A_ c);
+		nl_conn_close(EV_A_ &s->ic);
 		free(s);
 	}
 }
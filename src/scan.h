@@ -4,3 +4,13 @@
 
 void scan_init(EV_P);
 void scan_fini(EV_P);
+
+/* of the last complete scan, per helper */
+struct scan_stats {
+	unsigned int dumps;
+	ev_tstamp duration; /* summed, from sending until done */
+	uint64_t rx_bytes;
+};
+
+const struct scan_stats *scan_get_stats(const unsigned int idx);
+const char *scan_stats_name(const unsigned int idx);
@@ -76,6 +76,10 @@ static void sched_basic_place_prefix_list(const uint16_t base_prio, const char *
 		uint32_t chain_no = get_af_chain(pfx->addr.af);
 		uint16_t prio = obj_rule_find_available_prio(chain_no, base_prio);
 
+		if (prio == 0) {
+			fr_printf(ERROR, "sched_basic: chain %"PRIu32" is full\n", chain_no);
+			return;
+		}
 		request_onload_rule(chain_no, prio, &pfx->addr);
 	}
 }
@@ -98,18 +102,23 @@ static int sched_basic_place(const struct tc_rule *tcr, uint32_t *chain_no, uint
 {
 	switch (tcr->type) {
 	case TC_RULE_TYPE_FORWARD:
+	case TC_RULE_TYPE_FORWARD_TRAP:
 		*prio = 1;
 		*chain_no = filter_find_available_chain_no(5);
-		fr_printf(INFO, "filter_find_available_chain_no: %d\n", *chain_no);
+		fr_printf_ratelimited(INFO, "filter_find_available_chain_no: %d\n", *chain_no);
 		return true;
 	case TC_RULE_TYPE_ROUTE_GOTO:
 		*chain_no = get_af_chain(tcr->af_addr.af);
 		*prio = obj_rule_find_available_prio(*chain_no, 100);
-		AN(*prio >= 100);
-		fr_printf(INFO, "obj_rule_find_available_prio: %d\n", *prio);
+		if (*prio == 0) {
+			/* the route stays in software */
+			fr_printf(DEBUG1, "sched_basic: chain %"PRIu32" is full\n", *chain_no);
+			return false;
+		}
+		fr_printf_ratelimited(INFO, "obj_rule_find_available_prio: %d\n", *prio);
 		return true;
 	default:
-		fr_printf(INFO, "sched_basic: failed to place rule\n");
+		fr_printf_ratelimited(INFO, "sched_basic: failed to place rule\n");
 		break;
 	}
 	return false;
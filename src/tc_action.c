@@ -6,32 +6,29 @@
 #include "nl_send.h"
 
 struct tc_action {
+	unsigned int dev; /* index into config->ifidx */
 	uint32_t chain_no;
 	uint16_t prio;
 	struct tc_rule *tcr;
+	int flags;
+	int is_flush; /* every rule in the chain */
+	int nl_errno; /* if it couldn't be sent */
 	void *data;
 };
 
-static void tc_action_do_install(EV_P_ const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr)
+static int tc_action_do_install(EV_P_ const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, int flags)
 {
 	char buf[MNL_SOCKET_DUMP_SIZE];
-	struct conn *c = queue_get_conn();
+	struct conn *c = queue_get_conn(QUEUE_LANE_INSTALL);
 	struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
 
-	tc_encode_rule(nlh, chain_no, prio, tcr, NO_TCE_FLAGS);
-	AZ(config->dry_run);
-	nl_send_req(EV_A_ c, nlh);
-}
-
-static void tc_action_do_install_dry_run(EV_P_ const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr)
-{
-	char buf[MNL_SOCKET_DUMP_SIZE];
-	struct conn *c = queue_get_conn();
-	struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
-
-	tc_encode_rule(nlh, chain_no, prio, tcr, NO_TCE_FLAGS);
-	AZ(config->dry_run);
-	nl_send_req(EV_A_ c, nlh);
+	/* the kernel echoes the result back to us, ahead of the ACK,
+	 * so it is decoded into have before the request completes */
+	tc_encode_rule(nlh, dev, chain_no, prio, tcr, flags | TCE_FLAG_ECHO);
+	AZ(config->dry_run); /* see tc_dry_run.c */
+	if (nl_send_req(EV_A_ c, nlh) < 0)
+		return errno;
+	return 0;
 }
 
 static struct tc_action_callbacks tacb = {
@@ -48,10 +45,10 @@ static void tc_action_execute(EV_P_ void *data)
 	struct tc_action *tca = data;
 
 	AN(tacb.install);
-	if (tacb.pre_install)
+	if (tacb.pre_install && !tca->is_flush)
 		tacb.pre_install(tca->data);
-	tacb.install(EV_A_ tca->chain_no, tca->prio, tca->tcr);
-	if (tacb.post_install)
+	tca->nl_errno = tacb.install(EV_A_ tca->dev, tca->chain_no, tca->prio, tca->tcr, tca->flags);
+	if (tacb.post_install && !tca->is_flush)
 		tacb.post_install(tca->data);
 }
 
@@ -59,20 +56,71 @@ static void tc_action_done(EV_P_ void *data, const int nl_errno)
 {
 	struct tc_action *tca = data;
 
-	if (tacb.done)
-		tacb.done(tca->data, nl_errno);
+	if (tca->is_flush) {
+		if (tacb.flushed)
+			tacb.flushed(tca->dev, tca->chain_no, tca->data, nl_errno != 0 ? nl_errno : tca->nl_errno);
+	} else if (nl_errno == ECANCELED) {
+		if (tacb.cancelled)
+			tacb.cancelled(tca->data);
+	} else if (tacb.done) {
+		tacb.done(tca->data, nl_errno != 0 ? nl_errno : tca->nl_errno);
+	}
 	free(tca);
 }
 
-void tc_action_install(const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, void *data)
+/* there is only one rule per position, so a later request supersedes */
+static uint64_t tc_action_key(const unsigned int dev, const uint32_t chain_no, const uint16_t prio)
+{
+	return ((uint64_t) dev << 48) | ((uint64_t) chain_no << 16) | prio;
+}
+
+static enum queue_kind tc_action_kind(const struct tc_rule *tcr, const int flags)
+{
+	if (tcr == NULL)
+		return QUEUE_KIND_UNINSTALL;
+	if (flags & TCE_FLAG_REPLACE)
+		return QUEUE_KIND_REPLACE;
+	return QUEUE_KIND_INSTALL;
+}
+
+static void tc_action_schedule(const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, int flags, const int is_flush, const enum queue_class cls, void *data)
 {
 	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
 	struct tc_action *tca = fr_malloc(sizeof(struct tc_action));
 
+	tca->dev = dev;
 	tca->chain_no = chain_no;
 	tca->prio = prio;
 	tca->tcr = tcr;
+	tca->flags = flags;
+	tca->is_flush = is_flush;
 	tca->data = data;
 
-	queue_schedule(EV_A_ tc_action_execute, tc_action_done, tca);
+	queue_schedule_keyed(EV_A_ QUEUE_LANE_INSTALL, cls, tc_action_kind(tcr, flags), tc_action_key(dev, chain_no, prio), tc_action_execute, tc_action_done, tca);
+}
+
+void tc_action_install(const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, const enum queue_class cls, void *data)
+{
+	tc_action_schedule(dev, chain_no, prio, tcr, NO_TCE_FLAGS, false, cls, data);
+}
+
+/* overwrite the rule at (chain_no, prio) in a single request */
+void tc_action_replace(const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, const enum queue_class cls, void *data)
+{
+	AN(tcr);
+	tc_action_schedule(dev, chain_no, prio, tcr, TCE_FLAG_REPLACE, false, cls, data);
+}
+
+/* delete every rule in the chain in a single request, prio 0 matches all */
+void tc_action_flush_chain(const unsigned int dev, const uint32_t chain_no, const enum queue_class cls, void *data)
+{
+	tc_action_schedule(dev, chain_no, 0, NULL, NO_TCE_FLAGS, true, cls, data);
+}
+
+/* cancel an unsent request, returns true if there was one */
+int tc_action_cancel(const unsigned int dev, const uint32_t chain_no, const uint16_t prio)
+{
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+
+	return queue_cancel(EV_A_ QUEUE_LANE_INSTALL, tc_action_key(dev, chain_no, prio));
 }
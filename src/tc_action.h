@@ -2,14 +2,20 @@
 
 #include "common.h"
 #include "tc_rule.h"
+#include "nl_queue.h"
 
 struct tc_action_callbacks {
-	void (*install)(EV_P_ const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr);
+	int (*install)(EV_P_ const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, int flags); /* 0 or errno */
 	void (*pre_install)(void *data);
 	void (*post_install)(void *data);
-	void (*done)(void *data, const int nl_errno);
+	void (*done)(void *data, const int nl_errno); /* 0 or errno */
+	void (*cancelled)(void *data); /* superseded before it was sent */
+	void (*flushed)(const unsigned int dev, const uint32_t chain_no, void *data, const int nl_errno); /* 0 or errno */
 };
 
 struct tc_action_callbacks *tc_action_get_callbacks(void);
 
-void tc_action_install(const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, void *data);
+void tc_action_install(const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, const enum queue_class cls, void *data);
+void tc_action_replace(const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, const enum queue_class cls, void *data);
+void tc_action_flush_chain(const unsigned int dev, const uint32_t chain_no, const enum queue_class cls, void *data);
+int tc_action_cancel(const unsigned int dev, const uint32_t chain_no, const uint16_t prio);
@@ -36,6 +36,7 @@ static const struct type_map tc_attr_types[TCA_MAX+1] = {
 	TYPE_MAP(TCA_XSTATS,                  BINARY),
 	TYPE_MAP(TCA_STATS2,                  NESTED),
 	TYPE_MAP(TCA_HW_OFFLOAD,              U8),
+	TYPE_MAP(TCA_INGRESS_BLOCK,           U32),
 };
 decode_nlattr_cb(tc, TCA_MAX, true)
 
@@ -46,6 +47,8 @@ static const struct type_map tc_flower_attr_types[TCA_FLOWER_MAX+1] = {
 	TYPE_MAP(TCA_FLOWER_KEY_IPV4_SRC_MASK, U32),
 	TYPE_MAP(TCA_FLOWER_KEY_IPV4_DST,      U32),
 	TYPE_MAP(TCA_FLOWER_KEY_IPV4_DST_MASK, U32),
+	TYPE_MAP(TCA_FLOWER_KEY_IPV6_SRC,      BINARY),
+	TYPE_MAP(TCA_FLOWER_KEY_IPV6_SRC_MASK, BINARY),
 	TYPE_MAP(TCA_FLOWER_KEY_IPV6_DST,      BINARY),
 	TYPE_MAP(TCA_FLOWER_KEY_IPV6_DST_MASK, BINARY),
 	TYPE_MAP(TCA_FLOWER_FLAGS,             U32),
@@ -277,6 +280,7 @@ static int decode_nlattr_tc_act_mirred_cb(const struct nlattr *attr, struct tc_r
 	p = mnl_attr_get_payload(tb[TCA_MIRRED_PARMS]);
 	if (p->eaction != TCA_EGRESS_REDIR)
 		tc_rule_mark_alien(rule);
+	rule->egress_ifindex = p->ifindex;
 
 	fr_printf(DEBUG2, " ifidx %u", p->ifindex);
 	return MNL_CB_OK;
@@ -372,7 +376,57 @@ static uint8_t count_ones(const struct nlattr *attr, struct tc_rule *rule)
 	return ret;
 }
 
-static int decode_flower(const struct nlattr *attr, struct tc_rule *rule)
+static void decode_hash_bucket(const struct nlattr *key, const struct nlattr *mask, struct tc_rule *rule)
+{
+	const uint16_t len = mnl_attr_get_payload_len(key);
+	const uint8_t *k = mnl_attr_get_payload(key);
+	const uint8_t *m;
+
+	/* only the last octet of the source address may be matched on */
+	if (!mask || mnl_attr_get_payload_len(mask) != len)
+		goto mark_alien;
+	m = mnl_attr_get_payload(mask);
+	for (uint16_t i = 0; i < len - 1; i++) {
+		if (k[i] != 0 || m[i] != 0)
+			goto mark_alien;
+	}
+	switch (m[len - 1]) {
+	case 0x01:
+	case 0x03:
+	case 0x07:
+		break;
+	default:
+		goto mark_alien;
+	}
+	if ((k[len - 1] & ~m[len - 1]) != 0)
+		goto mark_alien;
+
+	tc_rule_set_hash_bucket(rule, m[len - 1] + 1, k[len - 1]);
+	return;
+mark_alien:
+	tc_rule_mark_alien(rule);
+}
+
+static uint32_t decode_flower_offload(struct nlattr **tb, uint32_t *in_hw_count)
+{
+	uint32_t flower_flags = 0;
+
+	if (tb[TCA_FLOWER_FLAGS]) {
+		flower_flags = mnl_attr_get_u32(tb[TCA_FLOWER_FLAGS]);
+
+		/* the kernel reports the offload status as flags */
+		if (flower_flags & TCA_CLS_FLAGS_IN_HW)
+			*in_hw_count = 1;
+		flower_flags &= ~(TCA_CLS_FLAGS_IN_HW | TCA_CLS_FLAGS_NOT_IN_HW);
+	}
+
+	if (tb[TCA_FLOWER_IN_HW_COUNT])
+		*in_hw_count = mnl_attr_get_u32(tb[TCA_FLOWER_IN_HW_COUNT]);
+
+	return flower_flags;
+}
+
+static int decode_flower(const struct nlattr *attr, struct tc_rule *rule, uint32_t *in_hw_count)
 {
 	struct nlattr *tb[TCA_FLOWER_MAX+1] = {0};
 
@@ -389,8 +443,7 @@ static int decode_flower(const struct nlattr *attr, struct tc_rule *rule)
 		tc_rule_mark_alien(rule);
 	}
 
-	if (tb[TCA_FLOWER_FLAGS])
-		rule->flower_flags = mnl_attr_get_u32(tb[TCA_FLOWER_FLAGS]);
+	rule->flower_flags = decode_flower_offload(tb, in_hw_count);
 
 	if (tb[TCA_FLOWER_KEY_IP_TTL]) {
 		if (mnl_attr_get_u8(tb[TCA_FLOWER_KEY_IP_TTL]) == 1)
@@ -418,6 +471,8 @@ static int decode_flower(const struct nlattr *attr, struct tc_rule *rule)
 				build_af_addr(&rule->af_addr, AF_INET, addr, mask_len);
 				rule->traits |= TC_RULE_HAVE_IP;
 			}
+			if (tb[TCA_FLOWER_KEY_IPV4_SRC])
+				decode_hash_bucket(tb[TCA_FLOWER_KEY_IPV4_SRC], tb[TCA_FLOWER_KEY_IPV4_SRC_MASK], rule);
 			break;
 		case ETH_P_IPV6:
 			rule->af_addr.af = AF_INET6;
@@ -429,6 +484,8 @@ static int decode_flower(const struct nlattr *attr, struct tc_rule *rule)
 				build_af_addr(&rule->af_addr, AF_INET6, addr, mask_len);
 				rule->traits |= TC_RULE_HAVE_IP;
 			}
+			if (tb[TCA_FLOWER_KEY_IPV6_SRC])
+				decode_hash_bucket(tb[TCA_FLOWER_KEY_IPV6_SRC], tb[TCA_FLOWER_KEY_IPV6_SRC_MASK], rule);
 			break;
 		default:
 			tc_rule_mark_alien(rule);
@@ -456,7 +513,9 @@ int decode_qdisc(const struct nlmsghdr *nlh, struct conn *c)
 	if (ret != MNL_CB_OK)
 		return ret;
 
-	if (tcm->tcm_ifindex != config->ifidx)
+	int dev = config_if_lookup(tcm->tcm_ifindex);
+
+	if (dev < 0)
 		return MNL_CB_OK;
 
 	uint32_t chain_no = tb[TCA_CHAIN] ? mnl_attr_get_u32(tb[TCA_CHAIN]) : 0;
@@ -466,7 +525,7 @@ int decode_qdisc(const struct nlmsghdr *nlh, struct conn *c)
 		return MNL_CB_OK;
 
 	if (DBG_LEVEL(DEBUG2)) {
-		fr_printf(DEBUG2, "qdisc for ifindex %d = %d\n", tcm->tcm_ifindex, config->ifidx);
+		fr_printf(DEBUG2, "qdisc for ifindex %d\n", tcm->tcm_ifindex);
 		fr_printf(DEBUG2, "tcm handle: %"PRIu32" (%"PRIx32")\n", tcm->tcm_handle, tcm->tcm_handle);
 		fr_printf(DEBUG2, "tcm parent: %"PRIu32" (%"PRIx32")\n", tcm->tcm_parent, tcm->tcm_parent);
 		fr_printf(DEBUG2, "tca kind: %s\n", qdisc_kind);
@@ -477,6 +536,14 @@ int decode_qdisc(const struct nlmsghdr *nlh, struct conn *c)
 	if (strcmp(qdisc_kind, "ingress") == 0)
 		filter_got_qdisc();
 
+	if (config->block_index && tcm->tcm_parent == TC_H_CLSACT) {
+		uint32_t block = tb[TCA_INGRESS_BLOCK] ? mnl_attr_get_u32(tb[TCA_INGRESS_BLOCK]) : 0;
+
+		if (block != config->block_index)
+			fr_printf(ERROR, "%s: ingress is not bound to block %"PRIu32", but to %"PRIu32"\n",
+				  config->ifname[dev], config->block_index, block);
+	}
+
 	return MNL_CB_OK;
 }
 
@@ -492,11 +559,11 @@ int decode_chain(const struct nlmsghdr *nlh, struct conn *c)
 
 	uint32_t chain_no = tb[TCA_CHAIN] ? mnl_attr_get_u32(tb[TCA_CHAIN]) : 0;
 
-	if (tcm->tcm_ifindex != config->ifidx)
+	if (filter_get_dev(tcm) < 0)
 		return MNL_CB_OK;
 
 	fr_printf(DEBUG2, "got chain %d\n", chain_no);
-	if (tcm->tcm_parent != TC_H_MAJ(TC_H_INGRESS)) {
+	if (config->block_index == 0 && tcm->tcm_parent != TC_H_MAJ(TC_H_INGRESS)) {
 		fr_printf(DEBUG2, "unexpected tcm_parent (got: %08x, expected: %08x)\n",
 				tcm->tcm_parent,
 				TC_H_MAJ(TC_H_INGRESS));
@@ -520,6 +587,12 @@ static int try_decode_filter(const struct nlmsghdr *nlh, struct conn *c, struct
 		return MNL_CB_OK;
 	AN(tcm->tcm_handle == 1);
 
+	/* filters on other devices are none of our business */
+	int dev = filter_get_dev(tcm);
+
+	if (dev < 0)
+		return MNL_CB_OK;
+
 	int ret = mnl_attr_parse(nlh, sizeof(*tcm), decode_nlattr_tc_cb, tb);
 
 	if (ret != MNL_CB_OK)
@@ -530,7 +603,7 @@ static int try_decode_filter(const struct nlmsghdr *nlh, struct conn *c, struct
 	struct tc_rule *tcr = &ext->tcr;
 
 	if (filter_kind && strcmp(filter_kind, "flower") == 0 && tb[TCA_OPTIONS]) {
-		int ret = decode_flower(tb[TCA_OPTIONS], tcr);
+		int ret = decode_flower(tb[TCA_OPTIONS], tcr, &ext->in_hw_count);
 
 		if (ret != MNL_CB_OK)
 			return ret;
@@ -541,6 +614,7 @@ static int try_decode_filter(const struct nlmsghdr *nlh, struct conn *c, struct
 	uint32_t chain_no = tb[TCA_CHAIN] ? mnl_attr_get_u32(tb[TCA_CHAIN]) : 0;
 	uint16_t prio = TC_H_MAJ(tcm->tcm_info)>>16;
 
+	ext->dev = dev;
 	ext->chain_no = chain_no;
 	ext->prio = prio;
 	ext->is_done = true;
@@ -554,13 +628,56 @@ static int try_decode_filter(const struct nlmsghdr *nlh, struct conn *c, struct
 	return MNL_CB_OK;
 }
 
+/* terse dumps only carry the handle, flags and offload state */
+static int decode_filter_terse(const struct nlmsghdr *nlh)
+{
+	struct nlattr *tb[TCA_MAX+1] = {0};
+	struct nlattr *fb[TCA_FLOWER_MAX+1] = {0};
+	struct tcmsg *tcm = mnl_nlmsg_get_payload(nlh);
+	uint32_t flower_flags = 0;
+	uint32_t in_hw_count = 0;
+	int is_flower;
+	int dev = filter_get_dev(tcm);
+
+	if (tcm->tcm_handle == 0 || dev < 0)
+		return MNL_CB_OK;
+
+	int ret = mnl_attr_parse(nlh, sizeof(*tcm), decode_nlattr_tc_cb, tb);
+
+	if (ret != MNL_CB_OK)
+		return ret;
+
+	const char *filter_kind = tb[TCA_KIND] ? mnl_attr_get_str(tb[TCA_KIND]) : NULL;
+
+	is_flower = filter_kind && strcmp(filter_kind, "flower") == 0;
+	if (is_flower && tb[TCA_OPTIONS]) {
+		ret = mnl_attr_parse_nested(tb[TCA_OPTIONS], decode_nlattr_tc_flower_cb, fb);
+		if (ret != MNL_CB_OK)
+			return ret;
+		flower_flags = decode_flower_offload(fb, &in_hw_count);
+	}
+
+	uint32_t chain_no = tb[TCA_CHAIN] ? mnl_attr_get_u32(tb[TCA_CHAIN]) : 0;
+	uint16_t prio = TC_H_MAJ(tcm->tcm_info)>>16;
+
+	fr_printf(DEBUG2, "terse filter\n");
+	fr_printf(DEBUG2, "  %"PRIu32", %"PRIu32" %"PRIu32", %s ...\n", chain_no, prio, tcm->tcm_handle, filter_kind);
+
+	obj_rule_terse_seen(dev, chain_no, prio, is_flower, flower_flags, in_hw_count);
+	return MNL_CB_OK;
+}
+
 int decode_filter(const struct nlmsghdr *nlh, struct conn *c)
 {
 	struct tc_decoded_rule tdr;
-	int ret = try_decode_filter(nlh, c, &tdr);
+	int ret;
+
+	if (nlh->nlmsg_type == RTM_NEWTFILTER && filter_dump_is_terse(c))
+		return decode_filter_terse(nlh);
 
+	ret = try_decode_filter(nlh, c, &tdr);
 	if (ret == MNL_CB_OK && tdr.is_done)
-		obj_rule_netlink_found(nlh->nlmsg_type, tdr.chain_no, tdr.prio, &tdr.tcr);
+		obj_rule_netlink_found(nlh->nlmsg_type, tdr.dev, tdr.chain_no, tdr.prio, &tdr.tcr, tdr.in_hw_count);
 	return ret;
 }
 
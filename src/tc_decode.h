@@ -5,8 +5,10 @@
 
 struct tc_decoded_rule {
 	int is_done;
+	unsigned int dev; /* index into config->ifidx */
 	uint32_t chain_no;
 	uint16_t prio;
+	uint32_t in_hw_count; /* kept out of tcr, as it is not ours to want */
 	struct tc_rule tcr;
 };
 
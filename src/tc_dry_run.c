@@ -0,0 +1,306 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * --dry-run action backend
+ *
+ * Rule changes are applied to a model of the filters, instead of the
+ * kernel, and fed back as the kernel's notifications would be, so the
+ * rest of the daemon carries on as usual. The model starts out with
+ * what the first scan finds, and keeps count of the chains and the
+ * distinct masks, for sizing a layout before it meets a NIC.
+ */
+
+#include "tc_dry_run.h"
+#include "tc_action.h"
+#include "tc_encode.h"
+#include "nl_decode.h"
+#include "rbtree.h"
+
+/* a filter, as the kernel would hold it */
+struct tc_dry_run_filter {
+	uint64_t key;
+	uint64_t mask_key;
+	struct rb_node node;
+};
+
+/* the filters with a given chain, or mask */
+struct tc_dry_run_count {
+	uint64_t key;
+	unsigned int cnt;
+	struct rb_node node;
+};
+
+static struct rb_root tc_dry_run_filters = RB_ROOT;
+static struct rb_root tc_dry_run_chains = RB_ROOT;
+static struct rb_root tc_dry_run_masks = RB_ROOT;
+static struct tc_dry_run_stats tc_dry_run_stats;
+static uint64_t tc_dry_run_reported = UINT64_MAX; /* changes, at the last report */
+
+/* in the order of a dump, as tc_action_key() */
+static uint64_t tc_dry_run_key(const unsigned int dev, const uint32_t chain_no, const uint16_t prio)
+{
+	return ((uint64_t) dev << 48) | ((uint64_t) chain_no << 16) | prio;
+}
+
+static uint32_t tc_dry_run_key_chain_no(const uint64_t key)
+{
+	return (key >> 16) & UINT32_MAX;
+}
+
+/* what the filter matches on, see tc_encode.c, sorted by chain */
+static uint64_t tc_dry_run_mask_key(const uint32_t chain_no, const struct tc_rule *tcr)
+{
+	uint64_t key = (uint64_t) chain_no << 32;
+
+	key |= (uint64_t) tcr->af_addr.af << 24;
+	if (tcr->traits & TC_RULE_HAVE_IP)
+		key |= (uint64_t) tcr->af_addr.mask_len << 16;
+	if (tcr->traits & TC_RULE_HAVE_TTL_CHECK)
+		key |= 1 << 8;
+	key |= tcr->hash_buckets;
+	return key;
+}
+
+/* the first filter with a key that isn't below key */
+static struct tc_dry_run_filter *tc_dry_run_filter_next(const uint64_t key)
+{
+	struct rb_node *node = tc_dry_run_filters.rb_node;
+	struct tc_dry_run_filter *best = NULL;
+	struct tc_dry_run_filter *this;
+
+	while (node) {
+		this = rb_container_of(node, struct tc_dry_run_filter, node);
+		if (this->key < key) {
+			node = node->rb_right;
+		} else {
+			best = this;
+			if (this->key == key)
+				break;
+			node = node->rb_left;
+		}
+	}
+	return best;
+}
+
+static struct tc_dry_run_filter *tc_dry_run_filter_lookup(const uint64_t key)
+{
+	struct tc_dry_run_filter *f = tc_dry_run_filter_next(key);
+
+	return f != NULL && f->key == key ? f : NULL;
+}
+
+static void tc_dry_run_filter_insert(struct tc_dry_run_filter *f)
+{
+	struct rb_node **new = &(tc_dry_run_filters.rb_node), *parent = NULL;
+	struct tc_dry_run_filter *this;
+
+	while (*new) {
+		this = rb_container_of(*new, struct tc_dry_run_filter, node);
+		parent = *new;
+		AN(f->key != this->key);
+		if (f->key < this->key)
+			new = &((*new)->rb_left);
+		else
+			new = &((*new)->rb_right);
+	}
+	rb_link_node(&f->node, parent, new);
+	rb_insert_color(&f->node, &tc_dry_run_filters);
+}
+
+/* returns the count for key, a new one, if there isn't one yet */
+static struct tc_dry_run_count *tc_dry_run_count_get(struct rb_root *root, const uint64_t key)
+{
+	struct rb_node **new = &(root->rb_node), *parent = NULL;
+	struct tc_dry_run_count *this;
+
+	while (*new) {
+		this = rb_container_of(*new, struct tc_dry_run_count, node);
+		parent = *new;
+		if (key == this->key)
+			return this;
+		if (key < this->key)
+			new = &((*new)->rb_left);
+		else
+			new = &((*new)->rb_right);
+	}
+	this = fr_malloc(sizeof(struct tc_dry_run_count));
+	this->key = key;
+	rb_link_node(&this->node, parent, new);
+	rb_insert_color(&this->node, root);
+	return this;
+}
+
+/* counts one more, or one less, distinct keys are counted in *distinct */
+static void tc_dry_run_count(struct rb_root *root, const uint64_t key, const int delta, unsigned int *distinct)
+{
+	struct tc_dry_run_count *c = tc_dry_run_count_get(root, key);
+
+	if (c->cnt == 0)
+		(*distinct)++;
+	AN(delta > 0 || c->cnt > 0);
+	c->cnt += delta;
+	if (c->cnt == 0) {
+		rb_erase(&c->node, root);
+		free(c);
+		(*distinct)--;
+	}
+}
+
+static void tc_dry_run_account(const struct tc_dry_run_filter *f, const int delta)
+{
+	tc_dry_run_count(&tc_dry_run_chains, tc_dry_run_key_chain_no(f->key), delta, &tc_dry_run_stats.chains);
+	tc_dry_run_count(&tc_dry_run_masks, f->mask_key, delta, &tc_dry_run_stats.masks);
+	tc_dry_run_stats.rules += delta;
+}
+
+static void tc_dry_run_erase(struct tc_dry_run_filter *f)
+{
+	tc_dry_run_account(f, -1);
+	rb_erase(&f->node, &tc_dry_run_filters);
+	free(f);
+}
+
+/* keeps the model in line with what's been found, by scans, the monitor, and ourselves */
+void tc_dry_run_found(const uint16_t nlmsg_type, const unsigned int dev, const uint32_t chain_no, const uint16_t prio, const struct tc_rule *tcr)
+{
+	uint64_t key = tc_dry_run_key(dev, chain_no, prio);
+	struct tc_dry_run_filter *f = tc_dry_run_filter_lookup(key);
+
+	if (nlmsg_type == RTM_DELTFILTER) {
+		if (f != NULL)
+			tc_dry_run_erase(f);
+		return;
+	}
+	AN(tcr);
+	if (f == NULL) {
+		f = fr_malloc(sizeof(struct tc_dry_run_filter));
+		f->key = key;
+		tc_dry_run_filter_insert(f);
+	} else {
+		tc_dry_run_account(f, -1);
+	}
+	f->mask_key = tc_dry_run_mask_key(chain_no, tcr);
+	tc_dry_run_account(f, 1);
+}
+
+static unsigned int tc_dry_run_flush(const unsigned int dev, const uint32_t chain_no)
+{
+	uint64_t end = tc_dry_run_key(dev, chain_no, UINT16_MAX) + 1;
+	struct tc_dry_run_filter *f;
+	unsigned int cnt = 0;
+
+	while ((f = tc_dry_run_filter_next(tc_dry_run_key(dev, chain_no, 0))) != NULL && f->key < end) {
+		tc_dry_run_erase(f);
+		cnt++;
+	}
+	return cnt;
+}
+
+/* refuses what the kernel would, see fake_nl.c */
+static int tc_dry_run_install(EV_P_ const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, int flags)
+{
+	char buf[MNL_SOCKET_DUMP_SIZE];
+	struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
+	struct tc_dry_run_filter *f;
+	unsigned int cnt;
+
+	fr_ev_unused();
+	if (tcr == NULL && prio == 0) {
+		/* fr_printf() only evaluates its arguments at DEBUG1 */
+		cnt = tc_dry_run_flush(dev, chain_no);
+		fr_printf(DEBUG1, "dry-run: flush chain %"PRIu32" on %s, %u rules\n",
+			  chain_no, filter_dev_name(dev), cnt);
+		tc_dry_run_stats.flushes++;
+		return 0;
+	}
+
+	f = tc_dry_run_filter_lookup(tc_dry_run_key(dev, chain_no, prio));
+	if (tcr == NULL) {
+		if (f == NULL)
+			goto refused;
+		tc_dry_run_stats.uninstalls++;
+	} else if (flags & TCE_FLAG_REPLACE) {
+		tc_dry_run_stats.replaces++;
+	} else {
+		if (f != NULL)
+			goto refused;
+		tc_dry_run_stats.installs++;
+	}
+	fr_printf(DEBUG1, "dry-run: %s (%"PRIu32",%"PRIu16") on %s %s\n",
+		  tcr == NULL ? "uninstall" : (flags & TCE_FLAG_REPLACE) ? "replace" : "install",
+		  chain_no, prio, filter_dev_name(dev), tcr != NULL ? tc_rule_state_str(tcr->type) : "");
+
+	/* as the kernel's notification, which also updates the model */
+	tc_encode_rule(nlh, dev, chain_no, prio, tcr, flags | TCE_FLAG_LOOPBACK);
+	decode_nlmsg_cb(nlh, NULL);
+	return 0;
+
+refused:
+	tc_dry_run_stats.failures++;
+	fr_printf(DEBUG1, "dry-run: %s (%"PRIu32",%"PRIu16") on %s would fail\n",
+		  tcr == NULL ? "uninstall" : "install", chain_no, prio, filter_dev_name(dev));
+	return tcr == NULL ? ENOENT : EEXIST;
+}
+
+void tc_dry_run_init(void)
+{
+	struct tc_action_callbacks *tacb = tc_action_get_callbacks();
+
+	tacb->install = tc_dry_run_install;
+}
+
+static void tc_dry_run_count_free_all(struct rb_root *root)
+{
+	struct rb_node *n;
+
+	while ((n = rb_first(root)) != NULL) {
+		rb_erase(n, root);
+		free(rb_container_of(n, struct tc_dry_run_count, node));
+	}
+}
+
+void tc_dry_run_fini(void)
+{
+	struct rb_node *n;
+
+	while ((n = rb_first(&tc_dry_run_filters)) != NULL) {
+		rb_erase(n, &tc_dry_run_filters);
+		free(rb_container_of(n, struct tc_dry_run_filter, node));
+	}
+	tc_dry_run_count_free_all(&tc_dry_run_chains);
+	tc_dry_run_count_free_all(&tc_dry_run_masks);
+	memset(&tc_dry_run_stats, '\0', sizeof(tc_dry_run_stats));
+	tc_dry_run_reported = UINT64_MAX;
+}
+
+void tc_dry_run_get_stats(struct tc_dry_run_stats *st)
+{
+	memcpy(st, &tc_dry_run_stats, sizeof(struct tc_dry_run_stats));
+}
+
+/* the first time, and whenever something would have changed since */
+void tc_dry_run_report(FILE *f)
+{
+	const struct tc_dry_run_stats *st = &tc_dry_run_stats;
+	uint64_t changes = st->installs + st->replaces + st->uninstalls + st->flushes + st->failures;
+	struct rb_node *m = rb_first(&tc_dry_run_masks);
+
+	if (changes == tc_dry_run_reported)
+		return;
+	tc_dry_run_reported = changes;
+
+	fprintf(f, "dry-run: installs=%"PRIu64" replaces=%"PRIu64" uninstalls=%"PRIu64" flushes=%"PRIu64" failures=%"PRIu64" rules=%u chains=%u masks=%u\n",
+		st->installs, st->replaces, st->uninstalls, st->flushes, st->failures,
+		st->rules, st->chains, st->masks);
+
+	/* both are sorted by chain */
+	for (struct rb_node *n = rb_first(&tc_dry_run_chains); n; n = rb_next(n)) {
+		const struct tc_dry_run_count *ch = rb_container_of(n, struct tc_dry_run_count, node);
+		unsigned int masks = 0;
+
+		for (; m && rb_container_of(m, struct tc_dry_run_count, node)->key >> 32 == ch->key; m = rb_next(m))
+			masks++;
+		fprintf(f, "dry-run: chain %"PRIu64" rules=%u masks=%u\n", ch->key, ch->cnt, masks);
+	}
+	fflush(f);
+}
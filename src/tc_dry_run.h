@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef FLOWER_ROUTE_TC_DRY_RUN_H
+#define FLOWER_ROUTE_TC_DRY_RUN_H
+
+#include "common.h"
+#include "tc_rule.h"
+
+struct tc_dry_run_stats {
+	uint64_t installs;
+	uint64_t replaces;
+	uint64_t uninstalls;
+	uint64_t flushes;
+	uint64_t failures; /* that the kernel would have refused */
+	unsigned int rules; /* on all devices */
+	unsigned int chains;
+	unsigned int masks; /* distinct flower masks, per chain */
+};
+
+void tc_dry_run_init(void);
+void tc_dry_run_fini(void);
+void tc_dry_run_found(const uint16_t nlmsg_type, const unsigned int dev, const uint32_t chain_no, const uint16_t prio, const struct tc_rule *tcr);
+void tc_dry_run_get_stats(struct tc_dry_run_stats *st);
+void tc_dry_run_report(FILE *f);
+
+#endif
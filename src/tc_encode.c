@@ -10,15 +10,14 @@
 #include <linux/tc_act/tc_mirred.h>
 #include <linux/if_ether.h>
 
-static void tce_set_tcm(struct nlmsghdr *nlh, uint32_t info, int flags)
+static void tce_set_tcm(struct nlmsghdr *nlh, const unsigned int dev, uint32_t info, int flags)
 {
 	struct tcmsg *tcm;
 
 	tcm = mnl_nlmsg_put_extra_header(nlh, sizeof(struct tcmsg));
 	tcm->tcm_family = AF_UNSPEC;
-	tcm->tcm_ifindex = config->ifidx;
-	tcm->tcm_handle = (flags & TCE_FLAG_LOOPBACK) != 0;
-	tcm->tcm_parent = TC_H_MAKE(TC_H_CLSACT, TC_H_MIN_INGRESS);
+	filter_set_dev(tcm, dev);
+	tcm->tcm_handle = (flags & (TCE_FLAG_LOOPBACK | TCE_FLAG_REPLACE)) != 0;
 	tcm->tcm_info = info;
 }
 
@@ -57,8 +56,11 @@ static struct nlattr *tce_new_flower_rule(struct nlmsghdr *nlh, const struct tc_
 	flower = mnl_attr_nest_start(nlh, TCA_OPTIONS);
 	AN(flower);
 
-	if ((flags & TCE_FLAG_LOOPBACK) == 0)
-		flower_flags &= ~TCA_CLS_FLAGS_IN_HW;
+	/* for loopback, act as if the hardware took it */
+	if ((flags & TCE_FLAG_LOOPBACK) && !(flower_flags & TCA_CLS_FLAGS_SKIP_HW)) {
+		flower_flags |= TCA_CLS_FLAGS_IN_HW;
+		mnl_attr_put_u32(nlh, TCA_FLOWER_IN_HW_COUNT, 1);
+	}
 	mnl_attr_put_u32(nlh, TCA_FLOWER_FLAGS, flower_flags);
 
 	tce_flower_set_eth_type(nlh, tcr->af_addr.af, flags);
@@ -145,6 +147,27 @@ static void tce_match_prefix(struct nlmsghdr *nlh, const struct tc_rule *tcr, in
 	}
 }
 
+static void tce_match_hash_bucket(struct nlmsghdr *nlh, const struct tc_rule *tcr)
+{
+	const uint8_t mask = tcr->hash_buckets - 1;
+	struct in6_addr ip6_key = {0};
+	struct in6_addr ip6_mask = {0};
+
+	/* the source address is a poor man's flow hash, but it is offloadable */
+	switch (tcr->af_addr.af) {
+	case AF_INET:
+		mnl_attr_put_u32(nlh, TCA_FLOWER_KEY_IPV4_SRC, htonl(tcr->hash_bucket));
+		mnl_attr_put_u32(nlh, TCA_FLOWER_KEY_IPV4_SRC_MASK, htonl(mask));
+		break;
+	case AF_INET6:
+		ip6_key.s6_addr[15] = tcr->hash_bucket;
+		ip6_mask.s6_addr[15] = mask;
+		mnl_attr_put(nlh, TCA_FLOWER_KEY_IPV6_SRC, sizeof(struct in6_addr), &ip6_key);
+		mnl_attr_put(nlh, TCA_FLOWER_KEY_IPV6_SRC_MASK, sizeof(struct in6_addr), &ip6_mask);
+		break;
+	}
+}
+
 static void tce_add_ip_gact_rule(struct nlmsghdr *nlh, const struct tc_rule *tcr, int flags, int action)
 {
 	tce_match_prefix(nlh, tcr, flags);
@@ -219,7 +242,7 @@ static void tce_pedit_action(struct nlmsghdr *nlh, uint16_t act_no, const struct
 	free(sel);
 }
 
-static void tce_redirect_action(struct nlmsghdr *nlh, uint16_t act_no)
+static void tce_redirect_action(struct nlmsghdr *nlh, uint16_t act_no, const uint32_t ifindex)
 {
 	struct nlattr *act, *act_opts;
 
@@ -229,7 +252,7 @@ static void tce_redirect_action(struct nlmsghdr *nlh, uint16_t act_no)
 	memset(&p, '\0', sizeof(struct tc_mirred));
 	p.eaction = TCA_EGRESS_REDIR;
 	p.action = TC_ACT_STOLEN;
-	p.ifindex = config->ifidx;
+	p.ifindex = ifindex;
 	mnl_attr_put(nlh, TCA_MIRRED_PARMS, sizeof(struct tc_mirred), &p);
 	tce_action_end(nlh, act, act_opts);
 }
@@ -261,27 +284,38 @@ static void tce_add_ip_forward_rule(struct nlmsghdr *nlh, const struct tc_rule *
 	tce_pedit_action(nlh, ++act_no, rule);
 	if (rule->af_addr.af == AF_INET)
 		tce_csum_action(nlh, ++act_no);
-	tce_redirect_action(nlh, ++act_no);
+	tce_redirect_action(nlh, ++act_no, rule->egress_ifindex);
 
 	mnl_attr_nest_end(nlh, acts);
 }
 
-static void tc_encode_add_rule(struct nlmsghdr *nlh, const uint32_t chain_no, const uint16_t prio, const struct tc_rule *tcr, int flags)
+static void tc_encode_add_rule(struct nlmsghdr *nlh, const unsigned int dev, const uint32_t chain_no, const uint16_t prio, const struct tc_rule *tcr, int flags)
 {
 	nlh->nlmsg_type = RTM_NEWTFILTER;
-	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | NLM_F_EXCL | NLM_F_CREATE;
-	tce_set_tcm(nlh, TC_H_MAKE(prio << 16, htons(ETH_P_8021Q)), flags);
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE;
+	if (flags & TCE_FLAG_REPLACE)
+		nlh->nlmsg_flags |= NLM_F_REPLACE;
+	else
+		nlh->nlmsg_flags |= NLM_F_EXCL;
+	if (flags & TCE_FLAG_ECHO)
+		nlh->nlmsg_flags |= NLM_F_ECHO;
+	tce_set_tcm(nlh, dev, TC_H_MAKE(prio << 16, htons(ETH_P_8021Q)), flags);
 	mnl_attr_put_u32(nlh, TCA_CHAIN, chain_no);
 
 	struct nlattr *flower = tce_new_flower_rule(nlh, tcr, flags);
 
 	switch (tcr->type) {
 	case TC_RULE_TYPE_FORWARD:
+		if (tcr->hash_buckets)
+			tce_match_hash_bucket(nlh, tcr);
 		tce_add_ip_forward_rule(nlh, tcr);
 		break;
 	case TC_RULE_TYPE_ROUTE_TRAP:
 		tce_add_ip_gact_rule(nlh, tcr, flags, TC_ACT_TRAP);
 		break;
+	case TC_RULE_TYPE_FORWARD_TRAP:
+		tce_simple_gact(nlh, TC_ACT_TRAP);
+		break;
 	case TC_RULE_TYPE_ROUTE_GOTO:
 		tce_add_ip_gact_rule(nlh, tcr, flags,
 				TC_ACT_GOTO_CHAIN | tcr->goto_target);
@@ -297,26 +331,28 @@ static void tc_encode_add_rule(struct nlmsghdr *nlh, const uint32_t chain_no, co
 	mnl_attr_nest_end(nlh, flower);
 }
 
-void tc_encode_drop_chain(struct nlmsghdr *nlh, const uint32_t chain_no, int flags)
+void tc_encode_drop_chain(struct nlmsghdr *nlh, const unsigned int dev, const uint32_t chain_no, int flags)
 {
 	nlh->nlmsg_type = RTM_DELTFILTER;
 	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
-	tce_set_tcm(nlh, 0, flags);
+	tce_set_tcm(nlh, dev, 0, flags);
 	mnl_attr_put_u32(nlh, TCA_CHAIN, chain_no);
 }
 
-static void tc_encode_drop_rule(struct nlmsghdr *nlh, const uint32_t chain_no, const uint16_t prio, int flags)
+static void tc_encode_drop_rule(struct nlmsghdr *nlh, const unsigned int dev, const uint32_t chain_no, const uint16_t prio, int flags)
 {
 	nlh->nlmsg_type = RTM_DELTFILTER;
 	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
-	tce_set_tcm(nlh, TC_H_MAKE(prio << 16, 0), flags);
+	if (flags & TCE_FLAG_ECHO)
+		nlh->nlmsg_flags |= NLM_F_ECHO;
+	tce_set_tcm(nlh, dev, TC_H_MAKE(prio << 16, 0), flags);
 	mnl_attr_put_u32(nlh, TCA_CHAIN, chain_no);
 }
 
-void tc_encode_rule(struct nlmsghdr *nlh, const uint32_t chain_no, const uint16_t prio, const struct tc_rule *tcr, int flags)
+void tc_encode_rule(struct nlmsghdr *nlh, const unsigned int dev, const uint32_t chain_no, const uint16_t prio, const struct tc_rule *tcr, int flags)
 {
 	if (tcr)
-		tc_encode_add_rule(nlh, chain_no, prio, tcr, flags);
+		tc_encode_add_rule(nlh, dev, chain_no, prio, tcr, flags);
 	else
-		tc_encode_drop_rule(nlh, chain_no, prio, flags);
+		tc_encode_drop_rule(nlh, dev, chain_no, prio, flags);
 }
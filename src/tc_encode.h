@@ -7,7 +7,9 @@
 enum {
 	NO_TCE_FLAGS      = 0,
 	TCE_FLAG_LOOPBACK = 1<<0,
+	TCE_FLAG_REPLACE  = 1<<1,
+	TCE_FLAG_ECHO     = 1<<2,
 };
 
-void tc_encode_drop_chain(struct nlmsghdr *nlh, const uint32_t chain_no, int flags);
-void tc_encode_rule(struct nlmsghdr *nlh, const uint32_t chain_no, const uint16_t prio, const struct tc_rule *tcr, int flags);
+void tc_encode_drop_chain(struct nlmsghdr *nlh, const unsigned int dev, const uint32_t chain_no, int flags);
+void tc_encode_rule(struct nlmsghdr *nlh, const unsigned int dev, const uint32_t chain_no, const uint16_t prio, const struct tc_rule *tcr, int flags);
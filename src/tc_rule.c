@@ -8,6 +8,7 @@ static unsigned int type_traits[TC_RULE_TYPE_MAX] = {
 	[TC_RULE_TYPE_ROUTE_GOTO] = TC_RULE_HAVE_AF_IP | TC_RULE_HAVE_GOTO,
 	[TC_RULE_TYPE_ROUTE_DFT_GOTO] = TC_RULE_HAVE_AF | TC_RULE_HAVE_GOTO,
 	[TC_RULE_TYPE_ROUTE_TRAP] = TC_RULE_HAVE_AF_IP | TC_RULE_HAVE_TRAP,
+	[TC_RULE_TYPE_FORWARD_TRAP] = TC_RULE_HAVE_AF | TC_RULE_HAVE_TRAP,
 };
 
 void tc_rule_init(struct tc_rule *tcr)
@@ -32,10 +33,25 @@ void tc_rule_set_type_and_traits(struct tc_rule *rule, const enum tc_rule_types
 	AN(rule->traits != 0);
 }
 
+void tc_rule_set_hash_bucket(struct tc_rule *tcr, const uint8_t buckets, const uint8_t bucket)
+{
+	AN(buckets > 1 && (buckets & (buckets - 1)) == 0);
+	AN(bucket < buckets);
+	tcr->hash_buckets = buckets;
+	tcr->hash_bucket = bucket;
+	tcr->traits |= TC_RULE_HAVE_HASH;
+}
+
 enum tc_rule_types tc_rule_detect(struct tc_rule *rule)
 {
 	unsigned int traits = rule->traits;
 
+	if (traits & TC_RULE_HAVE_HASH) {
+		if ((traits & ~TC_RULE_HAVE_HASH) != type_traits[TC_RULE_TYPE_FORWARD])
+			return TC_RULE_TYPE_ALIEN;
+		return TC_RULE_TYPE_FORWARD;
+	}
+
 	for (int i = 0; i < TC_RULE_TYPE_MAX; i++) {
 		unsigned int expected_traits = type_traits[i];
 
@@ -80,6 +96,8 @@ const char *tc_rule_state_str(enum tc_rule_types type)
 		return "route_goto";
 	case TC_RULE_TYPE_TTL_CHECK:
 		return "ttl_check";
+	case TC_RULE_TYPE_FORWARD_TRAP:
+		return "forward_trap";
 	case TC_RULE_TYPE_MAX:
 		break;
 	}
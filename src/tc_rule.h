@@ -14,6 +14,7 @@ enum tc_rule_types {
 	TC_RULE_TYPE_ROUTE_GOTO,
 	TC_RULE_TYPE_ROUTE_DFT_GOTO,
 	TC_RULE_TYPE_TTL_CHECK,
+	TC_RULE_TYPE_FORWARD_TRAP,
 	TC_RULE_TYPE_MAX
 };
 
@@ -26,6 +27,7 @@ enum tc_rule_traits {
 	TC_RULE_HAVE_TTL_DEC   = 1<<5,
 	TC_RULE_HAVE_LLADDR    = 1<<6,
 	TC_RULE_HAVE_VLAN_MOD  = 1<<7,
+	TC_RULE_HAVE_HASH      = 1<<8, /* optional, only for TC_RULE_TYPE_FORWARD */
 };
 #define TC_RULE_HAVE_AF_IP (TC_RULE_HAVE_AF | TC_RULE_HAVE_IP)
 
@@ -37,10 +39,13 @@ struct tc_rule {
 	uint16_t vlan_id;
 	uint32_t flower_flags;
 	uint32_t goto_target;
+	uint32_t egress_ifindex; /* redirected to, only for TC_RULE_TYPE_FORWARD */
 	unsigned int traits;
 	//const char *kind;
 	struct af_addr af_addr;
 	uint8_t ttl;
+	uint8_t hash_buckets; /* power of two, 0 when not hashing */
+	uint8_t hash_bucket;  /* matched against the low bits of the source address */
 	union {
 		struct {
 			uint8_t dst[ETH_ALEN];
@@ -59,6 +64,7 @@ void tc_rule_print(const struct tc_rule *rule);
 enum tc_rule_types tc_rule_detect(struct tc_rule *rule);
 const char *tc_rule_state_str(enum tc_rule_types type);
 void tc_rule_init(struct tc_rule *tcr);
+void tc_rule_set_hash_bucket(struct tc_rule *tcr, const uint8_t buckets, const uint8_t bucket);
 int tc_rule_set_dst(struct tc_rule *tcr, const char *ipstr, const uint8_t mask_len);
 
 #endif
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * convergence tracing
+ *
+ * While a netlink event is decoded, or a held back one is applied, its
+ * time is the event time, of the rule changes that follow from it.
+ * Each rule carries the time it reached each stage, and once the change
+ * is both acknowledged and confirmed, the time from the event to each
+ * stage is recorded. The slowest recent changes are kept in a ring.
+ */
+
+#include "trace.h"
+
+static ev_tstamp trace_event_at;
+static struct hist trace_hist[TRACE_STAGE_CNT]; /* time from the event */
+static struct hist trace_total;
+static struct trace_slow trace_slow[TRACE_SLOW_CNT];
+static unsigned int trace_slow_next;
+
+static const char * const trace_stage_names[TRACE_STAGE_CNT] = {
+	[TRACE_STAGE_EVENT] = "event",
+	[TRACE_STAGE_QUEUED] = "queued",
+	[TRACE_STAGE_SENT] = "sent",
+	[TRACE_STAGE_ACKED] = "acked",
+	[TRACE_STAGE_OK] = "ok",
+};
+
+const char *trace_stage_name(const enum trace_stage stage)
+{
+	AN(stage < TRACE_STAGE_CNT);
+	return trace_stage_names[stage];
+}
+
+/* returns what to restore afterwards, as they may nest */
+ev_tstamp trace_event_begin(const ev_tstamp ts)
+{
+	ev_tstamp prev = trace_event_at;
+
+	trace_event_at = ts;
+	return prev;
+}
+
+void trace_event_end(const ev_tstamp prev)
+{
+	trace_event_at = prev;
+}
+
+/* outside of an event, a change is caused by a timer, so starts now */
+ev_tstamp trace_event_ts(void)
+{
+	return trace_event_at != 0. ? trace_event_at : ev_time();
+}
+
+/* a retry, or a superseding request, still counts from the first event */
+void trace_queued(struct trace *t, const char *op)
+{
+	if (!t->active) {
+		memset(t->ts, '\0', sizeof(t->ts));
+		t->ts[TRACE_STAGE_EVENT] = trace_event_ts();
+		t->active = true;
+	}
+	t->op = op;
+	t->ts[TRACE_STAGE_QUEUED] = ev_time();
+	t->ts[TRACE_STAGE_SENT] = 0.;
+	t->ts[TRACE_STAGE_ACKED] = 0.;
+	t->ts[TRACE_STAGE_OK] = 0.;
+}
+
+void trace_stage(struct trace *t, const enum trace_stage stage)
+{
+	AN(stage < TRACE_STAGE_CNT);
+	if (t->active)
+		t->ts[stage] = ev_time();
+}
+
+static void trace_slow_record(const struct trace *t, const unsigned int dev, const uint32_t chain_no, const uint16_t prio)
+{
+	struct trace_slow *ts = &trace_slow[trace_slow_next];
+
+	memcpy(ts->ts, t->ts, sizeof(ts->ts));
+	ts->op = t->op;
+	ts->dev = dev;
+	ts->chain_no = chain_no;
+	ts->prio = prio;
+	trace_slow_next = (trace_slow_next + 1) % TRACE_SLOW_CNT;
+}
+
+void trace_finish(struct trace *t, const unsigned int dev, const uint32_t chain_no, const uint16_t prio)
+{
+	ev_tstamp event = t->ts[TRACE_STAGE_EVENT];
+	ev_tstamp total = 0.;
+
+	if (!t->active)
+		return;
+	t->active = false;
+	for (int i = TRACE_STAGE_QUEUED; i < TRACE_STAGE_CNT; i++) {
+		ev_tstamp d;
+
+		if (t->ts[i] == 0.)
+			continue;
+		d = t->ts[i] - event;
+		hist_record(&trace_hist[i], d);
+		if (d > total)
+			total = d;
+	}
+	/* slower than most so far, the first ones always are */
+	if (total >= hist_percentile(&trace_total, 99.))
+		trace_slow_record(t, dev, chain_no, prio);
+	hist_record(&trace_total, total);
+}
+
+const struct hist *trace_get_hist(const enum trace_stage stage)
+{
+	AN(stage < TRACE_STAGE_CNT);
+	return &trace_hist[stage];
+}
+
+const struct hist *trace_get_total(void)
+{
+	return &trace_total;
+}
+
+/* NULL for an unused slot, the most recent one first */
+const struct trace_slow *trace_get_slow(const unsigned int idx)
+{
+	const struct trace_slow *ts;
+
+	AN(idx < TRACE_SLOW_CNT);
+	ts = &trace_slow[(trace_slow_next + TRACE_SLOW_CNT - 1 - idx) % TRACE_SLOW_CNT];
+	return ts->op != NULL ? ts : NULL;
+}
+
+static void trace_print_hist(const char *name, const struct hist *h)
+{
+	if (h->cnt == 0)
+		return;
+	fr_printf(DEBUG1, "convergence %-7s n=%-8"PRIu64" p50=%.3fms p99=%.3fms max=%.3fms\n",
+		  name, h->cnt, hist_percentile(h, 50.) * 1e3,
+		  hist_percentile(h, 99.) * 1e3, h->max * 1e3);
+}
+
+void trace_print(void)
+{
+	const struct trace_slow *ts;
+
+	for (int i = TRACE_STAGE_QUEUED; i < TRACE_STAGE_CNT; i++)
+		trace_print_hist(trace_stage_names[i], &trace_hist[i]);
+	trace_print_hist("total", &trace_total);
+
+	for (unsigned int i = 0; i < TRACE_SLOW_CNT && (ts = trace_get_slow(i)) != NULL; i++) {
+		fr_printf(DEBUG1, "slow %-9s %u %6"PRIu32" %6"PRIu16, ts->op, ts->dev, ts->chain_no, ts->prio);
+		for (int j = TRACE_STAGE_QUEUED; j < TRACE_STAGE_CNT; j++) {
+			if (ts->ts[j] != 0.)
+				fr_printf(DEBUG1, " %s=+%.3fms", trace_stage_names[j],
+					  (ts->ts[j] - ts->ts[TRACE_STAGE_EVENT]) * 1e3);
+		}
+		fr_printf(DEBUG1, "\n");
+	}
+}
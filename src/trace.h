@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef FLOWER_ROUTE_TRACE_H
+#define FLOWER_ROUTE_TRACE_H
+
+#include "common.h"
+#include "hist.h"
+
+/* convergence of a rule change, from the netlink event that caused it */
+enum trace_stage {
+	TRACE_STAGE_EVENT,  /* route, neighbour or link event decoded */
+	TRACE_STAGE_QUEUED, /* rule change queued */
+	TRACE_STAGE_SENT,
+	TRACE_STAGE_ACKED,
+	TRACE_STAGE_OK,     /* the kernel's copy matches, as echoed or dumped */
+	TRACE_STAGE_CNT,
+};
+
+struct trace {
+	ev_tstamp ts[TRACE_STAGE_CNT]; /* 0 = not reached */
+	const char *op;
+	int active;
+};
+
+#define TRACE_SLOW_CNT 16
+
+/* a recent change, that was slow to converge */
+struct trace_slow {
+	ev_tstamp ts[TRACE_STAGE_CNT];
+	const char *op;
+	unsigned int dev;
+	uint32_t chain_no;
+	uint16_t prio;
+};
+
+ev_tstamp trace_event_begin(const ev_tstamp ts);
+void trace_event_end(const ev_tstamp prev);
+ev_tstamp trace_event_ts(void);
+void trace_queued(struct trace *t, const char *op);
+void trace_stage(struct trace *t, const enum trace_stage stage);
+void trace_finish(struct trace *t, const unsigned int dev, const uint32_t chain_no, const uint16_t prio);
+const char *trace_stage_name(const enum trace_stage stage);
+const struct hist *trace_get_hist(const enum trace_stage stage);
+const struct hist *trace_get_total(void);
+const struct trace_slow *trace_get_slow(const unsigned int idx);
+void trace_print(void);
+
+#endif
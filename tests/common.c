@@ -8,12 +8,19 @@
 #include "../src/obj_target.h"
 #include "../src/obj_rule.h"
 #include "../src/tc_action.h"
+#include "../src/neigh_action.h"
 #include "../src/tc_decode.h"
 #include "../src/tc_encode.h"
 #include "../src/nl_filter.h"
 #include "../src/nl_decode.h"
 #include "../src/sched.h"
 
+unsigned int tc_install_cnt;
+unsigned int tc_replace_cnt;
+unsigned int neigh_probe_cnt;
+int tc_install_errno;
+int tc_install_not_in_hw;
+
 void assert_all_counts_are_zero(void)
 {
 	ck_assert_int_eq(obj_link_count(), 0);
@@ -23,7 +30,7 @@ void assert_all_counts_are_zero(void)
 	ck_assert_int_eq(obj_rule_count(), 0);
 }
 
-static void tc_install_handler(EV_P_ const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr)
+static int tc_install_handler(EV_P_ const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, int flags)
 {
 	/*
 	 * here we act as if the rule got installed,
@@ -38,7 +45,16 @@ static void tc_install_handler(EV_P_ const uint32_t chain_no, const uint16_t pri
 	char buf[MNL_SOCKET_DUMP_SIZE];
 	struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
 
-	tc_encode_rule(nlh, chain_no, prio, tcr, TCE_FLAG_LOOPBACK);
+	if (flags & TCE_FLAG_REPLACE)
+		tc_replace_cnt++;
+	else
+		tc_install_cnt++;
+
+	/* act as if the kernel refused it */
+	if (tc_install_errno != 0)
+		return tc_install_errno;
+
+	tc_encode_rule(nlh, dev, chain_no, prio, tcr, flags | TCE_FLAG_LOOPBACK);
 
 	/* verify that the encode & decode have preserved the rule */
 	if (tcr) {
@@ -46,6 +62,7 @@ static void tc_install_handler(EV_P_ const uint32_t chain_no, const uint16_t pri
 
 		ck_assert_ptr_nonnull(tdr);
 		ck_assert_int_eq(tdr->is_done, true);
+		ck_assert_int_eq(tdr->dev, dev);
 		ck_assert_int_eq(tdr->chain_no, chain_no);
 		ck_assert_int_eq(tdr->prio, prio);
 		ck_assert_mem_eq(&tdr->tcr, tcr, sizeof(struct tc_rule));
@@ -54,22 +71,56 @@ static void tc_install_handler(EV_P_ const uint32_t chain_no, const uint16_t pri
 		ck_assert_int_eq(nlh->nlmsg_type, RTM_DELTFILTER);
 	}
 
+	/* act as if the kernel kept it in software */
+	if (tcr && tc_install_not_in_hw) {
+		struct tc_rule found = *tcr;
+
+		obj_rule_netlink_found(RTM_NEWTFILTER, dev, chain_no, prio, &found, 0);
+		return 0;
+	}
+
 	/* act as if we got the netlink message from the kernel */
 	decode_nlmsg_cb(nlh, NULL);
+	return 0;
+}
+
+static void neigh_probe_handler(EV_P_ const int ifindex, const struct af_addr *addr)
+{
+	(void)loop;
+	ck_assert_int_gt(ifindex, 0);
+	ck_assert_ptr_nonnull(addr);
+	neigh_probe_cnt++;
 }
 
 void pre_test(void)
 {
 	struct tc_action_callbacks *tacb;
+	struct neigh_action_callbacks *nacb;
 
 	config_init("test");
+	/* a pretend device, for the loopback install handler */
+	config->if_cnt = 1;
 	assert_all_counts_are_zero();
 	obj_set_mode(OBJ_MODE_NORMAL);
 	sched_setup();
 
+	tc_install_cnt = 0;
+	tc_replace_cnt = 0;
+	neigh_probe_cnt = 0;
+	tc_install_errno = 0;
+	tc_install_not_in_hw = false;
 	obj_rule_init();
 	tacb = tc_action_get_callbacks();
 	tacb->install = tc_install_handler;
+	nacb = neigh_action_get_callbacks();
+	nacb->probe = neigh_probe_handler;
+}
+
+/* for tests, that configure their own devices */
+void pre_test_options(void)
+{
+	pre_test();
+	config->if_cnt = 0;
 }
 
 void post_test(void)
@@ -6,8 +6,15 @@
 
 #include "../src/common.h"
 
+extern unsigned int tc_install_cnt;
+extern unsigned int tc_replace_cnt;
+extern unsigned int neigh_probe_cnt;
+extern int tc_install_errno;
+extern int tc_install_not_in_hw;
+
 void assert_all_counts_are_zero(void);
 void pre_test(void);
+void pre_test_options(void);
 void post_test(void);
 
 #endif
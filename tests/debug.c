@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "common.h"
+#include "debug.h"
+
+static int debug_pipe[2];
+
+static void debug_pre_test(void)
+{
+	struct ev_loop *loop = EV_DEFAULT;
+
+	config_init("test");
+	config->verbosity = VERBOSITY_LEVEL_INFO;
+	AZ(pipe(debug_pipe));
+	AZ(fcntl(debug_pipe[0], F_SETFL, O_NONBLOCK));
+	debug_init(EV_A_ debug_pipe[1]);
+}
+
+static void debug_post_test(void)
+{
+	struct ev_loop *loop = EV_DEFAULT;
+
+	debug_fini(EV_A);
+	close(debug_pipe[0]);
+	close(debug_pipe[1]);
+	config_free();
+}
+
+/* what has been written out so far */
+static char *debug_read(void)
+{
+	static char buf[4096];
+	ssize_t len = read(debug_pipe[0], buf, sizeof(buf) - 1);
+
+	if (len < 0) {
+		ck_assert_int_eq(errno, EAGAIN);
+		len = 0;
+	}
+	buf[len] = '\0';
+	return buf;
+}
+
+START_TEST(test_debug_ring)
+{
+	char long_msg[1024];
+
+	debug_pre_test();
+
+	fr_printf(INFO, "info %d\n", 1);
+	fr_printf(DEBUG1, "hidden\n");
+	ck_assert_str_eq(debug_read(), "");
+
+	/* errors are written out straight away, after what is queued */
+	fr_printf(ERROR, "error %d\n", 2);
+	ck_assert_str_eq(debug_read(), "info 1\nerror 2\n");
+
+	fr_printf(INFO, "info 3\n");
+	memset(long_msg, 'x', sizeof(long_msg) - 2);
+	long_msg[sizeof(long_msg) - 2] = '\n';
+	long_msg[sizeof(long_msg) - 1] = '\0';
+	fr_printf(INFO, "%s", long_msg);
+	ck_assert_int_eq(strncmp(debug_read(), "info 3\nxxxx", 11), 0);
+
+	fr_printf(INFO, "info 4\n");
+	debug_flush();
+	ck_assert_str_eq(debug_read(), "info 4\n");
+
+	debug_post_test();
+}
+END_TEST
+
+START_TEST(test_debug_ratelimit)
+{
+	struct debug_ratelimit rl;
+
+	debug_pre_test();
+	memset(&rl, '\0', sizeof(rl));
+
+	for (int i = 0; i < DEBUG_RATELIMIT_BURST; i++)
+		ck_assert_int_eq(debug_ratelimit(&rl, VERBOSITY_LEVEL_INFO, "f"), true);
+	for (int i = 0; i < 5; i++)
+		ck_assert_int_eq(debug_ratelimit(&rl, VERBOSITY_LEVEL_INFO, "f"), false);
+	ck_assert_uint_eq(rl.missed, 5);
+
+	/* the next interval starts with a summary */
+	rl.begin -= DEBUG_RATELIMIT_INTERVAL;
+	ck_assert_int_eq(debug_ratelimit(&rl, VERBOSITY_LEVEL_INFO, "f"), true);
+	ck_assert_uint_eq(rl.missed, 0);
+	debug_flush();
+	ck_assert_str_eq(debug_read(), "f: 5 messages suppressed\n");
+
+	debug_post_test();
+}
+END_TEST
+
+Suite *suite_debug(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("debug");
+	tc = tcase_create("log");
+	tcase_add_test(tc, test_debug_ring);
+	tcase_add_test(tc, test_debug_ratelimit);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -7,6 +7,7 @@
 #include "scan.h"
 #include "obj.h"
 #include "sched.h"
+#include "debug.h"
 
 static Suite *master_suite(void)
 {
@@ -24,6 +25,7 @@ int main(void)
 	srunner_add_suite(sr, suite_scan());
 	srunner_add_suite(sr, suite_obj());
 	srunner_add_suite(sr, suite_sched());
+	srunner_add_suite(sr, suite_debug());
 
 	srunner_run_all(sr, CK_NORMAL);
 	failed = srunner_ntests_failed(sr);
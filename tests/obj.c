@@ -9,6 +9,12 @@
 #include "../src/obj_target.h"
 #include "../src/obj_rule.h"
 #include "../src/nl_queue.h"
+#include "../src/coalesce.h"
+#include "../src/nl_common.h"
+#include "../src/nl_decode.h"
+#include "../src/trace.h"
+#include "../src/tc_action.h"
+#include "../src/tc_encode.h"
 
 const uint8_t lladdr_a[ETH_ALEN] = { 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf };
 const uint8_t lladdr_b[ETH_ALEN] = { 0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf };
@@ -62,7 +68,30 @@ static void rem_link2(void)
 
 static void update_neigh(const uint16_t nlmsg_type, const uint32_t ifidx, struct af_addr *addr, const uint8_t (*lladdr)[ETH_ALEN])
 {
-	obj_neigh_netlink_update(nlmsg_type, ifidx, addr->af, &addr->in, lladdr);
+	obj_neigh_netlink_update(nlmsg_type, ifidx, addr->af, &addr->in, lladdr, NUD_REACHABLE);
+}
+
+/* as the kernel would send it */
+static void decode_neigh_msg(const int ifidx, const struct af_addr *addr, const uint8_t (*lladdr)[ETH_ALEN], const uint32_t probes)
+{
+	char buf[MNL_SOCKET_DUMP_SIZE];
+	struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
+	struct ndmsg *ndm;
+
+	nlh->nlmsg_type = RTM_NEWNEIGH;
+	ndm = mnl_nlmsg_put_extra_header(nlh, sizeof(struct ndmsg));
+	ndm->ndm_family = addr->af;
+	ndm->ndm_ifindex = ifidx;
+	ndm->ndm_state = NUD_REACHABLE;
+	mnl_attr_put(nlh, NDA_DST, sizeof(struct in_addr), &addr->in);
+	mnl_attr_put(nlh, NDA_LLADDR, ETH_ALEN, lladdr);
+	mnl_attr_put_u32(nlh, NDA_PROBES, probes);
+	ck_assert_int_eq(decode_nlmsg_cb(nlh, NULL), MNL_CB_OK);
+}
+
+static void fail_neigh(const uint32_t ifidx, struct af_addr *addr)
+{
+	obj_neigh_netlink_update(RTM_NEWNEIGH, ifidx, addr->af, &addr->in, NULL, NUD_FAILED);
 }
 
 static void add_neigh1(void)
@@ -240,6 +269,35 @@ START_TEST(obj_neigh_cycle2)
 }
 END_TEST
 
+START_TEST(obj_neigh_fp1)
+{
+	struct obj_neigh *n;
+
+	pre_test();
+	prepare_addresses();
+
+	add_link1();
+	decode_neigh_msg(2, &addr_a, &lladdr_c, 0);
+	n = obj_neigh_fdb_lookup(obj_link_lookup(2), &addr_a);
+	ck_assert_ptr_nonnull(n);
+	ck_assert_mem_eq(n->lladdr, lladdr_c, ETH_ALEN);
+
+	/* unchanged, apart from the probe counter, so it isn't decoded */
+	memcpy(n->lladdr, lladdr_d, ETH_ALEN);
+	decode_neigh_msg(2, &addr_a, &lladdr_c, 1);
+	ck_assert_mem_eq(n->lladdr, lladdr_d, ETH_ALEN);
+
+	/* changed */
+	decode_neigh_msg(2, &addr_a, &lladdr_e, 1);
+	ck_assert_mem_eq(n->lladdr, lladdr_e, ETH_ALEN);
+
+	rem_link1();
+	ck_assert_int_eq(obj_neigh_count(), 0);
+
+	post_test();
+}
+END_TEST
+
 START_TEST(obj_neigh_cycle3)
 {
 	struct af_addr addrs[256];
@@ -320,6 +378,48 @@ START_TEST(obj_target_cycle1)
 }
 END_TEST
 
+START_TEST(obj_neigh_probe1)
+{
+	struct obj_neigh *n;
+	struct obj_target *t;
+	struct af_addr net1 = { .af = AF_INET, .mask_len = 25 };
+	struct af_addr net2 = { .af = AF_INET, .mask_len = 24 };
+
+	ck_assert_int_eq(inet_pton(AF_INET, "192.0.2.128", &net1.in), 1);
+	ck_assert_int_eq(inet_pton(AF_INET, "198.51.100.0", &net2.in), 1);
+
+	pre_test();
+	prepare_addresses();
+	obj_rule_reset_pin();
+
+	add_link1();
+
+	/* the routes arrive before the kernel has resolved the gateway */
+	n = obj_neigh_netlink_get(2, addr_a.af, &addr_a.in);
+	ck_assert_ptr_nonnull(n);
+	ck_assert_ptr_eq(obj_neigh_fdb_lookup(obj_link_lookup(2), &addr_a), n);
+	t = obj_target_get_unipath(n);
+	obj_route_netlink_update(RTM_NEWROUTE, t, &net1);
+	ck_assert_int_eq(neigh_probe_cnt, 1);
+	obj_route_netlink_update(RTM_NEWROUTE, t, &net2);
+	ck_assert_int_eq(neigh_probe_cnt, 1); /* rate limited */
+	obj_rule_remove_pin();
+	ck_assert_ptr_null(t->rule);
+
+	/* once resolved, the same neighbour is used */
+	add_neigh1();
+	ck_assert_int_eq(obj_neigh_count(), 1);
+	ck_assert_ptr_nonnull(t->rule);
+	ck_assert_int_eq(t->rule->state, OBJ_RULE_STATE_OK);
+	ck_assert_int_eq(obj_rule_count(), 3);
+
+	obj_set_mode(OBJ_MODE_TEARDOWN);
+	rem_link1(); /* this should clean up all the objects */
+
+	post_test();
+}
+END_TEST
+
 START_TEST(obj_route_cycle1)
 {
 	struct obj_target *t;
@@ -349,6 +449,602 @@ START_TEST(obj_route_cycle1)
 }
 END_TEST
 
+START_TEST(obj_route_move1)
+{
+	struct obj_target *t1, *t2;
+	struct obj_route *r;
+	struct af_addr my_net = { .af = AF_INET, .mask_len = 25 };
+
+	ck_assert_int_eq(inet_pton(AF_INET, "192.0.2.128", &my_net.in), 1);
+
+	pre_test();
+	prepare_addresses();
+	obj_rule_reset_pin();
+	obj_rule_remove_pin();
+
+	add_link1();
+	add_link2();
+	add_neigh1();
+	add_neigh2();
+	t1 = add_target1();
+	t2 = add_target2();
+	obj_route_netlink_update(RTM_NEWROUTE, t1, &my_net);
+	ck_assert_int_eq(obj_rule_count(), 2);
+	r = obj_route_lookup(&my_net);
+	ck_assert_ptr_nonnull(r);
+	ck_assert_int_eq(r->rule->want->goto_target, t1->rule->chain_no);
+
+	/* the route must follow its new target, to the other chain */
+	obj_route_netlink_update(RTM_NEWROUTE, t2, &my_net);
+	ck_assert_int_eq(obj_rule_count(), 3);
+	ck_assert_ptr_eq(r->target_rule, t2->rule);
+	ck_assert_int_eq(r->rule->want->goto_target, t2->rule->chain_no);
+	ck_assert_int_eq(r->rule->state, OBJ_RULE_STATE_OK);
+	ck_assert_ptr_null(t1->first_route);
+
+	obj_route_netlink_update(RTM_NEWROUTE, t1, &my_net);
+	ck_assert_int_eq(r->rule->want->goto_target, t1->rule->chain_no);
+	ck_assert_ptr_null(t2->first_route);
+
+	obj_set_mode(OBJ_MODE_TEARDOWN);
+	rem_link1();
+	rem_link2();
+
+	post_test();
+}
+END_TEST
+
+START_TEST(obj_route_full1)
+{
+	struct obj_target *t;
+	struct obj_route *r;
+	struct tc_rule tcr = {0};
+	int refcnt;
+	struct af_addr my_net = { .af = AF_INET, .mask_len = 25 };
+
+	ck_assert_int_eq(inet_pton(AF_INET, "192.0.2.128", &my_net.in), 1);
+
+	pre_test();
+	prepare_addresses();
+	obj_rule_reset_pin();
+
+	/* take every prio that routes can have in chain 1 */
+	tc_rule_init(&tcr);
+	tcr.af_addr.af = AF_INET;
+	tc_rule_set_type_and_traits(&tcr, TC_RULE_TYPE_TTL_CHECK);
+	for (unsigned int prio = 100; prio <= UINT16_MAX; prio++)
+		obj_rule_static_want(1, prio, &tcr);
+
+	add_link1();
+	add_neigh1();
+	t = add_target1();
+	obj_route_netlink_update(RTM_NEWROUTE, t, &my_net);
+	obj_rule_remove_pin();
+
+	/* the route stays in software */
+	r = obj_route_lookup(&my_net);
+	ck_assert_ptr_nonnull(r);
+	ck_assert_ptr_nonnull(t->rule);
+	ck_assert_int_eq(t->rule->state, OBJ_RULE_STATE_OK);
+	ck_assert_ptr_null(r->rule);
+	ck_assert_ptr_eq(r->target_rule, t->rule);
+	refcnt = t->rule->obj.refcnt;
+
+	/* each retry, doesn't take another reference on the target rule */
+	for (int i = 0; i < 3; i++)
+		obj_route_netlink_update(RTM_NEWROUTE, t, &my_net);
+	ck_assert_ptr_null(r->rule);
+	ck_assert_int_eq(t->rule->obj.refcnt, refcnt);
+
+	obj_set_mode(OBJ_MODE_TEARDOWN);
+	rem_link1();
+	obj_rule_clear_all();
+	ck_assert_int_eq(obj_rule_count(), 0);
+
+	post_test();
+}
+END_TEST
+
+START_TEST(obj_rule_trace1)
+{
+	struct obj_target *t;
+	struct af_addr my_net = { .af = AF_INET, .mask_len = 25 };
+	struct af_addr my_net2 = { .af = AF_INET, .mask_len = 25 };
+	const struct hist *total = trace_get_total();
+	const struct trace_slow *ts;
+	uint64_t cnt = total->cnt;
+	ev_tstamp prev;
+
+	ck_assert_int_eq(inet_pton(AF_INET, "192.0.2.128", &my_net.in), 1);
+	ck_assert_int_eq(inet_pton(AF_INET, "192.0.2.0", &my_net2.in), 1);
+
+	pre_test();
+	prepare_addresses();
+	obj_rule_reset_pin();
+
+	add_link1();
+	add_neigh1();
+	t = add_target1();
+	obj_route_netlink_update(RTM_NEWROUTE, t, &my_net);
+	obj_rule_remove_pin();
+	/* the target rule, and the route rule */
+	ck_assert_int_eq(total->cnt, cnt + 2);
+
+	/* a route event, that was decoded a second ago */
+	prev = trace_event_begin(ev_time() - 1.);
+	obj_route_netlink_update(RTM_NEWROUTE, t, &my_net2);
+	trace_event_end(prev);
+	ck_assert_int_eq(total->cnt, cnt + 3);
+	ck_assert(total->max >= 1.);
+
+	/* the slowest one so far, so it is in the ring */
+	ts = trace_get_slow(0);
+	ck_assert_ptr_nonnull(ts);
+	ck_assert_str_eq(ts->op, "install");
+	for (int i = TRACE_STAGE_QUEUED; i < TRACE_STAGE_CNT; i++)
+		ck_assert(ts->ts[i] >= ts->ts[TRACE_STAGE_EVENT] + 1.);
+	ck_assert(ts->ts[TRACE_STAGE_SENT] >= ts->ts[TRACE_STAGE_QUEUED]);
+
+	obj_set_mode(OBJ_MODE_TEARDOWN);
+	rem_link1(); /* this should clean up all the objects */
+
+	post_test();
+}
+END_TEST
+
+START_TEST(obj_rule_fail1)
+{
+	struct ev_loop *loop = EV_DEFAULT;
+	struct obj_target *t;
+	struct obj_rule *r;
+	struct tc_rule tcr;
+	struct af_addr my_net = { .af = AF_INET, .mask_len = 25 };
+
+	ck_assert_int_eq(inet_pton(AF_INET, "192.0.2.128", &my_net.in), 1);
+
+	pre_test();
+	prepare_addresses();
+	obj_rule_reset_pin();
+
+	add_link1();
+	add_neigh1();
+	t = add_target1();
+	obj_route_netlink_update(RTM_NEWROUTE, t, &my_net);
+
+	/* a full hardware table, is retried after a backoff */
+	tc_install_errno = ENOSPC;
+	obj_rule_remove_pin();
+	r = t->rule;
+	ck_assert_ptr_nonnull(r);
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_FAILED);
+	ck_assert_int_eq(r->nl_errno, ENOSPC);
+	ck_assert_int_eq(r->failures, 1);
+	ck_assert_int_ne(ev_is_active(&r->retry_timer), 0);
+
+	tc_install_cnt = 0;
+	ev_invoke(EV_A_ &r->retry_timer, EV_TIMER);
+	ck_assert_int_eq(tc_install_cnt, 1);
+	ck_assert_int_eq(r->failures, 2);
+	ck_assert(ev_timer_remaining(EV_A_ &r->retry_timer) > 1.); /* backing off */
+
+	/* an unoffloadable rule isn't sent again, until the cache expires */
+	tc_install_errno = EOPNOTSUPP;
+	ev_invoke(EV_A_ &r->retry_timer, EV_TIMER);
+	ck_assert_int_eq(tc_install_cnt, 2);
+	ck_assert_int_eq(r->nl_errno, EOPNOTSUPP);
+	ev_invoke(EV_A_ &r->retry_timer, EV_TIMER);
+	ck_assert_int_eq(tc_install_cnt, 2);
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_FAILED);
+	ck_assert_int_ne(ev_is_active(&r->retry_timer), 0);
+
+	/* a new want is tried right away */
+	tc_install_errno = 0;
+	tcr = *r->want;
+	tcr.vlan_id++;
+	obj_rule_replace_want(r, &tcr);
+	ck_assert_int_eq(tc_install_cnt, 4); /* and the route waiting for it */
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
+	ck_assert_int_eq(r->failures, 0);
+	ck_assert_int_eq(ev_is_active(&r->retry_timer), 0);
+
+	/* a filter that is already gone, counts as uninstalled */
+	ck_assert_int_eq(obj_rule_count(), 2);
+	tc_install_errno = ENOENT;
+	obj_route_netlink_update(RTM_DELROUTE, t, &my_net);
+	ck_assert_int_eq(obj_rule_count(), 1);
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
+	tc_install_errno = 0;
+
+	obj_set_mode(OBJ_MODE_TEARDOWN);
+	rem_link1(); /* this should clean up all the objects */
+
+	post_test();
+}
+END_TEST
+
+START_TEST(obj_rule_hw1)
+{
+	struct ev_loop *loop = EV_DEFAULT;
+	struct obj_rule_hw_stats st;
+	struct obj_target *t;
+	struct obj_rule *r;
+	struct tc_rule tcr;
+	struct af_addr my_net = { .af = AF_INET, .mask_len = 25 };
+
+	ck_assert_int_eq(inet_pton(AF_INET, "192.0.2.128", &my_net.in), 1);
+
+	pre_test();
+	prepare_addresses();
+	obj_rule_reset_pin();
+
+	add_link1();
+	add_neigh1();
+	t = add_target1();
+	obj_route_netlink_update(RTM_NEWROUTE, t, &my_net);
+	obj_rule_remove_pin();
+	r = t->rule;
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
+	ck_assert_int_eq(r->in_hw_count, 1);
+
+	/* the kernel reports it as kept in software */
+	tcr = *r->have;
+	obj_rule_netlink_found(RTM_NEWTFILTER, 0, r->chain_no, r->prio, &tcr, 0);
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
+	ck_assert_int_eq(r->in_hw_count, 0);
+	ck_assert_int_ne(ev_is_active(&r->retry_timer), 0);
+	obj_rule_get_hw_stats(&st);
+	ck_assert_int_eq(st.total[TC_RULE_TYPE_FORWARD], 1);
+	ck_assert_int_eq(st.in_hw[TC_RULE_TYPE_FORWARD], 0);
+
+	/* so it is re-placed, after a backoff */
+	tc_replace_cnt = 0;
+	ev_invoke(EV_A_ &r->retry_timer, EV_TIMER);
+	ck_assert_int_eq(tc_replace_cnt, 1);
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
+	ck_assert_int_eq(r->in_hw_count, 1);
+	ck_assert_int_eq(r->hw_retries, 0);
+	obj_rule_get_hw_stats(&st);
+	ck_assert_int_eq(st.in_hw[TC_RULE_TYPE_FORWARD], 1);
+
+	/* one that stays out of hardware, is re-placed as often as allowed */
+	tc_install_not_in_hw = true;
+	tc_replace_cnt = 0;
+	tcr = *r->have;
+	obj_rule_netlink_found(RTM_NEWTFILTER, 0, r->chain_no, r->prio, &tcr, 0);
+	for (int i = 0; i < 3; i++) { /* OBJ_RULE_HW_RETRIES */
+		ck_assert_int_ne(ev_is_active(&r->retry_timer), 0);
+		ev_invoke(EV_A_ &r->retry_timer, EV_TIMER);
+	}
+	ck_assert_int_eq(tc_replace_cnt, 3);
+	ck_assert_int_eq(ev_is_active(&r->retry_timer), 0);
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
+	ck_assert_int_eq(r->in_hw_count, 0);
+	tc_install_not_in_hw = false;
+
+	obj_set_mode(OBJ_MODE_TEARDOWN);
+	rem_link1(); /* this should clean up all the objects */
+
+	post_test();
+}
+END_TEST
+
+START_TEST(obj_rule_echo_encode1)
+{
+	char buf[MNL_SOCKET_DUMP_SIZE];
+	struct nlmsghdr *nlh;
+	struct tc_rule tcr = {0};
+
+	pre_test();
+	tc_rule_init(&tcr);
+	tcr.af_addr.af = AF_INET;
+	tc_rule_set_type_and_traits(&tcr, TC_RULE_TYPE_TTL_CHECK);
+
+	/* install, replace and uninstall ask for an echo, when told to */
+	nlh = mnl_nlmsg_put_header(buf);
+	tc_encode_rule(nlh, 0, 1, 1, &tcr, NO_TCE_FLAGS);
+	ck_assert_int_eq(nlh->nlmsg_flags & NLM_F_ECHO, 0);
+	nlh = mnl_nlmsg_put_header(buf);
+	tc_encode_rule(nlh, 0, 1, 1, &tcr, TCE_FLAG_ECHO);
+	ck_assert_int_eq(nlh->nlmsg_type, RTM_NEWTFILTER);
+	ck_assert_int_ne(nlh->nlmsg_flags & NLM_F_ECHO, 0);
+	ck_assert_int_ne(nlh->nlmsg_flags & NLM_F_EXCL, 0);
+	nlh = mnl_nlmsg_put_header(buf);
+	tc_encode_rule(nlh, 0, 1, 1, &tcr, TCE_FLAG_REPLACE | TCE_FLAG_ECHO);
+	ck_assert_int_ne(nlh->nlmsg_flags & NLM_F_ECHO, 0);
+	ck_assert_int_ne(nlh->nlmsg_flags & NLM_F_REPLACE, 0);
+
+	nlh = mnl_nlmsg_put_header(buf);
+	tc_encode_rule(nlh, 0, 1, 1, NULL, NO_TCE_FLAGS);
+	ck_assert_int_eq(nlh->nlmsg_flags & NLM_F_ECHO, 0);
+	nlh = mnl_nlmsg_put_header(buf);
+	tc_encode_rule(nlh, 0, 1, 1, NULL, TCE_FLAG_ECHO);
+	ck_assert_int_eq(nlh->nlmsg_type, RTM_DELTFILTER);
+	ck_assert_int_ne(nlh->nlmsg_flags & NLM_F_ECHO, 0);
+
+	/* but a chain flush doesn't */
+	nlh = mnl_nlmsg_put_header(buf);
+	tc_encode_drop_chain(nlh, 0, 1, TCE_FLAG_ECHO);
+	ck_assert_int_eq(nlh->nlmsg_flags & NLM_F_ECHO, 0);
+
+	post_test();
+}
+END_TEST
+
+/* the request, that is in flight on the install lane */
+static struct conn echo_conn;
+static unsigned int echo_dev;
+static uint32_t echo_chain_no;
+static uint16_t echo_prio;
+static struct tc_rule *echo_tcr;
+static unsigned int echo_sent_cnt;
+
+/* as tc_action_do_install(), but the request is only marked as sent */
+static int echo_install_handler(EV_P_ const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, int flags)
+{
+	char buf[MNL_SOCKET_DUMP_SIZE];
+	struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
+
+	fr_ev_unused();
+	tc_encode_rule(nlh, dev, chain_no, prio, tcr, flags | TCE_FLAG_ECHO);
+	ck_assert_int_ne(nlh->nlmsg_flags & NLM_F_ECHO, 0);
+	echo_dev = dev;
+	echo_chain_no = chain_no;
+	echo_prio = prio;
+	echo_tcr = tcr;
+	echo_sent_cnt++;
+	echo_conn.on_send_req(&echo_conn);
+	return 0;
+}
+
+START_TEST(obj_rule_echo1)
+{
+	struct ev_loop *loop = EV_DEFAULT;
+	struct tc_action_callbacks *tacb;
+	int (*loopback)(EV_P_ const unsigned int dev, const uint32_t chain_no, const uint16_t prio, struct tc_rule *tcr, int flags);
+	char buf[MNL_SOCKET_DUMP_SIZE];
+	struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
+	struct obj_target *t;
+	struct obj_rule *r;
+	struct af_addr my_net = { .af = AF_INET, .mask_len = 25 };
+
+	ck_assert_int_eq(inet_pton(AF_INET, "192.0.2.128", &my_net.in), 1);
+
+	pre_test();
+	prepare_addresses();
+	obj_rule_reset_pin();
+	obj_rule_remove_pin();
+	memset(&echo_conn, '\0', sizeof(echo_conn));
+	echo_sent_cnt = 0;
+	queue_init(QUEUE_LANE_INSTALL, &echo_conn);
+	tacb = tc_action_get_callbacks();
+	loopback = tacb->install;
+	tacb->install = echo_install_handler;
+
+	add_link1();
+	add_neigh1();
+	t = add_target1();
+	obj_route_netlink_update(RTM_NEWROUTE, t, &my_net);
+
+	/* the target rule is sent, and waits for the kernel */
+	r = t->rule;
+	ck_assert_int_eq(echo_sent_cnt, 1);
+	ck_assert_ptr_eq(echo_tcr, r->want);
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_PENDING);
+	ck_assert_ptr_null(r->have);
+
+	/* the echo comes ahead of the ACK, and confirms it */
+	tc_encode_rule(nlh, echo_dev, echo_chain_no, echo_prio, echo_tcr, TCE_FLAG_LOOPBACK);
+	ck_assert_int_eq(decode_nlmsg_cb(nlh, NULL), MNL_CB_OK);
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
+	ck_assert_ptr_nonnull(r->have);
+	ck_assert_int_eq(echo_sent_cnt, 1); /* the route's rule is still queued */
+
+	/* the ACK completes the request, and the queue carries on */
+	tacb->install = loopback;
+	echo_conn.on_complete(EV_A_ &echo_conn, 0);
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
+	ck_assert_int_eq(tc_install_cnt, 1);
+	ck_assert_int_eq(obj_rule_count(), 2);
+
+	obj_set_mode(OBJ_MODE_TEARDOWN);
+	rem_link1(); /* this should clean up all the objects */
+	queue_fini(QUEUE_LANE_INSTALL);
+
+	post_test();
+}
+END_TEST
+
+START_TEST(obj_rule_terse1)
+{
+	struct obj_target *t;
+	struct obj_rule *r;
+	struct af_addr my_net = { .af = AF_INET, .mask_len = 25 };
+
+	ck_assert_int_eq(inet_pton(AF_INET, "192.0.2.128", &my_net.in), 1);
+
+	pre_test();
+	prepare_addresses();
+	obj_rule_reset_pin();
+
+	add_link1();
+	add_neigh1();
+	t = add_target1();
+	obj_route_netlink_update(RTM_NEWROUTE, t, &my_net);
+	obj_rule_remove_pin();
+	r = t->rule;
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
+
+	/* as expected */
+	obj_rule_terse_seen(0, r->chain_no, r->prio, true, r->have->flower_flags, 1);
+	ck_assert_int_eq(obj_rule_terse_verify(0, r->chain_no), false);
+
+	/* missing from the dump */
+	ck_assert_int_eq(obj_rule_terse_verify(0, r->chain_no), true);
+
+	/* different flags */
+	obj_rule_terse_seen(0, r->chain_no, r->prio, true, r->have->flower_flags ^ TCA_CLS_FLAGS_SKIP_SW, 1);
+	ck_assert_int_eq(obj_rule_terse_verify(0, r->chain_no), true);
+
+	/* not one of ours */
+	obj_rule_terse_seen(0, r->chain_no, r->prio + 1, true, 0, 0);
+	obj_rule_terse_seen(0, r->chain_no, r->prio, true, r->have->flower_flags, 1);
+	ck_assert_int_eq(obj_rule_terse_verify(0, r->chain_no), true);
+
+	/* a terse dump of another chain, doesn't involve this one */
+	ck_assert_int_eq(obj_rule_terse_verify(0, r->chain_no + 1), false);
+
+	obj_set_mode(OBJ_MODE_TEARDOWN);
+	rem_link1(); /* this should clean up all the objects */
+
+	post_test();
+}
+END_TEST
+
+static void flushed_cb(void *data)
+{
+	int *flushed = data;
+
+	(*flushed)++;
+}
+
+START_TEST(obj_rule_flush1)
+{
+	struct obj_target *t;
+	struct obj_rule *r;
+	struct af_addr my_net = { .af = AF_INET, .mask_len = 25 };
+	int flushed = 0;
+	int chains;
+
+	ck_assert_int_eq(inet_pton(AF_INET, "192.0.2.128", &my_net.in), 1);
+
+	pre_test();
+	prepare_addresses();
+	obj_rule_reset_pin();
+
+	add_link1();
+	add_neigh1();
+	t = add_target1();
+	obj_route_netlink_update(RTM_NEWROUTE, t, &my_net);
+	obj_rule_remove_pin();
+	r = t->rule;
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
+
+	/* re-layout, one request per chain, and then installed afresh */
+	tc_install_cnt = 0;
+	chains = obj_rule_flush(flushed_cb, &flushed);
+	ck_assert_int_gt(chains, 0);
+	ck_assert_int_eq(flushed, 1);
+	ck_assert_int_eq(tc_install_cnt, chains + obj_rule_count());
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
+	ck_assert_ptr_nonnull(r->have);
+
+	/* at exit, while pinned, nothing is installed again */
+	obj_rule_reset_pin();
+	tc_install_cnt = 0;
+	ck_assert_int_eq(obj_rule_flush(flushed_cb, &flushed), chains);
+	ck_assert_int_eq(flushed, 2);
+	ck_assert_int_eq(tc_install_cnt, chains);
+	ck_assert_ptr_null(r->have);
+
+	/* nothing left to flush */
+	ck_assert_int_eq(obj_rule_flush(flushed_cb, &flushed), 0);
+	ck_assert_int_eq(flushed, 2);
+
+	obj_set_mode(OBJ_MODE_TEARDOWN);
+	rem_link1(); /* this should clean up all the objects */
+
+	post_test();
+}
+END_TEST
+
+START_TEST(obj_rule_multidev1)
+{
+	struct obj_target *t;
+	struct obj_route *route;
+	struct obj_rule *r, *m;
+	struct af_addr my_net = { .af = AF_INET, .mask_len = 25 };
+
+	ck_assert_int_eq(inet_pton(AF_INET, "192.0.2.128", &my_net.in), 1);
+
+	pre_test();
+	config->ifidx[1] = 7;
+	config->if_cnt = 2;
+	prepare_addresses();
+	obj_rule_reset_pin();
+
+	add_link1();
+	add_neigh1();
+	t = add_target1();
+	obj_route_netlink_update(RTM_NEWROUTE, t, &my_net);
+	obj_rule_remove_pin();
+
+	/* the graph is shared, the rules are on both devices */
+	ck_assert_int_eq(obj_target_count(), 1);
+	ck_assert_int_eq(obj_route_count(), 1);
+	ck_assert_int_eq(obj_rule_count(), 4);
+	ck_assert_int_eq(tc_install_cnt, 4);
+	r = t->rule;
+	m = r->mirror;
+	ck_assert_ptr_nonnull(m);
+	ck_assert_ptr_null(m->mirror);
+	ck_assert_int_eq(m->dev, 1);
+	ck_assert_ptr_eq(obj_rule_pos_lookup(1, r->chain_no, r->prio), m);
+	ck_assert_int_eq(m->state, OBJ_RULE_STATE_OK);
+	ck_assert_int_eq(m->have->egress_ifindex, 1);
+	ck_assert_int_eq(obj_rule_is_ok(r), true);
+	route = obj_route_lookup(&my_net);
+	ck_assert_ptr_nonnull(route);
+	ck_assert_ptr_nonnull(route->rule);
+	ck_assert_int_eq(obj_rule_is_ok(route->rule), true);
+
+	/* a rule gone from one device is only re-installed there */
+	tc_install_cnt = 0;
+	obj_rule_netlink_found(RTM_DELTFILTER, 1, m->chain_no, m->prio, NULL, 0);
+	ck_assert_int_eq(tc_install_cnt, 1);
+	ck_assert_int_eq(m->state, OBJ_RULE_STATE_OK);
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
+
+	obj_set_mode(OBJ_MODE_TEARDOWN);
+	rem_link1(); /* this should clean up all the objects */
+
+	post_test();
+}
+END_TEST
+
+START_TEST(obj_rule_block1)
+{
+	struct obj_target *t;
+	struct af_addr my_net = { .af = AF_INET, .mask_len = 25 };
+
+	ck_assert_int_eq(inet_pton(AF_INET, "192.0.2.128", &my_net.in), 1);
+
+	pre_test();
+	config->ifidx[1] = 7;
+	config->if_cnt = 2;
+	config->block_index = 42;
+	prepare_addresses();
+	obj_rule_reset_pin();
+
+	add_link1();
+	add_neigh1();
+	t = add_target1();
+	obj_route_netlink_update(RTM_NEWROUTE, t, &my_net);
+	obj_rule_remove_pin();
+
+	/* the devices share the block, so each rule is installed once */
+	ck_assert_int_eq(obj_rule_count(), 2);
+	ck_assert_int_eq(tc_install_cnt, 2);
+	ck_assert_ptr_null(t->rule->mirror);
+	ck_assert_int_eq(obj_rule_is_ok(t->rule), true);
+	ck_assert_ptr_eq(obj_rule_pos_lookup(0, t->rule->chain_no, t->rule->prio), t->rule);
+
+	obj_set_mode(OBJ_MODE_TEARDOWN);
+	rem_link1(); /* this should clean up all the objects */
+
+	post_test();
+}
+END_TEST
+
 START_TEST(obj_route_cycle2)
 {
 	struct obj_target *t1, *t2, *t3;
@@ -428,7 +1124,7 @@ START_TEST(obj_route_cycle2)
 
 	struct obj_rule *r;
 
-	r = obj_rule_pos_lookup(1, 100);
+	r = obj_rule_pos_lookup(0, 1, 100);
 	ck_assert_ptr_nonnull(r);
 	ck_assert_int_eq(r->chain_no, 1);
 	ck_assert_int_eq(r->prio, 100);
@@ -436,7 +1132,7 @@ START_TEST(obj_route_cycle2)
 	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
 	ck_assert_int_eq(r->have->af_addr.af, AF_INET);
 
-	r = obj_rule_pos_lookup(1, 101);
+	r = obj_rule_pos_lookup(0, 1, 101);
 	ck_assert_ptr_nonnull(r);
 	ck_assert_int_eq(r->chain_no, 1);
 	ck_assert_int_eq(r->prio, 101);
@@ -444,7 +1140,7 @@ START_TEST(obj_route_cycle2)
 	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
 	ck_assert_int_eq(r->have->af_addr.af, AF_INET);
 
-	r = obj_rule_pos_lookup(1, 102);
+	r = obj_rule_pos_lookup(0, 1, 102);
 	ck_assert_ptr_nonnull(r);
 	ck_assert_int_eq(r->chain_no, 1);
 	ck_assert_int_eq(r->prio, 102);
@@ -452,7 +1148,7 @@ START_TEST(obj_route_cycle2)
 	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
 	ck_assert_int_eq(r->have->af_addr.af, AF_INET);
 
-	r = obj_rule_pos_lookup(2, 100);
+	r = obj_rule_pos_lookup(0, 2, 100);
 	ck_assert_ptr_nonnull(r);
 	ck_assert_int_eq(r->chain_no, 2);
 	ck_assert_int_eq(r->prio, 100);
@@ -460,22 +1156,57 @@ START_TEST(obj_route_cycle2)
 	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
 	ck_assert_int_eq(r->have->af_addr.af, AF_INET6);
 
-	/* change MAC on link2 */
+	/* change MAC on link2, the rule is rewritten in place */
+	unsigned int install_cnt = tc_install_cnt;
+	struct obj_rule *t2_rule = t2->rule;
+
 	add_link2_mac_c();
 
 	obj_rule_print_all();
 	ck_assert_int_eq(obj_rule_count(), 7);
+	ck_assert_ptr_eq(t2->rule, t2_rule);
+	ck_assert_int_eq(t2->rule->state, OBJ_RULE_STATE_OK);
+	ck_assert_int_eq(t2->rule->chain_no, 6);
+	ck_assert_int_eq(t2->rule->prio, 1);
+	ck_assert_mem_eq(&t2->rule->have->lladdr.src, &lladdr_c, ETH_ALEN);
+	ck_assert_mem_eq(&t2->rule->have->lladdr.dst, &lladdr_d, ETH_ALEN);
+	ck_assert_int_eq(tc_replace_cnt, 1);
+	ck_assert_int_eq(tc_install_cnt, install_cnt);
 
-	/* TODO: verify that the rules updated to the new mac */
-	/* TODO: verify the order that the rule was updated in */
-
+	/* change MAC of the IPv6 nexthop, the route keeps its goto */
 	update_neigh(RTM_NEWNEIGH, 2, &addr_e, &lladdr_f);
-	/* TODO: verify that the rules updated to the new mac */
-	/* TODO: verify the order that the rule was updated in */
+	ck_assert_int_eq(obj_rule_count(), 7);
+	ck_assert_int_eq(t3->rule->state, OBJ_RULE_STATE_OK);
+	ck_assert_int_eq(t3->rule->chain_no, 7);
+	ck_assert_int_eq(t3->rule->prio, 1);
+	ck_assert_mem_eq(&t3->rule->have->lladdr.dst, &lladdr_f, ETH_ALEN);
+	ck_assert_int_eq(tc_replace_cnt, 2);
+	ck_assert_int_eq(tc_install_cnt, install_cnt);
 
+	r = obj_rule_pos_lookup(0, 2, 100);
+	ck_assert_ptr_nonnull(r);
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
+	ck_assert_int_eq(r->have->goto_target, 7);
+
+	/* the nexthop fails, so the chain traps to the CPU instead */
+	fail_neigh(2, &addr_e);
+	ck_assert_int_eq(obj_rule_count(), 7);
+	ck_assert_int_eq(t3->rule->state, OBJ_RULE_STATE_OK);
+	ck_assert_int_eq(t3->rule->chain_no, 7);
+	ck_assert_int_eq(t3->rule->have->type, TC_RULE_TYPE_FORWARD_TRAP);
+	ck_assert_int_eq(tc_replace_cnt, 3);
+	ck_assert_int_eq(tc_install_cnt, install_cnt);
+	ck_assert_ptr_eq(obj_rule_pos_lookup(0, 2, 100), r);
+	ck_assert_int_eq(r->state, OBJ_RULE_STATE_OK);
 
-	/* TODO make neigh invalid */
-	/* TODO confirm that routes are uninstalled */
+	/* and forwards again once it is reachable */
+	update_neigh(RTM_NEWNEIGH, 2, &addr_e, &lladdr_f);
+	ck_assert_int_eq(t3->rule->state, OBJ_RULE_STATE_OK);
+	ck_assert_int_eq(t3->rule->chain_no, 7);
+	ck_assert_int_eq(t3->rule->have->type, TC_RULE_TYPE_FORWARD);
+	ck_assert_mem_eq(&t3->rule->have->lladdr.dst, &lladdr_f, ETH_ALEN);
+	ck_assert_int_eq(tc_replace_cnt, 4);
+	ck_assert_int_eq(tc_install_cnt, install_cnt);
 
 	obj_set_mode(OBJ_MODE_TEARDOWN);
 	rem_link2();
@@ -485,6 +1216,178 @@ START_TEST(obj_route_cycle2)
 }
 END_TEST
 
+START_TEST(obj_route_coalesce1)
+{
+	struct obj_target *t;
+	struct af_addr net1 = { .af = AF_INET, .mask_len = 25 };
+
+	ck_assert_int_eq(inet_pton(AF_INET, "192.0.2.128", &net1.in), 1);
+
+	pre_test();
+	prepare_addresses();
+	config->coalesce_ms = 50;
+	obj_rule_remove_pin();
+
+	add_link1();
+	coalesce_neigh_update(RTM_NEWNEIGH, 2, addr_a.af, &addr_a.in, &lladdr_d, NUD_REACHABLE);
+	coalesce_neigh_update(RTM_NEWNEIGH, 2, addr_a.af, &addr_a.in, &lladdr_c, NUD_REACHABLE);
+	ck_assert_int_eq(obj_neigh_count(), 0);
+	coalesce_flush(EV_DEFAULT);
+	ck_assert_int_eq(obj_neigh_count(), 1);
+	t = add_target1();
+
+	/* a flap within the window, only the final state is applied */
+	coalesce_route_update(RTM_NEWROUTE, t, &net1);
+	coalesce_route_update(RTM_DELROUTE, t, &net1);
+	coalesce_route_update(RTM_NEWROUTE, t, &net1);
+	ck_assert_int_eq(coalesce_pending_count(), 1);
+	ck_assert_int_eq(obj_route_count(), 0);
+	coalesce_flush(EV_DEFAULT);
+	ck_assert_int_eq(coalesce_pending_count(), 0);
+	ck_assert_int_eq(obj_route_count(), 1);
+	ck_assert_int_eq(obj_rule_count(), 2);
+	ck_assert_int_eq(tc_install_cnt, 2);
+
+	/* keeps flapping, so withdrawals go through, but it is held back */
+	coalesce_route_update(RTM_DELROUTE, t, &net1);
+	coalesce_route_update(RTM_NEWROUTE, t, &net1);
+	ck_assert_int_eq(obj_route_count(), 1);
+	coalesce_route_update(RTM_DELROUTE, t, &net1);
+	ck_assert_int_eq(obj_route_count(), 0);
+	coalesce_route_update(RTM_NEWROUTE, t, &net1);
+	coalesce_flush(EV_DEFAULT);
+	ck_assert_int_eq(coalesce_pending_count(), 1);
+	ck_assert_int_eq(obj_route_count(), 0);
+
+	coalesce_fini(EV_DEFAULT);
+	obj_set_mode(OBJ_MODE_TEARDOWN);
+	rem_link1(); /* this should clean up all the objects */
+
+	post_test();
+}
+END_TEST
+
+START_TEST(obj_nexthop_cycle1)
+{
+	struct obj_link *l;
+	struct obj_neigh *n1, *n2;
+	struct obj_target *t;
+	struct af_addr net1 = { .af = AF_INET, .mask_len = 24 };
+	struct af_addr net2 = { .af = AF_INET, .mask_len = 24 };
+
+	ck_assert_int_eq(inet_pton(AF_INET, "198.51.100.0", &net1.in), 1);
+	ck_assert_int_eq(inet_pton(AF_INET, "203.0.113.0", &net2.in), 1);
+
+	pre_test();
+	prepare_addresses();
+	config->verbosity = VERBOSITY_LEVEL_ERROR;
+	obj_rule_reset_pin();
+
+	add_link1();
+	add_neigh1();
+	update_neigh(RTM_NEWNEIGH, 2, &addr_c, &lladdr_d);
+	l = obj_link_lookup(2);
+	n1 = obj_neigh_fdb_lookup(l, &addr_a);
+	n2 = obj_neigh_fdb_lookup(l, &addr_c);
+	ck_assert_ptr_nonnull(n1);
+	ck_assert_ptr_nonnull(n2);
+
+	/* nexthop object, referenced by two routes */
+	obj_target_nhid_netlink_update(RTM_NEWNEXTHOP, 10, n1, NULL, 0);
+	t = obj_target_nhid_lookup(10);
+	ck_assert_ptr_nonnull(t);
+	ck_assert_ptr_ne(t, obj_target_get_unipath(n1));
+	obj_route_netlink_update(RTM_NEWROUTE, t, &net1);
+	obj_route_netlink_update(RTM_NEWROUTE, t, &net2);
+	obj_rule_remove_pin();
+	ck_assert_int_eq(t->rule->state, OBJ_RULE_STATE_OK);
+	ck_assert_mem_eq(&t->rule->have->lladdr.dst, &lladdr_c, ETH_ALEN);
+
+	/* re-pointing the nexthop keeps the routes on the same target */
+	obj_target_nhid_netlink_update(RTM_NEWNEXTHOP, 10, n2, NULL, 0);
+	ck_assert_ptr_eq(obj_target_nhid_lookup(10), t);
+	ck_assert_int_eq(obj_route_count(), 2);
+	ck_assert_ptr_nonnull(t->first_route);
+	ck_assert_ptr_eq(t->first_route->target, t);
+	ck_assert_int_eq(t->rule->state, OBJ_RULE_STATE_OK);
+	ck_assert_mem_eq(&t->rule->have->lladdr.dst, &lladdr_d, ETH_ALEN);
+
+	/* the kernel silently flushes routes using a deleted nexthop */
+	obj_target_nhid_netlink_update(RTM_DELNEXTHOP, 10, NULL, NULL, 0);
+	ck_assert_ptr_null(obj_target_nhid_lookup(10));
+	ck_assert_int_eq(obj_route_count(), 0);
+
+	obj_set_mode(OBJ_MODE_TEARDOWN);
+	rem_link1(); /* this should clean up all the objects */
+
+	post_test();
+}
+END_TEST
+
+START_TEST(obj_multipath_cycle1)
+{
+	struct obj_link *l;
+	struct obj_neigh *n[3];
+	struct obj_neigh *set[3];
+	struct obj_target *t;
+	struct obj_rule *bucket2;
+	struct af_addr net1 = { .af = AF_INET, .mask_len = 24 };
+
+	ck_assert_int_eq(inet_pton(AF_INET, "198.51.100.0", &net1.in), 1);
+
+	pre_test();
+	prepare_addresses();
+	config->verbosity = VERBOSITY_LEVEL_ERROR;
+	obj_rule_reset_pin();
+
+	add_link1();
+	add_neigh1();
+	update_neigh(RTM_NEWNEIGH, 2, &addr_c, &lladdr_d);
+	update_neigh(RTM_NEWNEIGH, 2, &addr_d, &lladdr_e);
+	l = obj_link_lookup(2);
+	n[0] = obj_neigh_fdb_lookup(l, &addr_a);
+	n[1] = obj_neigh_fdb_lookup(l, &addr_c);
+	n[2] = obj_neigh_fdb_lookup(l, &addr_d);
+
+	/* the target is shared by nexthop sets in any order */
+	set[0] = n[2]; set[1] = n[0]; set[2] = n[1];
+	t = obj_target_get_multipath(set, 3);
+	set[0] = n[1]; set[1] = n[2]; set[2] = n[0];
+	ck_assert_ptr_eq(obj_target_get_multipath(set, 3), t);
+	ck_assert_int_eq(t->nexthop_cnt, 3);
+
+	obj_route_netlink_update(RTM_NEWROUTE, t, &net1);
+	obj_rule_remove_pin();
+	ck_assert_int_eq(obj_target_is_ready(t), true);
+
+	/* three nexthops are spread over four buckets in one chain */
+	ck_assert_int_eq(t->bucket_cnt, 4);
+	ck_assert_int_eq(t->rule->have->hash_buckets, 4);
+	ck_assert_int_eq(t->rule->have->hash_bucket, 0);
+	ck_assert_mem_eq(&t->rule->have->lladdr.dst, &lladdr_c, ETH_ALEN);
+	for (unsigned int i = 1; i < 4; i++) {
+		ck_assert_int_eq(t->bucket_rule[i]->chain_no, t->rule->chain_no);
+		ck_assert_int_eq(t->bucket_rule[i]->state, OBJ_RULE_STATE_OK);
+		ck_assert_int_eq(t->bucket_rule[i]->have->hash_bucket, i);
+	}
+	ck_assert_mem_eq(&t->bucket_rule[1]->have->lladdr.dst, &lladdr_d, ETH_ALEN);
+	ck_assert_mem_eq(&t->bucket_rule[2]->have->lladdr.dst, &lladdr_e, ETH_ALEN);
+	ck_assert_mem_eq(&t->bucket_rule[3]->have->lladdr.dst, &lladdr_c, ETH_ALEN);
+
+	/* a changed member only touches it's own bucket */
+	bucket2 = t->bucket_rule[2];
+	update_neigh(RTM_NEWNEIGH, 2, &addr_c, &lladdr_f);
+	ck_assert_int_eq(t->bucket_rule[1]->chain_no, t->rule->chain_no);
+	ck_assert_mem_eq(&t->bucket_rule[1]->have->lladdr.dst, &lladdr_f, ETH_ALEN);
+	ck_assert_ptr_eq(t->bucket_rule[2], bucket2);
+
+	obj_set_mode(OBJ_MODE_TEARDOWN);
+	rem_link1(); /* this should clean up all the objects */
+
+	post_test();
+}
+END_TEST
+
 // TODO test rule placement more
 // TODO test lost and found rules
 // TODO test rule content
@@ -519,6 +1422,7 @@ static void tcase_neigh(Suite *s)
 	tcase_add_test(tc, obj_neigh_cycle1);
 	tcase_add_test(tc, obj_neigh_cycle2);
 	tcase_add_test(tc, obj_neigh_cycle3);
+	tcase_add_test(tc, obj_neigh_fp1);
 
 	suite_add_tcase(s, tc);
 }
@@ -538,8 +1442,23 @@ static void tcase_route(Suite *s)
 	TCase *tc;
 
 	tc = tcase_create("route");
+	tcase_add_test(tc, obj_neigh_probe1);
 	tcase_add_test(tc, obj_route_cycle1);
+	tcase_add_test(tc, obj_route_full1);
+	tcase_add_test(tc, obj_route_move1);
+	tcase_add_test(tc, obj_rule_fail1);
+	tcase_add_test(tc, obj_rule_hw1);
+	tcase_add_test(tc, obj_rule_echo_encode1);
+	tcase_add_test(tc, obj_rule_echo1);
+	tcase_add_test(tc, obj_rule_terse1);
+	tcase_add_test(tc, obj_rule_flush1);
+	tcase_add_test(tc, obj_rule_multidev1);
+	tcase_add_test(tc, obj_rule_trace1);
+	tcase_add_test(tc, obj_rule_block1);
 	tcase_add_test(tc, obj_route_cycle2);
+	tcase_add_test(tc, obj_route_coalesce1);
+	tcase_add_test(tc, obj_nexthop_cycle1);
+	tcase_add_test(tc, obj_multipath_cycle1);
 
 	suite_add_tcase(s, tc);
 }
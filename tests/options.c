@@ -12,7 +12,7 @@ START_TEST(opts_a)
 {
 	size_t len;
 
-	pre_test();
+	pre_test_options();
 	rt_names_init();
 
 	len = sizeof(opts_a_args) / sizeof(char *);
@@ -21,7 +21,8 @@ START_TEST(opts_a)
 
 	ck_assert_int_eq(config->verbosity, VERBOSITY_LEVEL_DEBUG1);
 	ck_assert_int_eq(config->table_id, RT_TABLE_MAIN);
-	ck_assert_pstr_eq(config->ifname, "lo");
+	ck_assert_int_eq(config->if_cnt, 1);
+	ck_assert_pstr_eq(config->ifname[0], "lo");
 
 	rt_names_free();
 	post_test();
@@ -34,7 +35,7 @@ START_TEST(opts_b)
 {
 	size_t len;
 
-	pre_test();
+	pre_test_options();
 	rt_names_init();
 
 	len = sizeof(opts_b_args) / sizeof(char *);
@@ -43,7 +44,8 @@ START_TEST(opts_b)
 
 	ck_assert_int_eq(config->verbosity, VERBOSITY_LEVEL_INFO);
 	ck_assert_int_eq(config->table_id, RT_TABLE_LOCAL);
-	ck_assert_pstr_eq(config->ifname, "lo");
+	ck_assert_int_eq(config->if_cnt, 1);
+	ck_assert_pstr_eq(config->ifname[0], "lo");
 
 	rt_names_free();
 	post_test();
@@ -61,7 +63,7 @@ START_TEST(opts_c)
 	size_t len;
 	int i = 0;
 
-	pre_test();
+	pre_test_options();
 	rt_names_init();
 
 	len = sizeof(opts_c_args) / sizeof(char *);
@@ -69,7 +71,8 @@ START_TEST(opts_c)
 
 	ck_assert_int_eq(config->verbosity, VERBOSITY_LEVEL_INFO);
 	ck_assert_int_eq(config->table_id, RT_TABLE_LOCAL);
-	ck_assert_pstr_eq(config->ifname, "lo");
+	ck_assert_int_eq(config->if_cnt, 1);
+	ck_assert_pstr_eq(config->ifname[0], "lo");
 
 	list = config->prefix_list_head;
 	ck_assert_ptr_nonnull(list);
@@ -98,6 +101,51 @@ START_TEST(opts_c)
 }
 END_TEST
 
+static const char * const opts_d_args[] = {"test", "-i", "lo", "-t", "main", "--full-scans", "--no-tc-monitor"};
+
+START_TEST(opts_d)
+{
+	size_t len;
+
+	pre_test_options();
+	rt_names_init();
+
+	ck_assert_int_eq(config->full_scans, false);
+	ck_assert_int_eq(config->no_tc_monitor, false);
+
+	len = sizeof(opts_d_args) / sizeof(char *);
+	options_parse(len, (char **) &opts_d_args);
+
+	ck_assert_int_eq(config->full_scans, true);
+	ck_assert_int_eq(config->no_tc_monitor, true);
+
+	rt_names_free();
+	post_test();
+}
+END_TEST
+
+static const char * const opts_e_args[] = {"test", "-i", "lo", "-t", "main", "--block", "42"};
+
+START_TEST(opts_e)
+{
+	size_t len;
+
+	pre_test_options();
+	rt_names_init();
+
+	ck_assert_int_eq(config->block_index, 0);
+
+	len = sizeof(opts_e_args) / sizeof(char *);
+	options_parse(len, (char **) &opts_e_args);
+
+	ck_assert_int_eq(config->block_index, 42);
+	ck_assert_int_eq(config->if_cnt, 1);
+
+	rt_names_free();
+	post_test();
+}
+END_TEST
+
 static void tcase_options(Suite *s)
 {
 	TCase *tc;
@@ -106,6 +154,8 @@ static void tcase_options(Suite *s)
 	tcase_add_test(tc, opts_a);
 	tcase_add_test(tc, opts_b);
 	tcase_add_test(tc, opts_c);
+	tcase_add_test(tc, opts_d);
+	tcase_add_test(tc, opts_e);
 
 	suite_add_tcase(s, tc);
 }
@@ -21,7 +21,7 @@ static void check_and_set_last_called(const char *expected, char *new)
 static void foo_execute(EV_P_ void *data)
 {
 	const int *val = data;
-	struct conn *c = queue_get_conn();
+	struct conn *c = queue_get_conn(QUEUE_LANE_DUMP);
 
 	ck_assert_int_eq(*val, foo_data);
 	check_and_set_last_called(NULL, "foo_execute");
@@ -42,7 +42,7 @@ static void foo_completed(EV_P_ void *data, int nl_errno)
 static void bar_execute(EV_P_ void *data)
 {
 	const int *val = data;
-	struct conn *c = queue_get_conn();
+	struct conn *c = queue_get_conn(QUEUE_LANE_DUMP);
 
 	ck_assert_int_eq(*val, bar_data);
 	check_and_set_last_called("foo_completed", "bar_execute");
@@ -69,13 +69,13 @@ START_TEST(queue1)
 	pre_test();
 
 	nl_conn_open(0, &c, "queue_test");
-	queue_init(&c);
+	queue_init(QUEUE_LANE_DUMP, &c);
 
 	queue_schedule(EV_A_ foo_execute, foo_completed, &foo_data);
 	queue_schedule(EV_A_ bar_execute, bar_completed, &bar_data);
 
 	ev_run(EV_A_ 0);
-	queue_fini();
+	queue_fini(QUEUE_LANE_DUMP);
 	nl_conn_close(EV_A_ &c);
 	ck_assert_str_eq(last_called, "bar_completed");
 
@@ -86,7 +86,7 @@ END_TEST
 static void foobar_execute(EV_P_ void *data)
 {
 	const int *val = data;
-	struct conn *c = queue_get_conn();
+	struct conn *c = queue_get_conn(QUEUE_LANE_DUMP);
 
 	ck_assert_int_eq(*val, foobar_data);
 	check_and_set_last_called(NULL, "foobar_execute");
@@ -113,12 +113,12 @@ START_TEST(queue2)
 	pre_test();
 
 	nl_conn_open(0, &c, "queue_test");
-	queue_init(&c);
+	queue_init(QUEUE_LANE_DUMP, &c);
 
 	queue_schedule(EV_A_ foobar_execute, foobar_completed, &foobar_data);
 
 	ev_run(EV_A_ 0);
-	queue_fini();
+	queue_fini(QUEUE_LANE_DUMP);
 	nl_conn_close(EV_A_ &c);
 	ck_assert_str_eq(last_called, "foobar_completed");
 
@@ -126,6 +126,160 @@ START_TEST(queue2)
 }
 END_TEST
 
+static int cancelled_cnt;
+
+static void never_execute(EV_P_ void *data)
+{
+	fr_ev_unused();
+	(void)data;
+	ck_assert_msg(0, "cancelled item was executed");
+}
+
+static void never_completed(EV_P_ void *data, int nl_errno)
+{
+	fr_ev_unused();
+	(void)data;
+	ck_assert_int_eq(nl_errno, ECANCELED);
+	cancelled_cnt++;
+}
+
+START_TEST(queue3)
+{
+	struct conn c = {0};
+	struct ev_loop *loop = EV_DEFAULT;
+
+	last_called = NULL;
+	cancelled_cnt = 0;
+
+	pre_test();
+
+	nl_conn_open(0, &c, "queue_test");
+	queue_init(QUEUE_LANE_DUMP, &c);
+
+	/* the first item is sent right away, so the keyed items has to wait */
+	queue_schedule(EV_A_ foo_execute, foo_completed, &foo_data);
+	queue_schedule_keyed(EV_A_ QUEUE_LANE_DUMP, QUEUE_CLASS_BULK, QUEUE_KIND_OTHER, 1, never_execute, never_completed, &bar_data);
+	ck_assert_int_eq(cancelled_cnt, 0);
+	queue_schedule_keyed(EV_A_ QUEUE_LANE_DUMP, QUEUE_CLASS_BULK, QUEUE_KIND_OTHER, 1, bar_execute, bar_completed, &bar_data);
+	ck_assert_int_eq(cancelled_cnt, 1);
+
+	queue_schedule_keyed(EV_A_ QUEUE_LANE_DUMP, QUEUE_CLASS_BULK, QUEUE_KIND_OTHER, 2, never_execute, never_completed, &foobar_data);
+	ck_assert_int_eq(queue_cancel(EV_A_ QUEUE_LANE_DUMP, 2), true);
+	ck_assert_int_eq(queue_cancel(EV_A_ QUEUE_LANE_DUMP, 2), false);
+	ck_assert_int_eq(cancelled_cnt, 2);
+
+	ev_run(EV_A_ 0);
+	queue_fini(QUEUE_LANE_DUMP);
+	nl_conn_close(EV_A_ &c);
+	ck_assert_str_eq(last_called, "bar_completed");
+	ck_assert_int_eq(cancelled_cnt, 2);
+
+	post_test();
+}
+END_TEST
+
+static int order[4];
+static int order_cnt;
+
+static void order_execute(EV_P_ void *data)
+{
+	const int *val = data;
+
+	fr_ev_unused();
+	ck_assert_int_lt(order_cnt, 4);
+	order[order_cnt++] = *val;
+}
+
+START_TEST(queue4)
+{
+	struct conn c = {0};
+	struct ev_loop *loop = EV_DEFAULT;
+	int one = 1, two = 2, three = 3;
+
+	last_called = NULL;
+	order_cnt = 0;
+
+	pre_test();
+
+	nl_conn_open(0, &c, "queue_test");
+	queue_init(QUEUE_LANE_DUMP, &c);
+
+	/* while the lane is busy, urgent items overtake bulk items */
+	queue_schedule(EV_A_ foo_execute, foo_completed, &foo_data);
+	queue_schedule_in(EV_A_ QUEUE_LANE_DUMP, QUEUE_CLASS_BULK, QUEUE_KIND_OTHER, order_execute, NULL, &one);
+	queue_schedule_in(EV_A_ QUEUE_LANE_DUMP, QUEUE_CLASS_URGENT, QUEUE_KIND_OTHER, order_execute, NULL, &two);
+	queue_schedule_in(EV_A_ QUEUE_LANE_DUMP, QUEUE_CLASS_BULK, QUEUE_KIND_OTHER, order_execute, NULL, &three);
+	ck_assert_int_eq(order_cnt, 0);
+
+	/* the install lane isn't held up by the dump */
+	queue_schedule_in(EV_A_ QUEUE_LANE_INSTALL, QUEUE_CLASS_BULK, QUEUE_KIND_OTHER, order_execute, NULL, &one);
+	ck_assert_int_eq(order_cnt, 1);
+
+	ev_run(EV_A_ 0);
+	queue_fini(QUEUE_LANE_DUMP);
+	nl_conn_close(EV_A_ &c);
+	ck_assert_str_eq(last_called, "foo_completed");
+	ck_assert_int_eq(order_cnt, 4);
+	ck_assert_int_eq(order[1], 2);
+	ck_assert_int_eq(order[2], 1);
+	ck_assert_int_eq(order[3], 3);
+
+	post_test();
+}
+END_TEST
+
+/* act as if the request was sent, but the answer got lost */
+static void hung_execute(EV_P_ void *data)
+{
+	struct conn *c = queue_get_conn(QUEUE_LANE_DUMP);
+
+	fr_ev_unused();
+	(void)data;
+	c->on_send_req(c);
+}
+
+static void hung_completed(EV_P_ void *data, int nl_errno)
+{
+	fr_ev_unused();
+	(void)data;
+	ck_assert_int_eq(nl_errno, ETIMEDOUT);
+	check_and_set_last_called(NULL, NULL);
+	cancelled_cnt++;
+}
+
+START_TEST(queue5)
+{
+	struct conn c = {0};
+	struct ev_loop *loop = EV_DEFAULT;
+	const struct queue_stats *st = queue_get_stats(QUEUE_KIND_OTHER);
+	uint64_t timeouts = st->timeouts;
+
+	last_called = NULL;
+	cancelled_cnt = 0;
+
+	pre_test();
+
+	nl_conn_open(0, &c, "queue_test");
+	queue_init(QUEUE_LANE_DUMP, &c);
+	queue_set_deadline(QUEUE_LANE_DUMP, .05);
+
+	/* the queue recovers, and carries on with the next item */
+	queue_schedule_in(EV_A_ QUEUE_LANE_DUMP, QUEUE_CLASS_BULK, QUEUE_KIND_OTHER, hung_execute, hung_completed, NULL);
+	queue_schedule(EV_A_ foo_execute, foo_completed, &foo_data);
+
+	ev_run(EV_A_ 0);
+	queue_fini(QUEUE_LANE_DUMP);
+	ck_assert_ptr_nonnull(c.nl);
+	nl_conn_close(EV_A_ &c);
+	ck_assert_int_eq(cancelled_cnt, 1);
+	ck_assert_str_eq(last_called, "foo_completed");
+	ck_assert_int_eq(st->timeouts, timeouts + 1);
+	ck_assert(queue_stats_percentile(QUEUE_KIND_DUMP, 50.) > 0.);
+
+	post_test();
+}
+END_TEST
+
 static void tcase_queue(Suite *s)
 {
 	TCase *tc;
@@ -133,6 +287,9 @@ static void tcase_queue(Suite *s)
 	tc = tcase_create("queue");
 	tcase_add_test(tc, queue1);
 	tcase_add_test(tc, queue2);
+	tcase_add_test(tc, queue3);
+	tcase_add_test(tc, queue4);
+	tcase_add_test(tc, queue5);
 
 	suite_add_tcase(s, tc);
 }
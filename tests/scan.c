@@ -5,6 +5,9 @@
 
 #include "../src/scan.h"
 #include "../src/options.h"
+#include "../src/metrics.h"
+#include "../src/capture.h"
+#include "../src/tc_dry_run.h"
 
 static const char * const opts_args[] = {"test", "-i", "lo", "-1", "-t", "main"};
 
@@ -12,7 +15,7 @@ START_TEST(test_scan)
 {
 	size_t len;
 
-	pre_test();
+	pre_test_options();
 
 	len = sizeof(opts_args) / sizeof(char *);
 	options_parse(len, (char **) &opts_args);
@@ -27,12 +30,126 @@ START_TEST(test_scan)
 }
 END_TEST
 
+START_TEST(test_scan_metrics)
+{
+	char buf[16384];
+	size_t len;
+	FILE *f;
+
+	pre_test_options();
+
+	len = sizeof(opts_args) / sizeof(char *);
+	options_parse(len, (char **) &opts_args);
+
+	struct ev_loop *loop = EV_DEFAULT;
+
+	scan_init(EV_A);
+	ev_run(EV_A_ 0);
+
+	f = tmpfile();
+	ck_assert_ptr_nonnull(f);
+	metrics_print(f);
+	rewind(f);
+	len = fread(buf, 1, sizeof(buf) - 1, f);
+	buf[len] = '\0';
+	fclose(f);
+	scan_fini(EV_A);
+
+	ck_assert_ptr_nonnull(strstr(buf, "flower_route_queue_depth{lane=\"install\"} 0\n"));
+	ck_assert_ptr_nonnull(strstr(buf, "flower_route_netlink_requests_total{conn=\"scan\"} "));
+	ck_assert_ptr_nonnull(strstr(buf, "flower_route_scan_dumps{helper=\"links\"} 1\n"));
+	ck_assert_ptr_nonnull(strstr(buf, "flower_route_scan_dumps{helper=\"route6\"} 1\n"));
+	ck_assert_ptr_nonnull(strstr(buf, "flower_route_rules{state=\"ok\"} "));
+
+	post_test();
+}
+END_TEST
+
+static int capture_packet_cb(const struct capture_packet *p, void *data)
+{
+	unsigned int *msgs = data;
+	const struct nlmsghdr *nlh = p->buf;
+	int len = p->len;
+
+	ck_assert_int_ne(p->portid, 0);
+	ck_assert_int_gt(p->ts, 0);
+	ck_assert(mnl_nlmsg_ok(nlh, len));
+	while (mnl_nlmsg_ok(nlh, len)) {
+		(*msgs)++;
+		nlh = mnl_nlmsg_next(nlh, &len);
+	}
+	ck_assert_int_eq(len, 0);
+	return 0;
+}
+
+START_TEST(test_scan_capture)
+{
+	char path[64];
+	unsigned int msgs = 0;
+	size_t len;
+
+	pre_test_options();
+
+	len = sizeof(opts_args) / sizeof(char *);
+	options_parse(len, (char **) &opts_args);
+
+	snprintf(path, sizeof(path), "/tmp/flower-route-capture.%d", (int) getpid());
+	ck_assert_int_eq(capture_open(path), 0);
+
+	struct ev_loop *loop = EV_DEFAULT;
+
+	scan_init(EV_A);
+	ev_run(EV_A_ 0);
+	scan_fini(EV_A);
+	capture_close();
+
+	/* at least one reply per dump, read back as written */
+	ck_assert_int_ge(capture_read(path, capture_packet_cb, &msgs), 7);
+	ck_assert_int_ge(msgs, 7);
+	unlink(path);
+
+	post_test();
+}
+END_TEST
+
+START_TEST(test_scan_dry_run)
+{
+	static const char * const args[] = {"test", "-i", "lo", "-1", "-t", "main", "-s", "1", "--dry-run"};
+	size_t len;
+
+	pre_test_options();
+
+	len = sizeof(args) / sizeof(char *);
+	options_parse(len, (char **) &args);
+	tc_dry_run_init();
+
+	struct ev_loop *loop = EV_DEFAULT;
+
+	scan_init(EV_A);
+	ck_assert_str_eq(scan_stats_name(0), "filters");
+	ev_run(EV_A_ 0);
+	ck_assert_int_eq(scan_get_stats(0)->dumps, 1);
+
+	/* the model has the filters by now, and is kept up to date */
+	ev_run(EV_A_ 0);
+	ck_assert_int_eq(scan_get_stats(0)->dumps, 0);
+	ck_assert_int_eq(scan_get_stats(1)->dumps, 1);
+	scan_fini(EV_A);
+	tc_dry_run_fini();
+
+	post_test();
+}
+END_TEST
+
 static void tcase_scan(Suite *s)
 {
 	TCase *tc;
 
 	tc = tcase_create("scan");
 	tcase_add_test(tc, test_scan);
+	tcase_add_test(tc, test_scan_metrics);
+	tcase_add_test(tc, test_scan_capture);
+	tcase_add_test(tc, test_scan_dry_run);
 
 	suite_add_tcase(s, tc);
 }
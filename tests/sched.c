@@ -10,6 +10,9 @@
 #include "../src/obj_rule.h"
 #include "../src/nl_queue.h"
 #include "../src/sched.h"
+#include "../src/tc_action.h"
+#include "../src/tc_encode.h"
+#include "../src/tc_dry_run.h"
 
 START_TEST(obj_sched_basic1)
 {
@@ -28,12 +31,96 @@ START_TEST(obj_sched_basic1)
 }
 END_TEST
 
+START_TEST(obj_sched_dry_run)
+{
+	struct ev_loop *loop = EV_DEFAULT; /* TODO find a better way */
+	struct tc_action_callbacks *tacb;
+	struct tc_dry_run_stats st;
+	struct tc_rule tcr = {0};
+
+	pre_test();
+	config->dry_run = true;
+	tc_dry_run_init();
+	tacb = tc_action_get_callbacks();
+	obj_rule_reset_pin();
+
+	sched_init();
+
+	obj_rule_remove_pin();
+	ck_assert_int_eq(obj_rule_count(), 4);
+	tc_dry_run_get_stats(&st);
+	ck_assert_int_eq(st.installs, 4);
+	ck_assert_int_eq(st.failures, 0);
+	ck_assert_int_eq(st.rules, 4);
+	ck_assert_int_eq(st.chains, 3);
+	ck_assert_int_eq(st.masks, 4);
+
+	/*
+	 * on a chain of its own, out of the way of the scheduled rules,
+	 * and pinned, so filters that aren't wanted are left alone
+	 */
+	obj_rule_reset_pin();
+	tc_rule_init(&tcr);
+	tcr.af_addr.af = AF_INET;
+	tc_rule_set_type_and_traits(&tcr, TC_RULE_TYPE_TTL_CHECK);
+	ck_assert_int_eq(tacb->install(EV_A_ 0, 9, 1, &tcr, NO_TCE_FLAGS), 0);
+	ck_assert_int_eq(tacb->install(EV_A_ 0, 9, 2, &tcr, NO_TCE_FLAGS), 0);
+	tc_dry_run_get_stats(&st);
+	ck_assert_int_eq(st.installs, 6);
+	ck_assert_int_eq(st.rules, 6);
+	ck_assert_int_eq(st.chains, 4);
+	ck_assert_int_eq(st.masks, 5);
+
+	/* the kernel would refuse a taken prio */
+	ck_assert_int_eq(tacb->install(EV_A_ 0, 9, 1, &tcr, NO_TCE_FLAGS), EEXIST);
+	tc_dry_run_get_stats(&st);
+	ck_assert_int_eq(st.installs, 6);
+	ck_assert_int_eq(st.failures, 1);
+	ck_assert_int_eq(st.rules, 6);
+
+	/* but not replacing what's there */
+	ck_assert_int_eq(tacb->install(EV_A_ 0, 9, 1, &tcr, TCE_FLAG_REPLACE), 0);
+	tc_dry_run_get_stats(&st);
+	ck_assert_int_eq(st.replaces, 1);
+	ck_assert_int_eq(st.failures, 1);
+	ck_assert_int_eq(st.rules, 6);
+
+	ck_assert_int_eq(tacb->install(EV_A_ 0, 9, 1, NULL, NO_TCE_FLAGS), 0);
+	tc_dry_run_get_stats(&st);
+	ck_assert_int_eq(st.uninstalls, 1);
+	ck_assert_int_eq(st.rules, 5);
+	ck_assert_int_eq(st.chains, 4);
+
+	/* nor a filter that's already gone */
+	ck_assert_int_eq(tacb->install(EV_A_ 0, 9, 1, NULL, NO_TCE_FLAGS), ENOENT);
+	tc_dry_run_get_stats(&st);
+	ck_assert_int_eq(st.uninstalls, 1);
+	ck_assert_int_eq(st.failures, 2);
+	ck_assert_int_eq(st.rules, 5);
+
+	/* a flush takes the whole chain, and only that */
+	ck_assert_int_eq(tacb->install(EV_A_ 0, 9, 0, NULL, NO_TCE_FLAGS), 0);
+	tc_dry_run_get_stats(&st);
+	ck_assert_int_eq(st.flushes, 1);
+	ck_assert_int_eq(st.rules, 4);
+	ck_assert_int_eq(st.chains, 3);
+	ck_assert_int_eq(st.masks, 4);
+
+	obj_set_mode(OBJ_MODE_TEARDOWN);
+	obj_rule_clear_all();
+	tc_dry_run_fini();
+	config->dry_run = false;
+	post_test();
+}
+END_TEST
+
 static void tcase_sched(Suite *s)
 {
 	TCase *tc;
 
 	tc = tcase_create("basic");
 	tcase_add_test(tc, obj_sched_basic1);
+	tcase_add_test(tc, obj_sched_dry_run);
 
 	suite_add_tcase(s, tc);
 }